@@ -4,19 +4,39 @@
 #include <queue>
 #include <unordered_map>
 #include <atomic>
+#include <chrono>
 #include <mutex>
 #include <queue>
 #include <string>
 #include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <sqlite3.h>  // Include SQLite header
 #include <SQLiteCpp/SQLiteCpp.h>
 
 #include "../../ollama/include/ollama.hpp"
+#include "context.hpp"
+#include "conversation.hpp"
+#include "journal.hpp"
+#include "shared_query_store.hpp"
 #include "../../http/include/client.hpp"
+#include "../../http/include/async_client.hpp"
 #include "../../log/include/log.hpp"
 
+/**
+ * @brief A performance metric sample waiting to be written to the database.
+ */
+struct MetricSample {
+    std::string metric_name;
+    double metric_value;
+    std::chrono::system_clock::time_point timestamp;
+};
+
 struct MetricStatistic {
     std::string metric_name;
     double average_value;
@@ -32,6 +52,11 @@ struct MetricStatistic {
  * This structure holds all the information related to a single query, 
  * including the prompt, responses, and its state (e.g., running, completed, canceled).
  */
+struct Query;
+
+/// Callback invoked on the processing thread once a query has finished.
+using QueryCompletionHandler = std::function<void(const std::shared_ptr<Query>&)>;
+
 struct Query {
     std::string id;  ///< Unique identifier for the query.
     std::string prompt;  ///< The prompt to be sent to the LLM.
@@ -40,7 +65,33 @@ struct Query {
     std::atomic<bool> completed{false};  ///< Indicates whether the query has been completed.
     std::atomic<bool> running{false};  ///< Indicates whether the query is currently running.
     std::atomic<bool> canceled{false};  ///< Indicates whether the query has been canceled.
-    ollama::response last_context;
+    std::vector<int32_t> context;  ///< Packed context tokens: the input context until the query completes, then the final context.
+    std::string conversation_id;  ///< Conversation the query belongs to; empty for stand-alone generations.
+    std::string callback_url;  ///< https:// URL the final result is POSTed to, if any.
+    std::string error;  ///< Why the query failed; empty unless it failed. Set before `completed`.
+    int eval_count{0};  ///< Number of tokens generated, as reported by Ollama.
+    int shared_slot{-1};  ///< Slot in the shared query store, or -1 if the query is not shared.
+    QueryCompletionHandler on_complete;  ///< Optional callback invoked once the query has finished.
+};
+
+/**
+ * @brief One prompt of a bulk submission.
+ */
+struct BatchItem {
+    std::string prompt;  ///< The prompt to be sent to the LLM.
+    std::vector<int32_t> context;  ///< Context tokens returned by a previous query, if any.
+    std::string conversation_id;  ///< Conversation the prompt belongs to, if any.
+    std::string callback_url;  ///< https:// URL the final result is POSTed to, if any.
+};
+
+/**
+ * @brief Construction options for the Application.
+ */
+struct ApplicationOptions {
+    std::string journal_path = "query_journal.log";  ///< Path of the write-ahead query journal; empty disables journaling.
+    std::size_t workers = 1;  ///< Number of queries processed concurrently, each with its own Ollama client.
+    std::shared_ptr<SharedQueryStore> shared_store;  ///< Query state shared with the other worker processes, if any.
+    AsyncClientOptions webhook;  ///< Limits and trusted CAs of the client delivering completion callbacks.
 };
 
 /**
@@ -56,12 +107,20 @@ public:
     /**
      * @brief Constructs an Application object.
      * 
+     * Replays the query journal before the processing thread starts, so queries that were
+     * pending at the last shutdown are re-enqueued and completed ones stay queryable.
+     *
      * @param ioc The Boost.Asio I/O context that the application will use for asynchronous operations.
+     * @param ssl_ctx The SSL context used by the HTTP client.
+     * @param options Journal location and number of processing threads.
      */
-    Application(boost::asio::io_context& ioc, ssl::context& ssl_ctx);
+    Application(boost::asio::io_context& ioc, ssl::context& ssl_ctx, ApplicationOptions options = ApplicationOptions());
 
     /**
-     * @brief Destructor for Application class to close SQLite connection.
+     * @brief Stops the processing threads and waits for them, then closes the SQLite connection.
+     *
+     * A query being processed is finished first; queued queries stay in the journal.
+     * Buffered performance metrics are written before the connection closes.
      */
     ~Application();
 
@@ -71,9 +130,35 @@ public:
      * Generates a unique query ID, stores the prompt, and places the query in the queue for processing.
      * 
      * @param prompt The prompt to be sent to the LLM.
+     * @param context Context tokens returned by a previous query, if any.
+     * @param conversation_id If set, the prompt is sent as the next chat turn of this conversation
+     *                        and its history is kept within the model's context window.
+     * @param on_complete Optional callback invoked on the processing thread once the query has finished.
+     * @param callback_url Optional https:// URL the final result is POSTed to once the query has finished.
      * @return The unique ID of the newly added query.
      */
-    std::string add_query(const std::string& prompt, const ollama::response& context = ollama::response());
+    std::string add_query(const std::string& prompt, std::vector<int32_t> context = {}, const std::string& conversation_id = "",
+                          QueryCompletionHandler on_complete = nullptr, const std::string& callback_url = "");
+
+    /**
+     * @brief Adds many queries at once.
+     *
+     * All queries are queued under a single acquisition of the queue lock and grouped
+     * under a batch ID whose progress can be polled with get_batch_status().
+     *
+     * @param items The prompts to queue, in order.
+     * @param query_ids Receives the query ID of each item, in the same order.
+     * @return The unique ID of the batch.
+     */
+    std::string add_batch(std::vector<BatchItem> items, std::vector<std::string>& query_ids);
+
+    /**
+     * @brief Retrieves the aggregated progress of a batch.
+     *
+     * @param batch_id The unique ID of the batch.
+     * @return A JSON string with the number of queued, running, completed and canceled queries.
+     */
+    std::string get_batch_status(const std::string& batch_id);
 
     /**
      * @brief Retrieves the status of a specific query.
@@ -96,20 +181,70 @@ public:
 
     void fetch_and_update_json_data(); 
     // Existing methods, if any, should be documented similarly.
+
+    /**
+     * @brief Buffers a performance metric sample; a background thread writes the buffer to the database.
+     *
+     * Cheap enough for the io threads. Samples beyond max_buffered_metrics are dropped
+     * and counted until the next write.
+     *
+     * @param metric_name The name of the metric.
+     * @param metric_value The sampled value.
+     */
     void log_performance_metric(const std::string& metric_name, double metric_value);
     std::vector<MetricStatistic> get_performance_statistics();
     nlohmann::json get_performance_statistics_json();
 private:
     boost::asio::io_context& io_context_;  ///< Reference to the I/O context used for async operations.
     ssl::context& ssl_ctx_;
-    Ollama ollama_;  ///< Instance of Ollama API handler.
+    std::vector<std::unique_ptr<Ollama>> ollama_;  ///< One Ollama API handler per processing thread.
     boost::asio::steady_timer timer_;  ///< Timer used for scheduling tasks or timeouts.
     std::shared_ptr<Client> client_; ///< Client used for making http requests
+    std::shared_ptr<AsyncClient> webhook_client_;  ///< Pooled client delivering completion callbacks.
     std::queue<std::shared_ptr<Query>> query_queue_;  ///< Queue holding queries to be processed.
     std::unordered_map<std::string, std::shared_ptr<Query>> query_map_;  ///< Map from query IDs to their associated Query objects.
+    std::unordered_map<std::string, std::vector<std::shared_ptr<Query>>> batch_map_;  ///< Map from batch IDs to their queries.
+    std::deque<std::string> batch_order_;  ///< Batch IDs, oldest first, for evicting finished batches.
+    static constexpr std::size_t max_retained_batches = 10000;  ///< Batches kept before finished ones are evicted.
+    std::atomic<uint64_t> id_sequence_{0};  ///< Disambiguates IDs generated within the same clock tick.
     std::mutex queue_mutex_;  ///< Mutex to protect access to the query queue and map.
     std::condition_variable queue_cv_;  ///< Condition variable to signal when new queries are added to the queue.
+    bool stopping_ = false;  ///< Set by the destructor to end the processing threads; guarded by queue_mutex_.
+    std::vector<std::thread> workers_;  ///< The processing threads, joined by the destructor.
     std::unique_ptr<SQLite::Database> db_;
+    ConversationManager conversations_;  ///< Context-window policy for chat conversations.
+    std::unique_ptr<QueryJournal> journal_;  ///< Write-ahead journal of accepted and completed queries, if enabled.
+    std::shared_ptr<SharedQueryStore> shared_store_;  ///< Cross-process query state in prefork mode, if enabled.
+
+    static constexpr std::size_t max_buffered_metrics = 10000;  ///< Samples buffered between two writes.
+    static constexpr std::chrono::seconds metrics_flush_interval{1};  ///< How often buffered samples are written.
+    std::vector<MetricSample> metrics_;  ///< Samples not yet written, guarded by metrics_mutex_.
+    uint64_t dropped_metrics_ = 0;  ///< Samples dropped since the last write, guarded by metrics_mutex_.
+    bool metrics_stopping_ = false;  ///< Set by the destructor to end the metrics writer; guarded by metrics_mutex_.
+    std::mutex metrics_mutex_;
+    std::condition_variable metrics_cv_;
+    std::thread metrics_writer_;  ///< Writes the buffered samples every metrics_flush_interval.
+
+    /**
+     * @brief Generates a unique ID for a query or batch.
+     */
+    std::string generate_id(const std::string& seed);
+
+    /**
+     * @brief Publishes a new query to the shared query store, if there is one.
+     */
+    void share_query(const std::shared_ptr<Query>& query);
+
+    /**
+     * @brief POSTs the final result of a query to its callback URL.
+     */
+    void deliver_webhook(const std::shared_ptr<Query>& query);
+
+    /**
+     * @brief Rebuilds the query queue and map from the journal.
+     */
+    void recover_queries();
+
     /**
      * @brief Initializes the SQLite database connection.
      * 
@@ -124,13 +259,30 @@ private:
      */
     void check_and_create_tables();
 
+    /**
+     * @brief Evicts the oldest finished batches beyond max_retained_batches; called with queue_mutex_ held.
+     */
+    void evict_finished_batches();
+
+    /**
+     * @brief Writes the buffered performance metrics every metrics_flush_interval until stopped.
+     */
+    void run_metrics_writer();
+
+    /**
+     * @brief Writes performance metric samples to the database in one transaction.
+     */
+    void write_metrics(const std::vector<MetricSample>& samples, uint64_t dropped);
+
     /**
      * @brief Continuously processes queries from the queue.
      * 
      * This function runs in a separate thread, popping queries from the queue and processing them.
      * If a query is canceled, it will be skipped.
+     *
+     * @param worker Index of the processing thread, selecting its Ollama client.
      */
-    void process_queries();
+    void process_queries(std::size_t worker);
 
     /**
      * @brief Processes a single query by sending it to the LLM and handling partial responses.
@@ -139,8 +291,9 @@ private:
      * completed when all responses have been received or if an error occurs.
      * 
      * @param query The query to be processed.
+     * @param ollama The Ollama client owned by the calling processing thread.
      */
-    void run_query(const std::shared_ptr<Query>& query);
+    void run_query(const std::shared_ptr<Query>& query, Ollama& ollama);
 };
 
 #endif // APPLICATION_HPP
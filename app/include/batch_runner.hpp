@@ -0,0 +1,97 @@
+#ifndef BATCH_RUNNER_HPP
+#define BATCH_RUNNER_HPP
+
+#include <condition_variable>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include "application.hpp"
+#include "../../log/include/log.hpp"
+
+/**
+ * @brief Options for a batch-inference run.
+ */
+struct BatchOptions {
+    std::string input_path;  ///< JSONL file with one prompt object per line.
+    std::string output_path;  ///< JSONL file the results are appended to.
+    std::string checkpoint_path;  ///< Progress file; defaults to output_path + ".checkpoint".
+    std::size_t concurrency = 1;  ///< Maximum number of prompts in flight.
+    bool ordered = false;  ///< Write results in input order instead of completion order.
+};
+
+/**
+ * @brief Streams a JSONL file of prompts through the Application query pipeline.
+ *
+ * Each input line is a JSON object whose prompt is read from "prompt", "message"
+ * or "body", and whose identifier is read from "request_id" or "id" (the line
+ * number is used otherwise). At most `concurrency` prompts are queued or waiting
+ * to be written at a time. Every result is appended to the output file and, unless
+ * its query failed, its line number to the checkpoint file, so an interrupted run
+ * resumes where it stopped and retries the failed prompts.
+ */
+class BatchRunner {
+public:
+    /**
+     * @brief Constructs a batch runner.
+     *
+     * @param app The application whose query pipeline processes the prompts.
+     * @param options The batch options.
+     */
+    BatchRunner(Application& app, BatchOptions options);
+
+    /**
+     * @brief Processes the whole input file.
+     *
+     * Blocks until every prompt has been written to the output file, then reports
+     * the number of prompts processed, tokens generated, tokens/sec and wall time.
+     *
+     * @return EXIT_SUCCESS if the input was processed, EXIT_FAILURE otherwise.
+     */
+    int run();
+
+private:
+    /**
+     * @brief A finished line waiting to be written.
+     */
+    struct Result {
+        std::string json;  ///< The result object, serialized.
+        bool checkpoint;  ///< Whether to record the line as done; false for failed queries.
+    };
+
+    Application& app_;
+    BatchOptions options_;
+    std::shared_ptr<Logger> logger_;
+
+    std::mutex mutex_;
+    std::condition_variable done_cv_;
+    std::size_t in_flight_ = 0;  ///< Lines taken from the input whose result is not yet written.
+    std::set<std::size_t> done_lines_;  ///< Lines already written, loaded from the checkpoint.
+    std::map<std::size_t, Result> reorder_buffer_;  ///< Finished results waiting for earlier lines (ordered mode).
+    std::size_t next_line_ = 0;  ///< Next line to write in ordered mode.
+    std::ofstream output_;
+    std::ofstream checkpoint_;
+    uint64_t total_tokens_ = 0;
+    std::size_t processed_ = 0;
+
+    void load_checkpoint();
+
+    /**
+     * @brief Stores a finished result and writes everything that is ready. Called with mutex_ held.
+     */
+    void complete(std::size_t line, Result result);
+
+    /**
+     * @brief Appends one result, checkpoints its line and frees its slot. Called with mutex_ held.
+     */
+    void write_result(std::size_t line, const Result& result);
+
+    /**
+     * @brief Advances next_line_ past lines finished in a previous run. Called with mutex_ held.
+     */
+    void skip_done_lines();
+};
+
+#endif // BATCH_RUNNER_HPP
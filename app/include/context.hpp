@@ -0,0 +1,49 @@
+#ifndef CONTEXT_HPP
+#define CONTEXT_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../../ollama/include/json.hpp"
+
+/**
+ * @file context.hpp
+ * @brief Helpers for storing and forwarding Ollama context token arrays.
+ *
+ * Ollama returns the conversation state as a (potentially very long) array of
+ * integer tokens on the final streamed response. Instead of keeping the whole
+ * response as a JSON DOM, queries keep only the packed token array and splice
+ * it straight into the serialized body of the next request.
+ */
+
+/**
+ * @brief Extract a packed context token array from a JSON value.
+ *
+ * Accepts either a bare array of integers or an object holding such an array
+ * under the "context" key (i.e. a raw Ollama response). Anything else yields
+ * an empty context.
+ *
+ * @param value The JSON value to read the tokens from.
+ * @return The context tokens, or an empty vector if none were found.
+ */
+std::vector<int32_t> parse_context_tokens(const nlohmann::json& value);
+
+/**
+ * @brief Append the tokens to a string as a JSON array without building a DOM.
+ *
+ * @param out The string to append to.
+ * @param tokens The context tokens to serialize.
+ */
+void append_context_tokens(std::string& out, const std::vector<int32_t>& tokens);
+
+/**
+ * @brief Splice a "context" member into an already serialized JSON object.
+ *
+ * @param request_body A serialized JSON object, e.g. the output of ollama::request::dump().
+ * @param tokens The context tokens to add. Nothing is added if empty.
+ * @return The serialized request with the context member appended.
+ */
+std::string splice_context(std::string request_body, const std::vector<int32_t>& tokens);
+
+#endif // CONTEXT_HPP
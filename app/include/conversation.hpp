@@ -0,0 +1,165 @@
+#ifndef CONVERSATION_HPP
+#define CONVERSATION_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "../../ollama/include/ollama.hpp"
+#include "../../log/include/log.hpp"
+
+/**
+ * @brief Tunables for the context-window policy applied to chat conversations.
+ */
+struct ConversationPolicy {
+    std::string model = "llava:latest";  ///< Model used for the conversation and for summaries.
+    int num_ctx = 4096;  ///< Context window (in tokens) requested from the model.
+    double compact_threshold = 0.75;  ///< Fraction of num_ctx above which older turns are compacted.
+    std::size_t keep_recent_messages = 4;  ///< Number of most recent messages that are never compacted.
+    std::string server_url = "http://localhost:11434";  ///< Ollama server used for background summaries.
+    std::size_t max_conversations = 10000;  ///< Conversations kept; the least recently used ones are evicted.
+    std::chrono::seconds idle_timeout{3600};  ///< Conversations unused for this long are evicted.
+};
+
+/**
+ * @brief Keeps per-conversation chat history within the model's context window.
+ *
+ * The manager tracks an estimated token count for every message of a conversation
+ * and corrects it with the exact counts Ollama reports (prompt_eval_count and
+ * eval_count). Once a conversation crosses the compaction threshold, the older
+ * messages are summarized by a background generation and replaced with a single
+ * system message, so the prompt evaluated on every turn stays bounded. If the
+ * history grows past the full context window before the summary is ready, the
+ * oldest messages are trimmed synchronously.
+ *
+ * At most max_conversations are kept. When a prompt arrives, conversations idle for
+ * longer than idle_timeout, or the least recently used beyond the limit, are evicted;
+ * a conversation waiting for a reply is never evicted.
+ */
+class ConversationManager {
+public:
+    /**
+     * @brief Constructs the manager and starts the background compaction thread.
+     *
+     * @param policy The context-window policy to apply.
+     */
+    explicit ConversationManager(ConversationPolicy policy = ConversationPolicy());
+
+    /**
+     * @brief Stops the background compaction thread.
+     */
+    ~ConversationManager();
+
+    /**
+     * @brief Appends a user prompt to a conversation and returns the messages to send.
+     *
+     * @param conversation_id The conversation the prompt belongs to. Unknown IDs start a new conversation.
+     * @param prompt The user prompt.
+     * @return The (possibly compacted) message history including the new prompt.
+     */
+    ollama::messages prepare(const std::string& conversation_id, const std::string& prompt);
+
+    /**
+     * @brief Records the assistant reply for the latest prompt of a conversation.
+     *
+     * Updates the token accounting with the counts reported by Ollama and schedules a
+     * background compaction if the conversation crossed the threshold.
+     *
+     * @param conversation_id The conversation the reply belongs to.
+     * @param reply The full assistant reply.
+     * @param prompt_tokens The prompt_eval_count reported by Ollama, or a negative value if unknown.
+     * @param reply_tokens The eval_count reported by Ollama, or a negative value if unknown.
+     */
+    void record_reply(const std::string& conversation_id, const std::string& reply, int prompt_tokens, int reply_tokens);
+
+    /**
+     * @brief Rolls back the latest prompt of a conversation if no reply was recorded for it.
+     *
+     * Called once a query of the conversation finished, so a failed or canceled turn
+     * leaves no unanswered prompt in the history.
+     *
+     * @param conversation_id The conversation of the finished query.
+     */
+    void abandon_pending(const std::string& conversation_id);
+
+    /**
+     * @brief Returns the current token estimate for a conversation.
+     *
+     * @param conversation_id The conversation to inspect.
+     * @return The number of tokens the history is expected to occupy, or 0 if unknown.
+     */
+    int token_count(const std::string& conversation_id);
+
+    /**
+     * @brief Builds the request options carrying the configured context window.
+     *
+     * @return Options suitable for an ollama::request.
+     */
+    ollama::options request_options() const;
+
+    const ConversationPolicy& policy() const { return policy_; }
+
+private:
+    struct Conversation {
+        ollama::messages history;  ///< Messages sent to the model, oldest first.
+        std::vector<int> tokens;  ///< Token count of each message in history.
+        std::size_t trimmed = 0;  ///< Number of messages dropped from the front so far.
+        bool compacting = false;  ///< Whether a background summary is in flight.
+        bool awaiting_reply = false;  ///< Whether the last message is a prompt still being answered.
+        std::chrono::steady_clock::time_point last_used;
+        std::list<std::string>::iterator lru;  ///< Position in lru_.
+    };
+
+    struct CompactionJob {
+        std::string conversation_id;
+        ollama::messages messages;  ///< Snapshot of the prefix being summarized.
+        std::size_t trimmed;  ///< Value of Conversation::trimmed when the snapshot was taken.
+    };
+
+    ConversationPolicy policy_;
+    Ollama ollama_;  ///< Dedicated client so summaries never block query processing.
+    std::unordered_map<std::string, Conversation> conversations_;
+    std::list<std::string> lru_;  ///< Conversation IDs, most recently used first.
+    std::mutex mutex_;
+    std::deque<CompactionJob> jobs_;
+    std::condition_variable jobs_cv_;
+    bool stopping_ = false;
+    std::thread worker_;
+    std::shared_ptr<Logger> logger_;
+
+    static int estimate_tokens(const std::string& text);
+    static int total_tokens(const Conversation& conversation);
+
+    /**
+     * @brief Marks a conversation as just used.
+     */
+    void touch(Conversation& conversation);
+
+    /**
+     * @brief Evicts idle conversations and the least recently used ones beyond max_conversations.
+     */
+    void evict();
+
+    /**
+     * @brief Drops the oldest compactable messages until the history fits in the context window.
+     */
+    void trim_to_fit(Conversation& conversation);
+
+    /**
+     * @brief Queues a background summary of the older messages if the threshold is exceeded.
+     */
+    void maybe_schedule_compaction(const std::string& conversation_id, Conversation& conversation);
+
+    /**
+     * @brief Background loop summarizing queued conversation prefixes.
+     */
+    void run_compactions();
+};
+
+#endif // CONVERSATION_HPP
@@ -0,0 +1,157 @@
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../../log/include/log.hpp"
+
+/**
+ * @brief State of a query as reconstructed from the journal.
+ */
+struct JournaledQuery {
+    std::string id;  ///< Unique identifier of the query.
+    std::string prompt;  ///< The prompt sent to the LLM.
+    std::string conversation_id;  ///< Conversation the query belongs to, if any.
+    std::string callback_url;  ///< URL the final result is POSTed to, if any.
+    std::vector<int32_t> context;  ///< Input context while pending, final context once completed.
+    std::vector<std::string> partial_responses;  ///< Responses received, only set for completed queries.
+    bool completed = false;  ///< Whether a completion record was found.
+    bool canceled = false;  ///< Whether the query was canceled.
+};
+
+/**
+ * @brief Append-only, fsync-batched journal of accepted and completed queries.
+ *
+ * Every record is framed as [length][crc32][type][payload]. Records are appended
+ * to an in-memory batch and a background thread writes and fdatasync()s the batch
+ * at most every flush interval (group commit), so callers never wait for the disk.
+ *
+ * On startup the journal is scanned through a read-only mmap. A torn record at the
+ * tail, left behind by a crash, ends the scan and is truncated away. When the file
+ * holds many superseded records, or more completed queries than the retention
+ * limit, it is rewritten with one record pair per live query and swapped in with
+ * an atomic rename. The writer thread compacts without holding the lock, so
+ * appends carry on meanwhile and land in the new file.
+ *
+ * A batch that fails to be written or synced is cut off the file again and
+ * retried; its records are not reported durable until a retry succeeds.
+ */
+class QueryJournal {
+public:
+    /**
+     * @brief Opens (or creates) the journal file and starts the writer thread.
+     *
+     * @param path Path of the journal file.
+     * @param flush_interval Maximum time a record waits in memory before it is fsynced.
+     * @param max_retained_completed Number of completed queries kept across compactions.
+     * @throws std::runtime_error if the file cannot be opened.
+     */
+    QueryJournal(const std::string& path,
+                 std::chrono::milliseconds flush_interval = std::chrono::milliseconds(5),
+                 std::size_t max_retained_completed = 100000);
+
+    /**
+     * @brief Flushes outstanding records and stops the writer thread.
+     */
+    ~QueryJournal();
+
+    /**
+     * @brief Replays the journal and returns the state of every known query.
+     *
+     * Queries are returned in the order they were accepted. Compacts the file if
+     * it holds too many superseded records.
+     *
+     * @return The recovered queries.
+     */
+    std::vector<JournaledQuery> recover();
+
+    /**
+     * @brief Records that a query was accepted into the queue.
+     */
+    void record_accepted(const std::string& id, const std::string& prompt,
+                         const std::string& conversation_id, const std::vector<int32_t>& context,
+                         const std::string& callback_url = "");
+
+    /**
+     * @brief Records the final state of a query once it has been processed.
+     */
+    void record_completed(const std::string& id, bool canceled,
+                          const std::vector<std::string>& partial_responses, const std::vector<int32_t>& context);
+
+    /**
+     * @brief Records that a query was canceled before it ran.
+     */
+    void record_canceled(const std::string& id);
+
+    /**
+     * @brief Blocks until every record appended so far is durable.
+     *
+     * @throws std::runtime_error if the journal cannot be written; the records stay pending.
+     */
+    void flush();
+
+private:
+    enum class RecordType : uint8_t { accepted = 1, completed = 2, canceled = 3 };
+
+    std::string path_;
+    std::chrono::milliseconds flush_interval_;
+    std::size_t max_retained_completed_;
+    int fd_ = -1;
+    std::string pending_;  ///< Encoded records waiting to be written.
+    uint64_t appended_ = 0;  ///< Number of records appended by callers.
+    uint64_t durable_ = 0;  ///< Number of records written and fsynced.
+    uint64_t records_in_file_ = 0;  ///< Records currently stored in the file.
+    uint64_t live_queries_ = 0;  ///< Queries the last scan or compaction kept.
+    std::string error_;  ///< Why the last batch could not be made durable; empty once one succeeds.
+    bool stopping_ = false;
+    std::mutex mutex_;
+    std::condition_variable pending_cv_;
+    std::condition_variable durable_cv_;
+    std::thread writer_;
+    std::shared_ptr<Logger> logger_;
+
+    void append(RecordType type, const std::string& payload);
+    void run_writer();
+
+    /**
+     * @brief Appends a batch to the file and syncs it; a failed batch is truncated away again.
+     *
+     * @return An empty string on success, else the reason it failed.
+     */
+    std::string write_batch(int fd, const std::string& batch);
+
+    /**
+     * @brief Scans the journal through mmap and folds its records into per-query state.
+     *
+     * @param fd The journal.
+     * @param valid_bytes Set to the length of the intact record prefix.
+     * @param records Set to the number of intact records.
+     */
+    std::vector<JournaledQuery> scan(int fd, uint64_t& valid_bytes, uint64_t& records);
+
+    /**
+     * @brief Rewrites the journal with one record pair per retained query.
+     *
+     * Runs at startup and from the writer thread once the file outgrows the
+     * retained state. Touches nothing guarded by mutex_; the caller swaps the
+     * returned descriptor in.
+     *
+     * @param written_records Set to the number of records in the new file.
+     * @return The new journal opened for appending, or -1 if the old one stays in place.
+     */
+    int compact(std::vector<JournaledQuery>& queries, uint64_t& written_records);
+
+    /**
+     * @brief Replaces the journal descriptor with a compacted one; must be called with mutex_ held.
+     */
+    void swap_in(int fd, uint64_t written_records, uint64_t live_queries);
+};
+
+#endif // JOURNAL_HPP
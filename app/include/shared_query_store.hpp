@@ -0,0 +1,138 @@
+#ifndef SHARED_QUERY_STORE_HPP
+#define SHARED_QUERY_STORE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../../log/include/log.hpp"
+
+/**
+ * @brief Snapshot of a query read from the shared store.
+ */
+struct SharedQueryStatus {
+    bool completed = false;
+    bool running = false;
+    bool canceled = false;
+    bool truncated = false;  ///< The token log outgrew its slot; later responses are missing.
+    std::vector<std::string> partial_responses;
+    std::vector<int32_t> context;  ///< Final context, once completed and if it fit in the slot.
+};
+
+/**
+ * @brief Query status and token log kept in a MAP_SHARED mapping visible to every worker process.
+ *
+ * The mapping is created by the supervisor before it forks, so every worker (and every
+ * restarted worker) inherits the same pages. It is a fixed array of fixed-size slots,
+ * addressed by hashing the query ID with linear probing. A slot is claimed with a CAS
+ * on its key; when no free slot is within the probe window, the least recently updated
+ * completed query in the window is evicted.
+ *
+ * Only the worker that owns a query writes its slot: partial responses are appended as
+ * [u32 length][bytes] records and published with a release store of the log length, so
+ * readers in other processes copy a consistent prefix without locks or IPC. A generation
+ * counter, bumped when a slot is reclaimed, lets readers detect eviction mid-copy.
+ * Other workers may only set the cancel-request flag, which the owner polls.
+ */
+class SharedQueryStore {
+public:
+    /**
+     * @brief Maps an anonymous shared region of `slots` slots of `slot_bytes` bytes each.
+     *
+     * @throws std::runtime_error if the mapping cannot be created.
+     */
+    SharedQueryStore(std::size_t slots = 4096, std::size_t slot_bytes = 64 * 1024);
+
+    /**
+     * @brief Unmaps the region in this process.
+     */
+    ~SharedQueryStore();
+
+    SharedQueryStore(const SharedQueryStore&) = delete;
+    SharedQueryStore& operator=(const SharedQueryStore&) = delete;
+
+    /**
+     * @brief Claims a slot for a new query.
+     *
+     * @return The slot index, or -1 if every slot in the probe window is in use by an unfinished query.
+     */
+    int insert(const std::string& query_id);
+
+    /**
+     * @brief Appends one partial response to the token log of a slot owned by this process.
+     */
+    void append(int slot, const std::string& partial_response);
+
+    /**
+     * @brief Marks a slot as running.
+     */
+    void set_running(int slot);
+
+    /**
+     * @brief Marks a slot as completed and stores the final context if it fits.
+     */
+    void complete(int slot, bool canceled, const std::vector<int32_t>& context);
+
+    /**
+     * @brief Whether another worker asked to cancel the query in a slot.
+     */
+    bool cancel_requested(int slot) const;
+
+    /**
+     * @brief Asks the owning worker to cancel a query.
+     *
+     * @return False if the query is not in the store.
+     */
+    bool request_cancel(const std::string& query_id);
+
+    /**
+     * @brief Reads a consistent snapshot of a query.
+     *
+     * @return False if the query is not in the store.
+     */
+    bool find(const std::string& query_id, SharedQueryStatus& status) const;
+
+private:
+    static constexpr std::size_t max_id_length = 63;
+    static constexpr std::size_t max_probe = 64;
+
+    enum Flags : uint32_t {
+        flag_running = 1u << 0,
+        flag_completed = 1u << 1,
+        flag_canceled = 1u << 2,
+        flag_cancel_requested = 1u << 3,
+        flag_truncated = 1u << 4,
+        flag_has_context = 1u << 5,
+    };
+
+    /// Fixed header at the start of every slot; the token log follows it.
+    struct SlotHeader {
+        std::atomic<uint64_t> key;  ///< Hash of the query ID; 0 marks a free slot.
+        std::atomic<uint32_t> generation;  ///< Bumped every time the slot is reclaimed.
+        std::atomic<uint32_t> flags;
+        std::atomic<uint32_t> log_bytes;  ///< Committed length of the token log.
+        std::atomic<uint32_t> context_offset;  ///< Log offset of the final context, if flag_has_context.
+        std::atomic<int64_t> updated_ms;  ///< Last write, used to pick eviction victims.
+        char id[max_id_length + 1];
+    };
+
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+                  "shared-memory atomics must be lock-free to be address-free across processes");
+
+    std::size_t slots_;
+    std::size_t slot_bytes_;
+    std::size_t log_capacity_;
+    void* region_ = nullptr;
+    std::size_t region_bytes_ = 0;
+    std::shared_ptr<Logger> logger_;
+
+    SlotHeader* header(std::size_t slot) const;
+    char* log(std::size_t slot) const;
+    int locate(const std::string& query_id) const;
+    void touch(SlotHeader* h) const;
+};
+
+#endif // SHARED_QUERY_STORE_HPP
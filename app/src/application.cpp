@@ -1,5 +1,6 @@
 #include "../include/application.hpp"
 #include "../../log/include/log.hpp"
+#include <algorithm>
 #include <vector>
 #include <numeric>
 #include <sqlite3.h>
@@ -7,29 +8,69 @@
 #include <iomanip>
 #include <sstream>
 #include <filesystem>  // C++17 feature for file system operations
+#include <unistd.h>
 
 /**
  * @brief Constructs an Application object and starts the query processing thread.
  * 
  * @param ioc The Boost.Asio I/O context that the application will use for asynchronous operations.
+ * @param ssl_ctx The SSL context used by the HTTP client.
+ * @param options Journal location and number of processing threads.
  */
-Application::Application(boost::asio::io_context& ioc, ssl::context& ssl_ctx)
-    : io_context_(ioc), ssl_ctx_(ssl_ctx), client_(std::make_shared<Client>(ioc, ssl_ctx)), ollama_("http://localhost:11434"), timer_(io_context_)
+Application::Application(boost::asio::io_context& ioc, ssl::context& ssl_ctx, ApplicationOptions options)
+    : io_context_(ioc), ssl_ctx_(ssl_ctx), timer_(io_context_), client_(std::make_shared<Client>(ioc, ssl_ctx)),
+      webhook_client_(std::make_shared<AsyncClient>(ioc, options.webhook)),
+      shared_store_(options.shared_store)
 {
     auto logger = LoggerManager::getLogger("application_logger", LogLevel::DEBUG, LogOutput::CONSOLE);
     logger->log(LogLevel::DEBUG, "Initializing app.");
 
     initialize_database();  // Initialize the database connection
     check_and_create_tables();  // Check and create necessary tables
+    metrics_writer_ = std::thread(&Application::run_metrics_writer, this);
+    if (!options.journal_path.empty()) {
+        journal_ = std::make_unique<QueryJournal>(options.journal_path);
+        recover_queries();  // Re-enqueue unfinished queries from the journal
+    }
 
-    // Start a thread to process the query queue
-    std::thread(&Application::process_queries, this).detach();
+    // Start the threads processing the query queue, each with its own Ollama connection
+    std::size_t workers = std::max<std::size_t>(1, options.workers);
+    for (std::size_t i = 0; i < workers; ++i) {
+        ollama_.push_back(std::make_unique<Ollama>("http://localhost:11434"));
+    }
+    for (std::size_t i = 0; i < workers; ++i) {
+        workers_.emplace_back(&Application::process_queries, this, i);
+    }
 }
 
 /**
- * @brief Destructor to close the database connection.
+ * @brief Stops the processing threads and waits for them, then closes the database connection.
+ *
+ * The threads use the queue, the database and the journal, so they must be gone
+ * before any member is destroyed. A query being processed is finished first. The
+ * metrics writer stops last and writes the samples still buffered.
  */
-Application::~Application() {}
+Application::~Application() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        stopping_ = true;
+    }
+    queue_cv_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(metrics_mutex_);
+        metrics_stopping_ = true;
+    }
+    metrics_cv_.notify_all();
+    if (metrics_writer_.joinable()) {
+        metrics_writer_.join();
+    }
+}
 
 /**
  * @brief Initializes the SQLite database connection.
@@ -93,26 +134,118 @@ void Application::check_and_create_tables() {
 }
 
 
-void Application::log_performance_metric(const std::string& metric_name, double metric_value) {
+/**
+ * @brief Rebuilds the query queue and map from the journal.
+ *
+ * Completed queries are restored with their responses and final context. Queries that
+ * were accepted but never completed are queued again in their original order.
+ */
+void Application::recover_queries() {
     auto logger = LoggerManager::getLogger("application_logger", LogLevel::DEBUG, LogOutput::CONSOLE);
 
-    // Get the current timestamp
+    std::size_t requeued = 0;
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    for (auto& entry : journal_->recover()) {
+        auto query = std::make_shared<Query>();
+        query->id = std::move(entry.id);
+        query->prompt = std::move(entry.prompt);
+        query->conversation_id = std::move(entry.conversation_id);
+        query->callback_url = std::move(entry.callback_url);
+        query->context = std::move(entry.context);
+        query->partial_responses = std::move(entry.partial_responses);
+        query->canceled = entry.canceled;
+        query->completed = entry.completed;
+
+        if (!entry.completed && !entry.canceled) {
+            share_query(query);  // Completed queries stay local so they do not evict live ones.
+            query_queue_.push(query);
+            ++requeued;
+        }
+        query_map_[query->id] = query;
+    }
+
+    logger->log(LogLevel::INFO, "Re-enqueued " + std::to_string(requeued) + " unfinished queries from the journal.");
+}
+
+/**
+ * @brief Buffers a performance metric sample; a background thread writes the buffer to the database.
+ *
+ * Cheap enough for the io threads. Samples beyond max_buffered_metrics are dropped
+ * and counted until the next write.
+ *
+ * @param metric_name The name of the metric.
+ * @param metric_value The sampled value.
+ */
+void Application::log_performance_metric(const std::string& metric_name, double metric_value) {
     auto now = std::chrono::system_clock::now();
-    auto in_time_t = std::chrono::system_clock::to_time_t(now);
-    std::stringstream ss;
-    ss << std::put_time(std::localtime(&in_time_t), "%Y-%m-%d %X");
+    std::lock_guard<std::mutex> lock(metrics_mutex_);
+    if (metrics_.size() >= max_buffered_metrics) {
+        ++dropped_metrics_;
+        return;
+    }
+    metrics_.push_back(MetricSample{metric_name, metric_value, now});
+}
+
+/**
+ * @brief Writes the buffered performance metrics every metrics_flush_interval until stopped.
+ *
+ * One transaction per interval replaces an insert, and an fsync, per request.
+ */
+void Application::run_metrics_writer() {
+    std::vector<MetricSample> samples;
+    std::unique_lock<std::mutex> lock(metrics_mutex_);
+    while (true) {
+        metrics_cv_.wait_for(lock, metrics_flush_interval, [this] { return metrics_stopping_; });
+        bool stopping = metrics_stopping_;
+        samples.swap(metrics_);
+        uint64_t dropped = dropped_metrics_;
+        dropped_metrics_ = 0;
+        lock.unlock();
+
+        write_metrics(samples, dropped);
+        samples.clear();
+        if (stopping) {
+            return;
+        }
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Writes performance metric samples to the database in one transaction.
+ *
+ * @param samples The samples to write.
+ * @param dropped Samples dropped because the buffer was full.
+ */
+void Application::write_metrics(const std::vector<MetricSample>& samples, uint64_t dropped) {
+    auto logger = LoggerManager::getLogger("application_logger", LogLevel::DEBUG, LogOutput::CONSOLE);
+    if (dropped > 0) {
+        logger->log(LogLevel::WARN, "Dropped " + std::to_string(dropped) + " performance metric samples.");
+    }
+    if (samples.empty()) {
+        return;
+    }
 
     const std::string sql = "INSERT INTO performance_metrics (timestamp, metric_name, metric_value) VALUES (?, ?, ?);";
 
     try {
+        SQLite::Transaction transaction(*db_);
         SQLite::Statement stmt(*db_, sql);
-        stmt.bind(1, ss.str());
-        stmt.bind(2, metric_name);
-        stmt.bind(3, metric_value);
-        stmt.exec();
-        logger->log(LogLevel::DEBUG, "Performance metric logged: " + metric_name + " = " + std::to_string(metric_value));
+        for (const auto& sample : samples) {
+            auto in_time_t = std::chrono::system_clock::to_time_t(sample.timestamp);
+            std::stringstream ss;
+            ss << std::put_time(std::localtime(&in_time_t), "%Y-%m-%d %X");
+
+            stmt.bind(1, ss.str());
+            stmt.bind(2, sample.metric_name);
+            stmt.bind(3, sample.metric_value);
+            stmt.exec();
+            stmt.reset();
+        }
+        transaction.commit();
+        logger->log(LogLevel::DEBUG, "Performance metrics logged: " + std::to_string(samples.size()) + " samples.");
     } catch (const std::exception& e) {
-        logger->log(LogLevel::ERROR, "Failed to log performance metric: " + std::string(e.what()));
+        logger->log(LogLevel::ERROR, "Failed to log performance metrics: " + std::string(e.what()));
     }
 }
 
@@ -124,15 +257,25 @@ void Application::log_performance_metric(const std::string& metric_name, double
  * Generates a unique query ID, stores the prompt, and places the query in the queue for processing.
  * 
  * @param prompt The prompt to be sent to the LLM.
+ * @param context Context tokens returned by a previous query, if any.
+ * @param conversation_id If set, the prompt is sent as the next chat turn of this conversation.
+ * @param on_complete Optional callback invoked on the processing thread once the query has finished.
+ * @param callback_url Optional https:// URL the final result is POSTed to once the query has finished.
  * @return The unique ID of the newly added query.
  */
-std::string Application::add_query(const std::string& prompt, const ollama::response& context) {
+std::string Application::add_query(const std::string& prompt, std::vector<int32_t> context, const std::string& conversation_id,
+                                   QueryCompletionHandler on_complete, const std::string& callback_url) {
     auto query = std::make_shared<Query>();
-    query->id = std::to_string(std::hash<std::string>{}(prompt + std::to_string(std::chrono::system_clock::now().time_since_epoch().count())));
+    query->id = generate_id(prompt);
     query->prompt = prompt;
-    
-    if (context.is_valid()) {
-        query->last_context = context;
+    query->context = std::move(context);
+    query->conversation_id = conversation_id;
+    query->on_complete = std::move(on_complete);
+    query->callback_url = callback_url;
+    share_query(query);
+
+    if (journal_) {
+        journal_->record_accepted(query->id, query->prompt, query->conversation_id, query->context, query->callback_url);
     }
 
     {
@@ -147,6 +290,145 @@ std::string Application::add_query(const std::string& prompt, const ollama::resp
 }
 
 
+/**
+ * @brief Generates a unique ID for a query or batch.
+ *
+ * Hashes the seed together with the current time and a sequence number, so IDs stay
+ * unique when many identical prompts are added within the same clock tick.
+ */
+std::string Application::generate_id(const std::string& seed) {
+    return std::to_string(std::hash<std::string>{}(
+        seed + std::to_string(std::chrono::system_clock::now().time_since_epoch().count()) +
+        "#" + std::to_string(id_sequence_++) + "@" + std::to_string(::getpid())));
+}
+
+/**
+ * @brief Publishes a new query to the shared query store, if there is one.
+ *
+ * In prefork mode a status or cancel request may reach any worker process, so the
+ * accepting worker claims a slot that the others can read without asking it.
+ *
+ * @param query The query to publish.
+ */
+void Application::share_query(const std::shared_ptr<Query>& query) {
+    if (shared_store_) {
+        query->shared_slot = shared_store_->insert(query->id);
+    }
+}
+
+/**
+ * @brief Adds many queries at once.
+ *
+ * All queries are queued under a single acquisition of the queue lock and grouped
+ * under a batch ID whose progress can be polled with get_batch_status().
+ *
+ * @param items The prompts to queue, in order.
+ * @param query_ids Receives the query ID of each item, in the same order.
+ * @return The unique ID of the batch.
+ */
+std::string Application::add_batch(std::vector<BatchItem> items, std::vector<std::string>& query_ids) {
+    std::string batch_id = generate_id("batch");
+
+    std::vector<std::shared_ptr<Query>> queries;
+    queries.reserve(items.size());
+    query_ids.clear();
+    query_ids.reserve(items.size());
+
+    for (auto& item : items) {
+        auto query = std::make_shared<Query>();
+        query->id = generate_id(item.prompt);
+        query->prompt = std::move(item.prompt);
+        query->context = std::move(item.context);
+        query->conversation_id = std::move(item.conversation_id);
+        query->callback_url = std::move(item.callback_url);
+        share_query(query);
+
+        if (journal_) {
+            journal_->record_accepted(query->id, query->prompt, query->conversation_id, query->context, query->callback_url);
+        }
+
+        query_ids.push_back(query->id);
+        queries.push_back(std::move(query));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        for (const auto& query : queries) {
+            query_queue_.push(query);
+            query_map_[query->id] = query;
+        }
+        batch_map_[batch_id] = std::move(queries);
+        batch_order_.push_back(batch_id);
+        evict_finished_batches();
+    }
+
+    queue_cv_.notify_all();
+
+    return batch_id;
+}
+
+/**
+ * @brief Evicts the oldest finished batches beyond max_retained_batches; called with queue_mutex_ held.
+ *
+ * A batch is finished once every query in it has completed or was canceled. Batches
+ * still in progress are never evicted, so their status stays pollable.
+ */
+void Application::evict_finished_batches() {
+    std::size_t excess = batch_map_.size() > max_retained_batches ? batch_map_.size() - max_retained_batches : 0;
+    for (auto it = batch_order_.begin(); it != batch_order_.end() && excess > 0;) {
+        auto batch = batch_map_.find(*it);
+        bool finished = batch == batch_map_.end() ||
+                        std::all_of(batch->second.begin(), batch->second.end(), [](const std::shared_ptr<Query>& query) {
+                            return query->completed || query->canceled;
+                        });
+        if (!finished) {
+            ++it;
+            continue;
+        }
+        if (batch != batch_map_.end()) {
+            batch_map_.erase(batch);
+            --excess;
+        }
+        it = batch_order_.erase(it);
+    }
+}
+
+/**
+ * @brief Retrieves the aggregated progress of a batch.
+ *
+ * @param batch_id The unique ID of the batch.
+ * @return A JSON string with the number of queued, running, completed and canceled queries.
+ */
+std::string Application::get_batch_status(const std::string& batch_id) {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    auto it = batch_map_.find(batch_id);
+    if (it == batch_map_.end()) {
+        return R"({"error": "Batch ID not found."})";
+    }
+
+    std::size_t completed = 0, running = 0, canceled = 0;
+    for (const auto& query : it->second) {
+        if (query->canceled) {
+            ++canceled;
+        } else if (query->completed) {
+            ++completed;
+        } else if (query->running) {
+            ++running;
+        }
+    }
+
+    nlohmann::json response_json;
+    response_json["batch_id"] = batch_id;
+    response_json["total"] = it->second.size();
+    response_json["completed"] = completed;
+    response_json["running"] = running;
+    response_json["canceled"] = canceled;
+    response_json["queued"] = it->second.size() - completed - running - canceled;
+    response_json["done"] = completed + canceled == it->second.size();
+
+    return response_json.dump();
+}
+
 /**
  * @brief Retrieves the status of a specific query.
  * 
@@ -167,11 +449,42 @@ std::string Application::get_query_status(const std::string& query_id) {
         response_json["running"] = static_cast<bool>(query->running);
         response_json["canceled"] = static_cast<bool>(query->canceled);
         response_json["partial_responses"] = query->partial_responses;
+        if (query->completed && !query->error.empty()) {
+            response_json["error"] = query->error;
+        }
+
+        if (!query->conversation_id.empty()) {
+            response_json["conversation_id"] = query->conversation_id;
+            response_json["conversation_tokens"] = conversations_.token_count(query->conversation_id);
+        }
+
+        // Hand the final context back once the query is done so the client can continue the conversation.
+        if (query->completed && !query->running && !query->context.empty()) {
+            response_json["context"] = query->context;
+        }
 
         return response_json.dump();  // Return the status as a JSON string.
-    } else {
-        return R"({"error": "Query ID not found."})";  // Return an error if the query ID is not found.
     }
+
+    // The query may have been accepted by another worker process; read its state from shared memory.
+    SharedQueryStatus shared;
+    if (shared_store_ && shared_store_->find(query_id, shared)) {
+        nlohmann::json response_json;
+        response_json["query_id"] = query_id;
+        response_json["completed"] = shared.completed;
+        response_json["running"] = shared.running;
+        response_json["canceled"] = shared.canceled;
+        response_json["partial_responses"] = shared.partial_responses;
+        if (shared.truncated) {
+            response_json["truncated"] = true;
+        }
+        if (shared.completed && !shared.context.empty()) {
+            response_json["context"] = shared.context;
+        }
+        return response_json.dump();
+    }
+
+    return R"({"error": "Query ID not found."})";  // Return an error if the query ID is not found.
 }
 
 /**
@@ -185,6 +498,11 @@ void Application::cancel_query(const std::string& query_id) {
     std::lock_guard<std::mutex> lock(queue_mutex_);  // Lock the mutex to protect access to the query map.
     if (query_map_.find(query_id) != query_map_.end()) {
         query_map_[query_id]->canceled = true;  // Mark the query as canceled.
+        if (journal_) {
+            journal_->record_canceled(query_id);
+        }
+    } else if (shared_store_) {
+        shared_store_->request_cancel(query_id);  // Owned by another worker process, which polls the flag.
     }
 }
 
@@ -193,8 +511,10 @@ void Application::cancel_query(const std::string& query_id) {
  * 
  * This function runs in a separate thread, popping queries from the queue and processing them.
  * If a query is canceled, it will be skipped.
+ *
+ * @param worker Index of the processing thread, selecting its Ollama client.
  */
-void Application::process_queries() {
+void Application::process_queries(std::size_t worker) {
     auto logger = LoggerManager::getLogger("application_logger", LogLevel::DEBUG, LogOutput::CONSOLE);
 
     while (true) {
@@ -203,17 +523,34 @@ void Application::process_queries() {
         {
             // Lock the mutex and wait for new queries to be added to the queue.
             std::unique_lock<std::mutex> lock(queue_mutex_);
-            queue_cv_.wait(lock, [this]{ return !query_queue_.empty(); });
+            queue_cv_.wait(lock, [this]{ return stopping_ || !query_queue_.empty(); });
+            if (stopping_) {
+                return;
+            }
 
             // Pop the next query from the queue.
             query = query_queue_.front();
             query_queue_.pop();
         }
 
+        if (query && shared_store_ && shared_store_->cancel_requested(query->shared_slot)) {
+            query->canceled = true;
+        }
+
         // If the query has not been canceled, process it.
         if (query && !query->canceled) {
             query->running = true;
-            run_query(query);  // Process the query.
+            run_query(query, *ollama_[worker]);  // Process the query.
+        } else if (query) {
+            if (shared_store_) {
+                shared_store_->complete(query->shared_slot, true, {});
+            }
+            if (!query->callback_url.empty()) {
+                deliver_webhook(query);
+            }
+            if (query->on_complete) {
+                query->on_complete(query);
+            }
         }
     }
 }
@@ -225,35 +562,62 @@ void Application::process_queries() {
  * completed when all responses have been received or if an error occurs.
  * 
  * @param query The query to be processed.
+ * @param ollama The Ollama client owned by the calling processing thread.
  */
-void Application::run_query(const std::shared_ptr<Query>& query) {
+void Application::run_query(const std::shared_ptr<Query>& query, Ollama& ollama) {
     query->running = true;
+    if (shared_store_) {
+        shared_store_->set_running(query->shared_slot);
+    }
 
     auto logger = LoggerManager::getLogger("application_logger", LogLevel::DEBUG);
 
     // Lambda function to handle each partial response received from the LLM.
-    auto on_receive_token = [query, logger](const ollama::response& response) {
+    auto on_receive_token = [this, query, logger](const ollama::response& response) {
         logger->log(LogLevel::DEBUG, "Inside on_receive_token callback.");
 
         // Check if the response contains a partial response and handle it.
-        if (response.as_json().contains("response")) {
-            std::string partial_response = response.as_json()["response"];
+        // Generations carry the text in "response", chat turns in "message".
+        if (response.as_json().contains("response") || response.as_json().contains("message")) {
+            std::string partial_response = response.as_simple_string();
             logger->log(LogLevel::DEBUG, "Valid partial response received: " + partial_response);
             query->partial_responses.push_back(partial_response);  // Add the partial response to the query.
+            if (shared_store_) {
+                shared_store_->append(query->shared_slot, partial_response);
+            }
         } else {
             logger->log(LogLevel::ERROR, "Invalid or error response: " + response.as_json_string());
         }
 
-        // Store the latest context for future queries
-        query->last_context = response;
-
         // Mark the query as completed when the "done" flag is true.
         if (response.as_json().contains("done") && response.as_json()["done"].get<bool>()) {
+            if (response.as_json().contains("eval_count")) {
+                query->eval_count = response.as_json()["eval_count"].get<int>();
+            }
+
+            if (query->conversation_id.empty()) {
+                // Only the final response carries the context; keep just the packed tokens for future queries.
+                query->context = parse_context_tokens(response.as_json());
+            } else {
+                // Feed the reply and the exact token counts back into the conversation policy.
+                const auto& json = response.as_json();
+                conversations_.record_reply(
+                    query->conversation_id,
+                    std::accumulate(query->partial_responses.begin(), query->partial_responses.end(), std::string()),
+                    json.contains("prompt_eval_count") ? json["prompt_eval_count"].get<int>() : -1,
+                    json.contains("eval_count") ? json["eval_count"].get<int>() : -1);
+            }
+
             logger->log(LogLevel::DEBUG, "Final response received. Marking query as completed.");
             query->completed = true;
             query->running = false;
         }
 
+        // A cancel request may also come from another worker process.
+        if (shared_store_ && shared_store_->cancel_requested(query->shared_slot)) {
+            query->canceled = true;
+        }
+
         // If the query has been canceled, mark it as completed.
         if (query->canceled) {
             logger->log(LogLevel::DEBUG, "Query was canceled.");
@@ -262,18 +626,91 @@ void Application::run_query(const std::shared_ptr<Query>& query) {
         }
     };
 
-    // Send the prompt to the LLM with or without context
-    if (query->last_context.is_valid()) {
-        // Subsequent query with context
-        ollama_.generate("llava:latest", query->prompt, query->last_context, on_receive_token);
-    } else {
-        // Initial query without context
-        ollama_.generate("llava:latest", query->prompt, on_receive_token);
+    try {
+        if (!query->conversation_id.empty()) {
+            // Chat turn: send the compacted conversation history instead of raw context tokens.
+            ollama::messages messages = conversations_.prepare(query->conversation_id, query->prompt);
+            ollama::request request(conversations_.policy().model, messages, conversations_.request_options(), true);
+            ollama.chat(request, on_receive_token);
+        } else {
+            // Send the prompt to the LLM, splicing in the packed context of a previous query if there is one.
+            ollama::request request("llava:latest", query->prompt, nullptr, true);
+            std::string request_string = splice_context(request.dump(), query->context);
+            query->context.clear();
+            ollama.generate_serialized(request_string, on_receive_token);
+        }
+    } catch (const std::exception& e) {
+        logger->log(LogLevel::ERROR, "Query " + query->id + " failed: " + std::string(e.what()));
+        query->error = e.what();
+    }
+
+    if (!query->conversation_id.empty()) {
+        // A failed or canceled turn must not leave its prompt in the history
+        conversations_.abandon_pending(query->conversation_id);
+    }
+
+    if (journal_) {
+        journal_->record_completed(query->id, query->canceled, query->partial_responses, query->context);
     }
 
     // Mark the query as completed after processing (even if not successful).
     query->completed = true;
     query->running = false;
+    if (shared_store_) {
+        shared_store_->complete(query->shared_slot, query->canceled, query->context);
+    }
+
+    if (!query->callback_url.empty()) {
+        deliver_webhook(query);
+    }
+    if (query->on_complete) {
+        query->on_complete(query);
+    }
+}
+
+/**
+ * @brief POSTs the final result of a query to its callback URL.
+ *
+ * The delivery is handed to the pooled AsyncClient, which batches deliveries to the
+ * same host over one connection and retries failures, so the processing thread never
+ * waits on the receiver.
+ *
+ * @param query The finished query.
+ */
+void Application::deliver_webhook(const std::shared_ptr<Query>& query) {
+    auto logger = LoggerManager::getLogger("application_logger", LogLevel::DEBUG);
+
+    url_parts url;
+    if (!parse_url(query->callback_url, url)) {
+        logger->log(LogLevel::ERROR, "Invalid callback URL for query " + query->id + ": " + query->callback_url);
+        return;
+    }
+
+    nlohmann::json payload;
+    payload["query_id"] = query->id;
+    payload["completed"] = static_cast<bool>(query->completed);
+    payload["canceled"] = static_cast<bool>(query->canceled);
+    payload["response"] = std::accumulate(query->partial_responses.begin(), query->partial_responses.end(), std::string());
+    payload["eval_count"] = query->eval_count;
+    if (!query->error.empty()) {
+        payload["error"] = query->error;
+    }
+    if (!query->conversation_id.empty()) {
+        payload["conversation_id"] = query->conversation_id;
+    }
+    if (!query->context.empty()) {
+        payload["context"] = query->context;
+    }
+
+    std::string query_id = query->id;
+    webhook_client_->post(url.host, url.port, url.target, payload.dump(),
+        [logger, query_id](beast::error_code ec, unsigned status) {
+            if (ec) {
+                logger->log(LogLevel::ERROR, "Callback for query " + query_id + " failed: " + ec.message());
+            } else {
+                logger->log(LogLevel::DEBUG, "Callback for query " + query_id + " delivered with status " + std::to_string(status));
+            }
+        });
 }
 
 
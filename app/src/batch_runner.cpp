@@ -0,0 +1,181 @@
+#include "../include/batch_runner.hpp"
+#include <chrono>
+#include <numeric>
+
+/**
+ * @brief Constructs a batch runner.
+ *
+ * @param app The application whose query pipeline processes the prompts.
+ * @param options The batch options.
+ */
+BatchRunner::BatchRunner(Application& app, BatchOptions options)
+    : app_(app), options_(std::move(options)),
+      logger_(LoggerManager::getLogger("batch_logger", LogLevel::INFO, LogOutput::CONSOLE))
+{
+    if (options_.checkpoint_path.empty()) {
+        options_.checkpoint_path = options_.output_path + ".checkpoint";
+    }
+    options_.concurrency = std::max<std::size_t>(1, options_.concurrency);
+}
+
+/**
+ * @brief Loads the line numbers finished by a previous run.
+ */
+void BatchRunner::load_checkpoint()
+{
+    std::ifstream checkpoint(options_.checkpoint_path);
+    std::size_t line;
+    while (checkpoint >> line) {
+        done_lines_.insert(line);
+    }
+
+    if (!done_lines_.empty()) {
+        logger_->log(LogLevel::INFO, "Resuming batch, " + std::to_string(done_lines_.size()) + " prompts already done.");
+    }
+}
+
+/**
+ * @brief Advances next_line_ past lines finished in a previous run. Called with mutex_ held.
+ */
+void BatchRunner::skip_done_lines()
+{
+    while (done_lines_.count(next_line_) != 0) {
+        ++next_line_;
+    }
+}
+
+/**
+ * @brief Appends one result, checkpoints its line and frees its slot. Called with mutex_ held.
+ */
+void BatchRunner::write_result(std::size_t line, const Result& result)
+{
+    output_ << result.json << '\n';
+    output_.flush();
+    if (result.checkpoint) {
+        checkpoint_ << line << '\n';
+        checkpoint_.flush();
+    }
+
+    // The slot is only released here, so results buffered in ordered mode count against the concurrency.
+    --in_flight_;
+    done_cv_.notify_all();
+}
+
+/**
+ * @brief Stores a finished result and writes everything that is ready. Called with mutex_ held.
+ */
+void BatchRunner::complete(std::size_t line, Result result)
+{
+    if (!options_.ordered) {
+        write_result(line, result);
+        return;
+    }
+
+    reorder_buffer_.emplace(line, std::move(result));
+    skip_done_lines();
+    for (auto it = reorder_buffer_.find(next_line_); it != reorder_buffer_.end(); it = reorder_buffer_.find(next_line_)) {
+        write_result(it->first, it->second);
+        reorder_buffer_.erase(it);
+        ++next_line_;
+        skip_done_lines();
+    }
+}
+
+/**
+ * @brief Processes the whole input file.
+ *
+ * @return EXIT_SUCCESS if the input was processed, EXIT_FAILURE otherwise.
+ */
+int BatchRunner::run()
+{
+    std::ifstream input(options_.input_path);
+    if (!input.is_open()) {
+        logger_->log(LogLevel::ERROR, "Cannot open batch input: " + options_.input_path);
+        return EXIT_FAILURE;
+    }
+
+    load_checkpoint();
+    output_.open(options_.output_path, std::ios::app);
+    checkpoint_.open(options_.checkpoint_path, std::ios::app);
+    if (!output_.is_open() || !checkpoint_.is_open()) {
+        logger_->log(LogLevel::ERROR, "Cannot open batch output: " + options_.output_path);
+        return EXIT_FAILURE;
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    std::string text;
+    std::size_t line = 0;
+
+    for (; std::getline(input, text); ++line) {
+        if (done_lines_.count(line) != 0) {
+            continue;
+        }
+
+        nlohmann::json result;
+        result["line"] = line;
+
+        std::string prompt;
+        try {
+            auto item = nlohmann::json::parse(text);
+            for (const char* key : {"request_id", "id"}) {
+                if (item.contains(key)) {
+                    result["id"] = item[key];
+                    break;
+                }
+            }
+            for (const char* key : {"prompt", "message", "body"}) {
+                if (item.contains(key) && item[key].is_string()) {
+                    prompt = item[key].get<std::string>();
+                    break;
+                }
+            }
+        } catch (const nlohmann::json::exception& e) {
+            result["error"] = "Invalid JSON: " + std::string(e.what());
+        }
+
+        // Wait for a free slot before taking the next line.
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [this] { return in_flight_ < options_.concurrency; });
+        ++in_flight_;
+
+        if (prompt.empty()) {
+            if (!result.contains("error")) {
+                result["error"] = "Missing prompt.";
+            }
+            complete(line, {result.dump(), true});
+            continue;
+        }
+        lock.unlock();
+
+        app_.add_query(prompt, {}, "", [this, line, result](const std::shared_ptr<Query>& query) mutable {
+            result["query_id"] = query->id;
+            result["response"] = std::accumulate(query->partial_responses.begin(), query->partial_responses.end(), std::string());
+            result["eval_count"] = query->eval_count;
+            if (query->canceled) {
+                result["canceled"] = true;
+            }
+            if (!query->error.empty()) {
+                result["error"] = query->error;
+            }
+
+            std::lock_guard<std::mutex> guard(mutex_);
+            total_tokens_ += query->eval_count > 0 ? query->eval_count : query->partial_responses.size();
+            ++processed_;
+            // A failed line stays out of the checkpoint so a resumed run retries it.
+            complete(line, {result.dump(), query->error.empty()});
+        });
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return in_flight_ == 0; });
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    double tokens_per_second = seconds > 0 ? total_tokens_ / seconds : 0.0;
+    logger_->log(LogLevel::INFO, "Batch finished: " + std::to_string(processed_) + " prompts, " +
+                 std::to_string(total_tokens_) + " tokens in " + std::to_string(seconds) + " s (" +
+                 std::to_string(tokens_per_second) + " tokens/s).");
+
+    app_.log_performance_metric("Batch Throughput (tokens/s)", tokens_per_second);
+    app_.log_performance_metric("Batch Wall Time (s)", seconds);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,83 @@
+#include "../include/context.hpp"
+#include <charconv>
+
+/**
+ * @brief Extract a packed context token array from a JSON value.
+ *
+ * @param value The JSON value to read the tokens from.
+ * @return The context tokens, or an empty vector if none were found.
+ */
+std::vector<int32_t> parse_context_tokens(const nlohmann::json& value)
+{
+    const nlohmann::json* tokens = &value;
+    if (value.is_object()) {
+        auto it = value.find("context");
+        if (it == value.end()) {
+            return {};
+        }
+        tokens = &*it;
+    }
+
+    if (!tokens->is_array()) {
+        return {};
+    }
+
+    std::vector<int32_t> result;
+    result.reserve(tokens->size());
+    for (const auto& token : *tokens) {
+        if (!token.is_number_integer()) {
+            return {};
+        }
+        result.push_back(token.get<int32_t>());
+    }
+    return result;
+}
+
+/**
+ * @brief Append the tokens to a string as a JSON array without building a DOM.
+ *
+ * @param out The string to append to.
+ * @param tokens The context tokens to serialize.
+ */
+void append_context_tokens(std::string& out, const std::vector<int32_t>& tokens)
+{
+    // Worst case is 11 characters per token plus the separator.
+    out.reserve(out.size() + tokens.size() * 12 + 2);
+    out.push_back('[');
+
+    char digits[16];
+    for (std::size_t i = 0; i < tokens.size(); ++i) {
+        if (i != 0) {
+            out.push_back(',');
+        }
+        auto result = std::to_chars(digits, digits + sizeof(digits), tokens[i]);
+        out.append(digits, result.ptr);
+    }
+
+    out.push_back(']');
+}
+
+/**
+ * @brief Splice a "context" member into an already serialized JSON object.
+ *
+ * @param request_body A serialized JSON object, e.g. the output of ollama::request::dump().
+ * @param tokens The context tokens to add. Nothing is added if empty.
+ * @return The serialized request with the context member appended.
+ */
+std::string splice_context(std::string request_body, const std::vector<int32_t>& tokens)
+{
+    if (tokens.empty() || request_body.size() < 2 || request_body.back() != '}') {
+        return request_body;
+    }
+
+    // Drop the closing brace, add the member and close the object again.
+    request_body.pop_back();
+    if (request_body.back() != '{') {
+        request_body.push_back(',');
+    }
+    request_body.append("\"context\":");
+    append_context_tokens(request_body, tokens);
+    request_body.push_back('}');
+
+    return request_body;
+}
@@ -0,0 +1,318 @@
+#include "../include/conversation.hpp"
+#include <numeric>
+
+/**
+ * @brief Constructs the manager and starts the background compaction thread.
+ *
+ * @param policy The context-window policy to apply.
+ */
+ConversationManager::ConversationManager(ConversationPolicy policy)
+    : policy_(std::move(policy)), ollama_(policy_.server_url),
+      logger_(LoggerManager::getLogger("conversation_logger", LogLevel::DEBUG, LogOutput::CONSOLE))
+{
+    worker_ = std::thread(&ConversationManager::run_compactions, this);
+}
+
+/**
+ * @brief Stops the background compaction thread.
+ */
+ConversationManager::~ConversationManager()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    jobs_cv_.notify_all();
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+/**
+ * @brief Rough token estimate used until Ollama reports exact counts (~4 characters per token).
+ */
+int ConversationManager::estimate_tokens(const std::string& text)
+{
+    return static_cast<int>(text.size() / 4) + 4;
+}
+
+int ConversationManager::total_tokens(const Conversation& conversation)
+{
+    return std::accumulate(conversation.tokens.begin(), conversation.tokens.end(), 0);
+}
+
+/**
+ * @brief Builds the request options carrying the configured context window.
+ *
+ * @return Options suitable for an ollama::request.
+ */
+ollama::options ConversationManager::request_options() const
+{
+    ollama::options options;
+    options["num_ctx"] = policy_.num_ctx;
+    return options;
+}
+
+/**
+ * @brief Appends a user prompt to a conversation and returns the messages to send.
+ *
+ * @param conversation_id The conversation the prompt belongs to. Unknown IDs start a new conversation.
+ * @param prompt The user prompt.
+ * @return The (possibly compacted) message history including the new prompt.
+ */
+ollama::messages ConversationManager::prepare(const std::string& conversation_id, const std::string& prompt)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto inserted = conversations_.try_emplace(conversation_id);
+    Conversation& conversation = inserted.first->second;
+    if (inserted.second) {
+        conversation.lru = lru_.insert(lru_.begin(), conversation_id);
+    }
+    touch(conversation);
+
+    conversation.history.push_back(ollama::message("user", prompt));
+    conversation.tokens.push_back(estimate_tokens(prompt));
+    conversation.awaiting_reply = true;
+    evict();
+
+    trim_to_fit(conversation);
+    maybe_schedule_compaction(conversation_id, conversation);
+
+    return conversation.history;
+}
+
+/**
+ * @brief Records the assistant reply for the latest prompt of a conversation.
+ *
+ * @param conversation_id The conversation the reply belongs to.
+ * @param reply The full assistant reply.
+ * @param prompt_tokens The prompt_eval_count reported by Ollama, or a negative value if unknown.
+ * @param reply_tokens The eval_count reported by Ollama, or a negative value if unknown.
+ */
+void ConversationManager::record_reply(const std::string& conversation_id, const std::string& reply, int prompt_tokens, int reply_tokens)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = conversations_.find(conversation_id);
+    if (it == conversations_.end()) {
+        return;
+    }
+    Conversation& conversation = it->second;
+
+    // Ollama may reuse its KV cache and report fewer prompt tokens than the history holds,
+    // so the exact count is only used to correct underestimates.
+    int estimated = total_tokens(conversation);
+    if (prompt_tokens > estimated && !conversation.tokens.empty()) {
+        conversation.tokens.back() += prompt_tokens - estimated;
+    }
+
+    conversation.history.push_back(ollama::message("assistant", reply));
+    conversation.tokens.push_back(reply_tokens >= 0 ? reply_tokens : estimate_tokens(reply));
+    conversation.awaiting_reply = false;
+    touch(conversation);
+
+    logger_->log(LogLevel::DEBUG, "Conversation " + conversation_id + " now holds " +
+                 std::to_string(total_tokens(conversation)) + " tokens.");
+
+    maybe_schedule_compaction(conversation_id, conversation);
+}
+
+/**
+ * @brief Rolls back the latest prompt of a conversation if no reply was recorded for it.
+ *
+ * @param conversation_id The conversation of the finished query.
+ */
+void ConversationManager::abandon_pending(const std::string& conversation_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = conversations_.find(conversation_id);
+    if (it == conversations_.end() || !it->second.awaiting_reply) {
+        return;
+    }
+    Conversation& conversation = it->second;
+    conversation.awaiting_reply = false;
+
+    // The prompt may already be gone if keep_recent_messages let trim_to_fit() drop it
+    if (!conversation.history.empty() && conversation.history.back()["role"].get<std::string>() == "user") {
+        conversation.history.pop_back();
+        conversation.tokens.pop_back();
+        logger_->log(LogLevel::DEBUG, "Rolled back the unanswered prompt of conversation " + conversation_id + ".");
+    }
+}
+
+/**
+ * @brief Marks a conversation as just used.
+ */
+void ConversationManager::touch(Conversation& conversation)
+{
+    conversation.last_used = std::chrono::steady_clock::now();
+    lru_.splice(lru_.begin(), lru_, conversation.lru);
+}
+
+/**
+ * @brief Evicts idle conversations and the least recently used ones beyond max_conversations.
+ *
+ * Walks from the least recently used end and stops at the first conversation that is
+ * neither idle nor over the limit. Conversations waiting for a reply are skipped.
+ */
+void ConversationManager::evict()
+{
+    auto now = std::chrono::steady_clock::now();
+    std::size_t evicted = 0;
+    for (auto it = lru_.end(); it != lru_.begin();) {
+        --it;
+        auto conversation = conversations_.find(*it);
+        bool over_limit = conversations_.size() > policy_.max_conversations;
+        if (!over_limit && now - conversation->second.last_used < policy_.idle_timeout) {
+            break;
+        }
+        if (conversation->second.awaiting_reply) {
+            continue;
+        }
+        conversations_.erase(conversation);
+        it = lru_.erase(it);
+        ++evicted;
+    }
+
+    if (evicted > 0) {
+        logger_->log(LogLevel::DEBUG, "Evicted " + std::to_string(evicted) + " conversations.");
+    }
+}
+
+/**
+ * @brief Returns the current token estimate for a conversation.
+ *
+ * @param conversation_id The conversation to inspect.
+ * @return The number of tokens the history is expected to occupy, or 0 if unknown.
+ */
+int ConversationManager::token_count(const std::string& conversation_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = conversations_.find(conversation_id);
+    return it == conversations_.end() ? 0 : total_tokens(it->second);
+}
+
+/**
+ * @brief Drops the oldest compactable messages until the history fits in the context window.
+ *
+ * An eighth of the window is kept free for the reply.
+ */
+void ConversationManager::trim_to_fit(Conversation& conversation)
+{
+    const int budget = policy_.num_ctx - policy_.num_ctx / 8;
+    std::size_t dropped = 0;
+
+    while (total_tokens(conversation) > budget && conversation.history.size() > policy_.keep_recent_messages) {
+        conversation.history.erase(conversation.history.begin());
+        conversation.tokens.erase(conversation.tokens.begin());
+        ++dropped;
+    }
+
+    if (dropped > 0) {
+        conversation.trimmed += dropped;
+        logger_->log(LogLevel::WARN, "Context window exceeded, trimmed " + std::to_string(dropped) + " messages.");
+    }
+}
+
+/**
+ * @brief Queues a background summary of the older messages if the threshold is exceeded.
+ */
+void ConversationManager::maybe_schedule_compaction(const std::string& conversation_id, Conversation& conversation)
+{
+    const int threshold = static_cast<int>(policy_.num_ctx * policy_.compact_threshold);
+    if (conversation.compacting || total_tokens(conversation) <= threshold) {
+        return;
+    }
+    if (conversation.history.size() <= policy_.keep_recent_messages + 1) {
+        return;
+    }
+
+    std::size_t prefix = conversation.history.size() - policy_.keep_recent_messages;
+    CompactionJob job{conversation_id,
+                      ollama::messages(),
+                      conversation.trimmed};
+    job.messages.assign(conversation.history.begin(), conversation.history.begin() + prefix);
+
+    conversation.compacting = true;
+    jobs_.push_back(std::move(job));
+    jobs_cv_.notify_one();
+
+    logger_->log(LogLevel::DEBUG, "Scheduled compaction of " + std::to_string(prefix) +
+                 " messages for conversation " + conversation_id + ".");
+}
+
+/**
+ * @brief Background loop summarizing queued conversation prefixes.
+ *
+ * The summary replaces the summarized prefix with a single system message. Messages
+ * that were trimmed while the summary was generated are accounted for, and messages
+ * appended in the meantime are left untouched.
+ */
+void ConversationManager::run_compactions()
+{
+    while (true) {
+        CompactionJob job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            jobs_cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+
+        std::string transcript;
+        for (const auto& message : job.messages) {
+            transcript += message["role"].get<std::string>() + ": " + message["content"].get<std::string>() + "\n";
+        }
+
+        std::string summary;
+        try {
+            ollama::messages request_messages = {
+                ollama::message("system", "Summarize the following conversation in a few sentences. "
+                                          "Keep names, facts and decisions that later turns may refer to."),
+                ollama::message("user", transcript)
+            };
+            ollama::request request(policy_.model, request_messages, request_options(), false);
+            summary = ollama_.chat(request).as_simple_string();
+        } catch (const std::exception& e) {
+            logger_->log(LogLevel::ERROR, "Failed to summarize conversation " + job.conversation_id + ": " + std::string(e.what()));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = conversations_.find(job.conversation_id);
+        if (it == conversations_.end()) {
+            continue;
+        }
+        Conversation& conversation = it->second;
+        conversation.compacting = false;
+
+        if (summary.empty()) {
+            // Fall back to trimming; the synchronous guard in prepare() keeps requests within num_ctx.
+            continue;
+        }
+
+        std::size_t already_dropped = conversation.trimmed - job.trimmed;
+        if (already_dropped >= job.messages.size()) {
+            continue;
+        }
+        std::size_t replace = std::min(job.messages.size() - already_dropped, conversation.history.size());
+        if (replace == 0) {
+            // The history emptied meanwhile (e.g. abandon_pending); there is nothing left to summarize.
+            continue;
+        }
+
+        conversation.history.erase(conversation.history.begin(), conversation.history.begin() + replace);
+        conversation.tokens.erase(conversation.tokens.begin(), conversation.tokens.begin() + replace);
+
+        std::string content = "Summary of the earlier conversation: " + summary;
+        conversation.history.insert(conversation.history.begin(), ollama::message("system", content));
+        conversation.tokens.insert(conversation.tokens.begin(), estimate_tokens(content));
+
+        // The summary message itself counts as one removed-and-replaced slot for later snapshots.
+        conversation.trimmed += replace - 1;
+
+        logger_->log(LogLevel::INFO, "Compacted " + std::to_string(replace) + " messages of conversation " +
+                     job.conversation_id + " into a summary.");
+    }
+}
@@ -0,0 +1,555 @@
+#include "../include/journal.hpp"
+#include <boost/crc.hpp>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Frame header: payload length, crc32 of type + payload.
+constexpr std::size_t header_size = sizeof(uint32_t) * 2;
+
+// Wait before retrying a batch that could not be written.
+constexpr std::chrono::seconds retry_interval(1);
+
+void put_u32(std::string& out, uint32_t value)
+{
+    char bytes[sizeof(value)];
+    std::memcpy(bytes, &value, sizeof(value));
+    out.append(bytes, sizeof(bytes));
+}
+
+void put_string(std::string& out, const std::string& value)
+{
+    put_u32(out, static_cast<uint32_t>(value.size()));
+    out.append(value);
+}
+
+void put_tokens(std::string& out, const std::vector<int32_t>& tokens)
+{
+    put_u32(out, static_cast<uint32_t>(tokens.size()));
+    out.append(reinterpret_cast<const char*>(tokens.data()), tokens.size() * sizeof(int32_t));
+}
+
+/// Bounds-checked reader over a record payload.
+struct Reader {
+    const char* data;
+    std::size_t size;
+    std::size_t pos = 0;
+    bool ok = true;
+
+    uint32_t u32()
+    {
+        uint32_t value = 0;
+        if (size - pos < sizeof(value)) { ok = false; return 0; }
+        std::memcpy(&value, data + pos, sizeof(value));
+        pos += sizeof(value);
+        return value;
+    }
+
+    uint8_t u8()
+    {
+        if (pos >= size) { ok = false; return 0; }
+        return static_cast<uint8_t>(data[pos++]);
+    }
+
+    std::string str()
+    {
+        uint32_t length = u32();
+        if (!ok || size - pos < length) { ok = false; return {}; }
+        std::string value(data + pos, length);
+        pos += length;
+        return value;
+    }
+
+    std::vector<int32_t> tokens()
+    {
+        uint32_t count = u32();
+        if (!ok || (size - pos) / sizeof(int32_t) < count) { ok = false; return {}; }
+        std::vector<int32_t> value(count);
+        std::memcpy(value.data(), data + pos, count * sizeof(int32_t));
+        pos += count * sizeof(int32_t);
+        return value;
+    }
+};
+
+uint32_t checksum(const char* data, std::size_t size)
+{
+    boost::crc_32_type crc;
+    crc.process_bytes(data, size);
+    return crc.checksum();
+}
+
+/// Appends a framed record: [length][crc32][type][payload].
+void frame(std::string& out, uint8_t type, const std::string& payload)
+{
+    std::string body;
+    body.reserve(payload.size() + 1);
+    body.push_back(static_cast<char>(type));
+    body.append(payload);
+
+    put_u32(out, static_cast<uint32_t>(body.size()));
+    put_u32(out, checksum(body.data(), body.size()));
+    out.append(body);
+}
+
+std::string accepted_payload(const std::string& id, const std::string& prompt,
+                             const std::string& conversation_id, const std::vector<int32_t>& context,
+                             const std::string& callback_url)
+{
+    std::string payload;
+    put_string(payload, id);
+    put_string(payload, prompt);
+    put_string(payload, conversation_id);
+    put_tokens(payload, context);
+    put_string(payload, callback_url);
+    return payload;
+}
+
+std::string completed_payload(const std::string& id, bool canceled,
+                              const std::vector<std::string>& partial_responses, const std::vector<int32_t>& context)
+{
+    std::string payload;
+    put_string(payload, id);
+    payload.push_back(canceled ? 1 : 0);
+    put_u32(payload, static_cast<uint32_t>(partial_responses.size()));
+    for (const auto& response : partial_responses) {
+        put_string(payload, response);
+    }
+    put_tokens(payload, context);
+    return payload;
+}
+
+} // namespace
+
+/**
+ * @brief Opens (or creates) the journal file and starts the writer thread.
+ *
+ * @param path Path of the journal file.
+ * @param flush_interval Maximum time a record waits in memory before it is fsynced.
+ * @param max_retained_completed Number of completed queries kept across compactions.
+ * @throws std::runtime_error if the file cannot be opened.
+ */
+QueryJournal::QueryJournal(const std::string& path, std::chrono::milliseconds flush_interval, std::size_t max_retained_completed)
+    : path_(path), flush_interval_(flush_interval), max_retained_completed_(max_retained_completed),
+      logger_(LoggerManager::getLogger("journal_logger", LogLevel::DEBUG, LogOutput::CONSOLE))
+{
+    fd_ = ::open(path_.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        logger_->log(LogLevel::ERROR, "Cannot open query journal: " + path_);
+        throw std::runtime_error("Failed to open query journal");
+    }
+
+    writer_ = std::thread(&QueryJournal::run_writer, this);
+}
+
+/**
+ * @brief Flushes outstanding records and stops the writer thread.
+ */
+QueryJournal::~QueryJournal()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    pending_cv_.notify_all();
+    if (writer_.joinable()) {
+        writer_.join();
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+/**
+ * @brief Records that a query was accepted into the queue.
+ */
+void QueryJournal::record_accepted(const std::string& id, const std::string& prompt,
+                                   const std::string& conversation_id, const std::vector<int32_t>& context,
+                                   const std::string& callback_url)
+{
+    append(RecordType::accepted, accepted_payload(id, prompt, conversation_id, context, callback_url));
+}
+
+/**
+ * @brief Records the final state of a query once it has been processed.
+ */
+void QueryJournal::record_completed(const std::string& id, bool canceled,
+                                    const std::vector<std::string>& partial_responses, const std::vector<int32_t>& context)
+{
+    append(RecordType::completed, completed_payload(id, canceled, partial_responses, context));
+}
+
+/**
+ * @brief Records that a query was canceled before it ran.
+ */
+void QueryJournal::record_canceled(const std::string& id)
+{
+    std::string payload;
+    put_string(payload, id);
+    append(RecordType::canceled, payload);
+}
+
+/**
+ * @brief Frames a record and hands it to the writer thread.
+ */
+void QueryJournal::append(RecordType type, const std::string& payload)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    frame(pending_, static_cast<uint8_t>(type), payload);
+    ++appended_;
+    pending_cv_.notify_one();
+}
+
+/**
+ * @brief Blocks until every record appended so far is durable.
+ *
+ * @throws std::runtime_error if the journal cannot be written; the records stay pending.
+ */
+void QueryJournal::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t target = appended_;
+    pending_cv_.notify_one();
+    durable_cv_.wait(lock, [this, target] { return durable_ >= target || stopping_ || !error_.empty(); });
+    if (durable_ < target && !error_.empty()) {
+        throw std::runtime_error(error_);
+    }
+}
+
+/**
+ * @brief Appends a batch to the file and syncs it; a failed batch is truncated away again.
+ *
+ * After a failed fdatasync() the kernel may have dropped the dirty pages, so a
+ * later sync could succeed without the data; the batch is rewritten instead.
+ *
+ * @param fd The journal, opened for appending.
+ * @param batch Encoded records.
+ * @return An empty string on success, else the reason it failed.
+ */
+std::string QueryJournal::write_batch(int fd, const std::string& batch)
+{
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        return "Failed to stat query journal: " + std::string(std::strerror(errno));
+    }
+
+    std::string error;
+    std::size_t written = 0;
+    while (written < batch.size()) {
+        ssize_t n = ::write(fd, batch.data() + written, batch.size() - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            error = "Failed to write query journal: " + std::string(std::strerror(errno));
+            break;
+        }
+        written += static_cast<std::size_t>(n);
+    }
+    if (error.empty() && ::fdatasync(fd) != 0) {
+        error = "Failed to sync query journal: " + std::string(std::strerror(errno));
+    }
+
+    if (!error.empty() && written > 0 && ::ftruncate(fd, st.st_size) != 0) {
+        error += "; the partial batch could not be truncated: " + std::string(std::strerror(errno));
+    }
+    return error;
+}
+
+/**
+ * @brief Background loop implementing group commit.
+ *
+ * Waits for the first pending record, then lets the batch fill for up to one flush
+ * interval before a single write() and fdatasync() make the whole batch durable.
+ * A failed batch goes back in front of the pending records and is retried; it only
+ * counts as durable once a retry succeeds.
+ */
+void QueryJournal::run_writer()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        pending_cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+        if (pending_.empty() && stopping_) {
+            return;
+        }
+
+        if (!stopping_) {
+            pending_cv_.wait_for(lock, flush_interval_, [this] { return stopping_; });
+        }
+
+        std::string batch;
+        batch.swap(pending_);
+        uint64_t batch_end = appended_;
+        int fd = fd_;
+        lock.unlock();
+
+        std::string error = write_batch(fd, batch);
+
+        lock.lock();
+        if (!error.empty()) {
+            if (error_.empty()) {
+                logger_->log(LogLevel::ERROR, error + "; retrying.");
+            }
+            error_ = error;
+            batch.append(pending_);
+            pending_.swap(batch);
+            durable_cv_.notify_all();
+            if (stopping_) {
+                logger_->log(LogLevel::ERROR, "Query journal stopped with " + std::to_string(appended_ - durable_) +
+                             " records that are not durable.");
+                return;
+            }
+            pending_cv_.wait_for(lock, retry_interval, [this] { return stopping_; });
+            continue;
+        }
+
+        if (!error_.empty()) {
+            logger_->log(LogLevel::INFO, "Query journal is writable again.");
+            error_.clear();
+        }
+        records_in_file_ += batch_end - durable_;
+        durable_ = batch_end;
+        durable_cv_.notify_all();
+
+        // Periodic compaction keeps the file, and therefore recovery time, bounded. Only this
+        // thread writes the file, so it is rewritten without the lock while appends go on in memory.
+        if (records_in_file_ > 2 * live_queries_ + 4 * max_retained_completed_) {
+            lock.unlock();
+            std::vector<JournaledQuery> queries;
+            uint64_t written_records = 0;
+            int compacted_fd = -1;
+            try {
+                uint64_t valid_bytes = 0;
+                uint64_t records = 0;
+                queries = scan(fd, valid_bytes, records);
+                compacted_fd = compact(queries, written_records);
+            } catch (const std::exception& e) {
+                logger_->log(LogLevel::ERROR, e.what());
+            }
+            lock.lock();
+            if (compacted_fd >= 0) {
+                swap_in(compacted_fd, written_records, queries.size());
+            }
+        }
+    }
+}
+
+/**
+ * @brief Scans the journal through mmap and folds its records into per-query state.
+ *
+ * @param fd The journal.
+ * @param valid_bytes Set to the length of the intact record prefix.
+ * @param records Set to the number of intact records.
+ */
+std::vector<JournaledQuery> QueryJournal::scan(int fd, uint64_t& valid_bytes, uint64_t& records)
+{
+    std::vector<JournaledQuery> queries;
+    std::unordered_map<std::string, std::size_t> index;
+    valid_bytes = 0;
+    records = 0;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+        return queries;
+    }
+
+    auto size = static_cast<std::size_t>(st.st_size);
+    void* mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::runtime_error("Failed to map query journal: " + std::string(std::strerror(errno)));
+    }
+    ::madvise(mapping, size, MADV_SEQUENTIAL);
+
+    const char* data = static_cast<const char*>(mapping);
+    std::size_t pos = 0;
+    while (size - pos >= header_size) {
+        uint32_t length, crc;
+        std::memcpy(&length, data + pos, sizeof(length));
+        std::memcpy(&crc, data + pos + sizeof(length), sizeof(crc));
+        if (length == 0 || size - pos - header_size < length) {
+            break;
+        }
+        const char* body = data + pos + header_size;
+        if (checksum(body, length) != crc) {
+            break;
+        }
+
+        Reader reader{body, length};
+        auto type = static_cast<RecordType>(reader.u8());
+        std::string id = reader.str();
+
+        if (type == RecordType::accepted) {
+            JournaledQuery query;
+            query.id = id;
+            query.prompt = reader.str();
+            query.conversation_id = reader.str();
+            query.context = reader.tokens();
+            if (reader.ok && reader.pos < reader.size) {
+                query.callback_url = reader.str();  // Absent in records written before callbacks existed.
+            }
+            if (reader.ok && index.find(id) == index.end()) {
+                index.emplace(id, queries.size());
+                queries.push_back(std::move(query));
+            }
+        } else if (type == RecordType::completed) {
+            bool canceled = reader.u8() != 0;
+            uint32_t count = reader.u32();
+            std::vector<std::string> responses;
+            for (uint32_t i = 0; reader.ok && i < count; ++i) {
+                responses.push_back(reader.str());
+            }
+            std::vector<int32_t> context = reader.tokens();
+            auto it = index.find(id);
+            if (reader.ok && it != index.end()) {
+                auto& query = queries[it->second];
+                query.completed = true;
+                query.canceled = canceled;
+                query.partial_responses = std::move(responses);
+                query.context = std::move(context);
+            }
+        } else if (type == RecordType::canceled) {
+            auto it = index.find(id);
+            if (reader.ok && it != index.end()) {
+                queries[it->second].canceled = true;
+            }
+        }
+
+        pos += header_size + length;
+        ++records;
+    }
+
+    ::munmap(mapping, size);
+    valid_bytes = pos;
+    return queries;
+}
+
+/**
+ * @brief Replays the journal and returns the state of every known query.
+ *
+ * @return The recovered queries, in the order they were accepted.
+ */
+std::vector<JournaledQuery> QueryJournal::recover()
+{
+    auto start = std::chrono::steady_clock::now();
+    uint64_t valid_bytes = 0;
+    uint64_t records = 0;
+
+    flush();
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    std::vector<JournaledQuery> queries = scan(fd_, valid_bytes, records);
+
+    struct stat st;
+    if (::fstat(fd_, &st) == 0 && static_cast<uint64_t>(st.st_size) > valid_bytes) {
+        logger_->log(LogLevel::WARN, "Discarding torn tail of query journal (" +
+                     std::to_string(st.st_size - valid_bytes) + " bytes).");
+        if (::ftruncate(fd_, static_cast<off_t>(valid_bytes)) != 0) {
+            logger_->log(LogLevel::ERROR, "Failed to truncate query journal: " + std::string(std::strerror(errno)));
+        }
+    }
+    records_in_file_ = records;
+    live_queries_ = queries.size();
+
+    // Compact when more than half the records are superseded or too many completed queries pile up.
+    std::size_t completed = 0;
+    for (const auto& query : queries) {
+        completed += query.completed ? 1 : 0;
+    }
+    if (records > 2 * queries.size() + 1024 || completed > max_retained_completed_) {
+        uint64_t written_records = 0;
+        int compacted_fd = compact(queries, written_records);
+        if (compacted_fd >= 0) {
+            swap_in(compacted_fd, written_records, queries.size());
+        }
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    logger_->log(LogLevel::INFO, "Recovered " + std::to_string(queries.size()) + " queries from " +
+                 std::to_string(records) + " journal records in " + std::to_string(elapsed) + " ms.");
+    return queries;
+}
+
+/**
+ * @brief Rewrites the journal with one record pair per retained query.
+ *
+ * Canceled queries that never ran are dropped, and only the most recent
+ * max_retained_completed completed queries are kept. The new file is opened for
+ * appending before it is renamed over the journal, so the returned descriptor
+ * needs no reopening. Touches nothing guarded by mutex_.
+ *
+ * @param written_records Set to the number of records in the new file.
+ * @return The new journal opened for appending, or -1 if the old one stays in place.
+ */
+int QueryJournal::compact(std::vector<JournaledQuery>& queries, uint64_t& written_records)
+{
+    std::size_t completed = 0;
+    for (const auto& query : queries) {
+        completed += query.completed ? 1 : 0;
+    }
+    std::size_t drop_completed = completed > max_retained_completed_ ? completed - max_retained_completed_ : 0;
+
+    std::vector<JournaledQuery> kept;
+    kept.reserve(queries.size());
+    for (auto& query : queries) {
+        if (query.canceled && !query.completed) {
+            continue;
+        }
+        if (query.completed && drop_completed > 0) {
+            --drop_completed;
+            continue;
+        }
+        kept.push_back(std::move(query));
+    }
+    queries.swap(kept);
+
+    std::string tmp_path = path_ + ".compact";
+    int tmp_fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (tmp_fd < 0) {
+        logger_->log(LogLevel::ERROR, "Cannot create compacted query journal: " + tmp_path);
+        return -1;
+    }
+
+    std::string encoded;
+    written_records = 0;
+    for (const auto& query : queries) {
+        frame(encoded, static_cast<uint8_t>(RecordType::accepted),
+              accepted_payload(query.id, query.prompt, query.conversation_id,
+                               query.completed ? std::vector<int32_t>() : query.context, query.callback_url));
+        ++written_records;
+        if (query.completed) {
+            frame(encoded, static_cast<uint8_t>(RecordType::completed),
+                  completed_payload(query.id, query.canceled, query.partial_responses, query.context));
+            ++written_records;
+        }
+    }
+
+    std::string error = write_batch(tmp_fd, encoded);
+    if (error.empty() && ::rename(tmp_path.c_str(), path_.c_str()) != 0) {
+        error = "Failed to rename compacted query journal: " + std::string(std::strerror(errno));
+    }
+    if (!error.empty()) {
+        ::close(tmp_fd);
+        ::unlink(tmp_path.c_str());
+        logger_->log(LogLevel::ERROR, error + "; keeping the old journal.");
+        return -1;
+    }
+
+    logger_->log(LogLevel::INFO, "Compacted query journal to " + std::to_string(written_records) + " records.");
+    return tmp_fd;
+}
+
+/**
+ * @brief Replaces the journal descriptor with a compacted one; must be called with mutex_ held.
+ */
+void QueryJournal::swap_in(int fd, uint64_t written_records, uint64_t live_queries)
+{
+    ::close(fd_);
+    fd_ = fd;
+    records_in_file_ = written_records;
+    live_queries_ = live_queries;
+}
@@ -0,0 +1,336 @@
+#include "../include/shared_query_store.hpp"
+#include <sys/mman.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+namespace {
+
+uint64_t key_of(const std::string& query_id)
+{
+    uint64_t key = std::hash<std::string>{}(query_id);
+    return key == 0 ? 1 : key;  // 0 marks a free slot
+}
+
+int64_t now_ms()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+/**
+ * @brief Maps an anonymous shared region of `slots` slots of `slot_bytes` bytes each.
+ *
+ * The region must be created before the worker processes are forked; they inherit it.
+ *
+ * @param slots Number of queries the store can hold.
+ * @param slot_bytes Size of each slot, header included; bounds the token log of one query.
+ * @throws std::runtime_error if the mapping cannot be created.
+ */
+SharedQueryStore::SharedQueryStore(std::size_t slots, std::size_t slot_bytes)
+    : slots_(std::max<std::size_t>(1, slots)),
+      logger_(LoggerManager::getLogger("shared_store_logger", LogLevel::INFO, LogOutput::CONSOLE))
+{
+    // Keep every slot header cache-line aligned.
+    slot_bytes_ = (std::max(slot_bytes, sizeof(SlotHeader) + 256) + 63) & ~std::size_t(63);
+    log_capacity_ = slot_bytes_ - sizeof(SlotHeader);
+    region_bytes_ = slots_ * slot_bytes_;
+
+    region_ = ::mmap(nullptr, region_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (region_ == MAP_FAILED) {
+        region_ = nullptr;
+        throw std::runtime_error("Failed to map shared query store: " + std::string(std::strerror(errno)));
+    }
+
+    logger_->log(LogLevel::INFO, "Shared query store mapped: " + std::to_string(slots_) + " slots of " +
+                 std::to_string(slot_bytes_) + " bytes.");
+}
+
+/**
+ * @brief Unmaps the region in this process.
+ */
+SharedQueryStore::~SharedQueryStore()
+{
+    if (region_) {
+        ::munmap(region_, region_bytes_);
+    }
+}
+
+SharedQueryStore::SlotHeader* SharedQueryStore::header(std::size_t slot) const
+{
+    return reinterpret_cast<SlotHeader*>(static_cast<char*>(region_) + slot * slot_bytes_);
+}
+
+char* SharedQueryStore::log(std::size_t slot) const
+{
+    return reinterpret_cast<char*>(header(slot)) + sizeof(SlotHeader);
+}
+
+void SharedQueryStore::touch(SlotHeader* h) const
+{
+    h->updated_ms.store(now_ms(), std::memory_order_relaxed);
+}
+
+/**
+ * @brief Claims a slot for a new query.
+ *
+ * Takes the first free slot in the probe window (or the query's own slot when a
+ * restarted worker re-inserts it), or else evicts the least recently updated
+ * completed query in it. A slot is claimed by moving its generation from even
+ * to odd with a CAS, so exactly one process resets it and concurrent readers discard
+ * what they copied; the generation becomes even again once the slot is reinitialized.
+ *
+ * @param query_id The ID of the new query.
+ * @return The slot index, or -1 if every slot in the probe window is in use by an unfinished query.
+ */
+int SharedQueryStore::insert(const std::string& query_id)
+{
+    if (query_id.size() > max_id_length) {
+        logger_->log(LogLevel::ERROR, "Query ID too long for the shared store: " + query_id);
+        return -1;
+    }
+
+    const uint64_t key = key_of(query_id);
+    const std::size_t start = key % slots_;
+
+    for (int attempt = 0; attempt < 4; ++attempt) {
+        int victim = -1;
+        uint32_t victim_generation = 0;
+        int64_t oldest = INT64_MAX;
+
+        for (std::size_t i = 0; i < std::min(max_probe, slots_); ++i) {
+            std::size_t slot = (start + i) % slots_;
+            SlotHeader* h = header(slot);
+            uint32_t generation = h->generation.load(std::memory_order_acquire);
+            if (generation & 1) {
+                continue;  // Being claimed by someone else.
+            }
+
+            // Reuse a free slot, or the slot of the same query left behind by a crashed worker.
+            uint64_t current = h->key.load(std::memory_order_acquire);
+            if (current == 0 || (current == key && std::strncmp(h->id, query_id.c_str(), sizeof(h->id)) == 0)) {
+                victim = static_cast<int>(slot);
+                victim_generation = generation;
+                break;
+            }
+
+            uint32_t flags = h->flags.load(std::memory_order_acquire);
+            int64_t updated = h->updated_ms.load(std::memory_order_relaxed);
+            if ((flags & flag_completed) && updated < oldest) {
+                oldest = updated;
+                victim = static_cast<int>(slot);
+                victim_generation = generation;
+            }
+        }
+
+        if (victim < 0) {
+            break;
+        }
+
+        SlotHeader* h = header(victim);
+        if (!h->generation.compare_exchange_strong(victim_generation, victim_generation + 1, std::memory_order_acq_rel)) {
+            continue;  // Lost the race for this slot; probe again.
+        }
+
+        h->flags.store(0, std::memory_order_relaxed);
+        h->log_bytes.store(0, std::memory_order_relaxed);
+        h->context_offset.store(0, std::memory_order_relaxed);
+        std::memset(h->id, 0, sizeof(h->id));
+        std::memcpy(h->id, query_id.data(), query_id.size());
+        touch(h);
+        h->key.store(key, std::memory_order_relaxed);
+        h->generation.fetch_add(1, std::memory_order_release);
+        return victim;
+    }
+
+    logger_->log(LogLevel::ERROR, "Shared query store is full, query " + query_id + " is only visible to its worker.");
+    return -1;
+}
+
+/**
+ * @brief Returns the slot holding a query, or -1.
+ */
+int SharedQueryStore::locate(const std::string& query_id) const
+{
+    if (query_id.size() > max_id_length) {
+        return -1;
+    }
+
+    const uint64_t key = key_of(query_id);
+    const std::size_t start = key % slots_;
+    for (std::size_t i = 0; i < std::min(max_probe, slots_); ++i) {
+        std::size_t slot = (start + i) % slots_;
+        SlotHeader* h = header(slot);
+        if (h->key.load(std::memory_order_acquire) == key &&
+            std::strncmp(h->id, query_id.c_str(), sizeof(h->id)) == 0) {
+            return static_cast<int>(slot);
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Appends one partial response to the token log of a slot owned by this process.
+ *
+ * The record is written first and then published by a release store of the log
+ * length. Once the slot is full the query is flagged as truncated.
+ */
+void SharedQueryStore::append(int slot, const std::string& partial_response)
+{
+    if (slot < 0) {
+        return;
+    }
+
+    SlotHeader* h = header(slot);
+    uint32_t used = h->log_bytes.load(std::memory_order_relaxed);
+    uint32_t length = static_cast<uint32_t>(partial_response.size());
+    if (used + sizeof(length) + length > log_capacity_) {
+        h->flags.fetch_or(flag_truncated, std::memory_order_release);
+        return;
+    }
+
+    char* out = log(slot) + used;
+    std::memcpy(out, &length, sizeof(length));
+    std::memcpy(out + sizeof(length), partial_response.data(), length);
+    h->log_bytes.store(used + sizeof(length) + length, std::memory_order_release);
+    touch(h);
+}
+
+/**
+ * @brief Marks a slot as running.
+ */
+void SharedQueryStore::set_running(int slot)
+{
+    if (slot < 0) {
+        return;
+    }
+
+    header(slot)->flags.fetch_or(flag_running, std::memory_order_release);
+    touch(header(slot));
+}
+
+/**
+ * @brief Marks a slot as completed and stores the final context if it fits.
+ *
+ * The context is written behind the token log, as a u32 count followed by the
+ * tokens, before the completed flag is published.
+ */
+void SharedQueryStore::complete(int slot, bool canceled, const std::vector<int32_t>& context)
+{
+    if (slot < 0) {
+        return;
+    }
+
+    SlotHeader* h = header(slot);
+    uint32_t set = flag_completed | (canceled ? uint32_t(flag_canceled) : 0u);
+
+    uint32_t offset = (h->log_bytes.load(std::memory_order_relaxed) + 3) & ~uint32_t(3);
+    uint32_t count = static_cast<uint32_t>(context.size());
+    if (count > 0 && offset + sizeof(count) + count * sizeof(int32_t) <= log_capacity_) {
+        char* out = log(slot) + offset;
+        std::memcpy(out, &count, sizeof(count));
+        std::memcpy(out + sizeof(count), context.data(), count * sizeof(int32_t));
+        h->context_offset.store(offset, std::memory_order_relaxed);
+        set |= flag_has_context;
+    }
+
+    touch(h);
+    h->flags.fetch_and(~uint32_t(flag_running), std::memory_order_relaxed);
+    h->flags.fetch_or(set, std::memory_order_release);
+}
+
+/**
+ * @brief Whether another worker asked to cancel the query in a slot.
+ */
+bool SharedQueryStore::cancel_requested(int slot) const
+{
+    return slot >= 0 && (header(slot)->flags.load(std::memory_order_acquire) & flag_cancel_requested);
+}
+
+/**
+ * @brief Asks the owning worker to cancel a query.
+ *
+ * @param query_id The ID of the query.
+ * @return False if the query is not in the store.
+ */
+bool SharedQueryStore::request_cancel(const std::string& query_id)
+{
+    int slot = locate(query_id);
+    if (slot < 0) {
+        return false;
+    }
+
+    header(slot)->flags.fetch_or(flag_cancel_requested, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Reads a consistent snapshot of a query.
+ *
+ * Copies the committed part of the token log and re-checks the slot generation
+ * afterwards; if the slot was reclaimed in the meantime the copy is discarded.
+ *
+ * @param query_id The ID of the query.
+ * @param status Receives the snapshot.
+ * @return False if the query is not in the store.
+ */
+bool SharedQueryStore::find(const std::string& query_id, SharedQueryStatus& status) const
+{
+    int slot = locate(query_id);
+    if (slot < 0) {
+        return false;
+    }
+
+    SlotHeader* h = header(slot);
+    uint32_t generation = h->generation.load(std::memory_order_acquire);
+    if (generation & 1) {
+        return false;
+    }
+
+    uint32_t flags = h->flags.load(std::memory_order_acquire);
+    uint32_t used = std::min<uint32_t>(h->log_bytes.load(std::memory_order_acquire), log_capacity_);
+    std::string copy(log(slot), used);
+
+    std::vector<int32_t> context;
+    if (flags & flag_has_context) {
+        uint32_t offset = h->context_offset.load(std::memory_order_relaxed);
+        uint32_t count = 0;
+        if (offset + sizeof(count) <= log_capacity_) {
+            std::memcpy(&count, log(slot) + offset, sizeof(count));
+        }
+        if (offset + sizeof(count) + static_cast<std::size_t>(count) * sizeof(int32_t) <= log_capacity_) {
+            context.resize(count);
+            std::memcpy(context.data(), log(slot) + offset + sizeof(count), count * sizeof(int32_t));
+        }
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (h->generation.load(std::memory_order_relaxed) != generation ||
+        std::strncmp(h->id, query_id.c_str(), sizeof(h->id)) != 0) {
+        return false;  // Reclaimed while we were copying.
+    }
+
+    status = SharedQueryStatus();
+    status.completed = flags & flag_completed;
+    status.running = flags & flag_running;
+    status.canceled = flags & (flag_canceled | flag_cancel_requested);
+    status.truncated = flags & flag_truncated;
+    status.context = std::move(context);
+
+    for (std::size_t pos = 0; pos + sizeof(uint32_t) <= copy.size();) {
+        uint32_t length;
+        std::memcpy(&length, copy.data() + pos, sizeof(length));
+        pos += sizeof(length);
+        if (pos + length > copy.size()) {
+            break;
+        }
+        status.partial_responses.emplace_back(copy.data() + pos, length);
+        pos += length;
+    }
+
+    return true;
+}
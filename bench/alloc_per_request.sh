@@ -0,0 +1,48 @@
+#!/bin/sh
+# Counts the server's heap allocations per request in a keep-alive loop.
+#
+# Usage: bench/alloc_per_request.sh [target] [connections] [duration] [server threads]
+#
+# Builds bin/alloc/main with ALLOC_STATS=1, which counts every call of the global
+# operator new, runs bin/loadgen against TARGET (default /query_status/0) and
+# divides the allocations made during the run by the requests read.
+
+set -e
+
+TARGET=${1:-/query_status/0}
+CONNECTIONS=${2:-16}
+DURATION=${3:-10}
+THREADS=${4:-2}
+PORT=${PORT:-8443}
+JOBS=$(nproc)
+
+make -j"$JOBS" bench
+make -j"$JOBS" OBJ_DIR=obj/alloc BIN_DIR=bin/alloc ALLOC_STATS=1
+
+# Prints the heap_allocations and requests_read counters of the running server
+counters() {
+    curl -sk "https://127.0.0.1:$PORT/performance_statistics" | python3 -c '
+import json, sys
+stats = {s["metric_name"]: s["total_value"] for s in json.load(sys.stdin)}
+print(int(stats["heap_allocations"]), int(stats["requests_read"]))'
+}
+
+./bin/alloc/main 127.0.0.1 "$PORT" www "$THREADS" > /dev/null 2>&1 &
+server=$!
+sleep 1
+
+# Warm up, so arenas, caches and pools are in their steady state
+./bin/loadgen 127.0.0.1 "$PORT" --target "$TARGET" --connections "$CONNECTIONS" --duration 2 --threads 2 > /dev/null
+set -- $(counters)
+before_allocations=$1
+before_requests=$2
+
+./bin/loadgen 127.0.0.1 "$PORT" --target "$TARGET" --connections "$CONNECTIONS" \
+    --duration "$DURATION" --threads 2
+
+set -- $(counters)
+# The statistics request itself is included in both the allocations and the requests
+echo "allocations per request: $(( ($1 - before_allocations) / ($2 - before_requests) ))"
+
+kill -INT "$server"
+wait "$server" 2> /dev/null || true
@@ -0,0 +1,45 @@
+#!/bin/sh
+# Compares the epoll and io_uring builds of bin/main on the static file and status endpoints.
+#
+# Usage: bench/compare_io.sh [connections] [duration] [server threads]
+#
+# Builds both variants into separate directories, starts each one in turn on
+# PORT (default 8443) and runs bin/loadgen against / (static file) and
+# /query_status/<unknown id> (JSON status endpoint).
+# Set STRACE=1 to also print the per-backend syscall summary of the server.
+# IO_URING=1 only moves socket I/O to io_uring; file bodies are still read with
+# blocking reads on the io threads, so / mostly measures the socket side.
+
+set -e
+
+CONNECTIONS=${1:-256}
+DURATION=${2:-15}
+THREADS=${3:-4}
+PORT=${PORT:-8443}
+JOBS=$(nproc)
+
+make -j"$JOBS" bench
+make -j"$JOBS" OBJ_DIR=obj/epoll BIN_DIR=bin/epoll
+make -j"$JOBS" OBJ_DIR=obj/io_uring BIN_DIR=bin/io_uring IO_URING=1
+
+for backend in epoll io_uring; do
+    if [ "$STRACE" = 1 ]; then
+        strace -c -f -o "strace_$backend.txt" ./bin/$backend/main 127.0.0.1 "$PORT" www "$THREADS" > /dev/null 2>&1 &
+    else
+        ./bin/$backend/main 127.0.0.1 "$PORT" www "$THREADS" > /dev/null 2>&1 &
+    fi
+    server=$!
+    sleep 1
+
+    for target in / /query_status/0; do
+        echo "== $backend $target"
+        ./bin/loadgen 127.0.0.1 "$PORT" --target "$target" --connections "$CONNECTIONS" \
+            --duration "$DURATION" --threads 4
+    done
+
+    kill -INT "$server"
+    wait "$server" 2> /dev/null || true
+    if [ "$STRACE" = 1 ]; then
+        head -n 25 "strace_$backend.txt"
+    fi
+done
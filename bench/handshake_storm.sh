@@ -0,0 +1,38 @@
+#!/bin/sh
+# Measures keep-alive request latency during a storm of new TLS connections,
+# with handshakes on the io threads and on a dedicated handshake pool.
+#
+# Usage: bench/handshake_storm.sh [connections] [churn connections] [duration] [server threads] [handshake threads]
+#
+# Each run keeps CONNECTIONS keep-alive clients busy on /query_status/0 while
+# CHURN clients reconnect with a full handshake for every request. Compare the
+# keep-alive p99 of the two runs, and of a run with --churn 0 as the baseline.
+
+set -e
+
+CONNECTIONS=${1:-64}
+CHURN=${2:-256}
+DURATION=${3:-15}
+THREADS=${4:-4}
+HANDSHAKE_THREADS=${5:-2}
+PORT=${PORT:-8443}
+
+make -j"$(nproc)"
+make -j"$(nproc)" bench
+
+for pool in 0 "$HANDSHAKE_THREADS"; do
+    ./bin/main 127.0.0.1 "$PORT" www "$THREADS" --handshake-threads "$pool" > /dev/null 2>&1 &
+    server=$!
+    sleep 1
+
+    echo "== handshake threads: $pool (0 = io threads), no churn"
+    ./bin/loadgen 127.0.0.1 "$PORT" --target /query_status/0 --connections "$CONNECTIONS" \
+        --duration "$DURATION" --threads 2
+
+    echo "== handshake threads: $pool (0 = io threads), churn $CHURN"
+    ./bin/loadgen 127.0.0.1 "$PORT" --target /query_status/0 --connections "$CONNECTIONS" \
+        --duration "$DURATION" --threads 4 --churn "$CHURN"
+
+    kill -INT "$server"
+    wait "$server" 2> /dev/null || true
+done
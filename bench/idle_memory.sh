@@ -0,0 +1,69 @@
+#!/bin/sh
+# Measures the server's resident memory per idle keep-alive TLS connection (C10K).
+#
+# Usage: bench/idle_memory.sh [idle connections] [server threads]
+#
+# Holds IDLE TLS connections open, each idle after one request, and divides the
+# growth of the server's VmRSS by the connections open. The first run keeps
+# OpenSSL's record buffers, the read buffers and the request arenas of idle
+# connections, as the server did before they were released; the second run keeps
+# 4 KiB of read buffer and no arena per idle connection. Both the server and loadgen need a file descriptor per connection.
+
+set -e
+
+IDLE=${1:-10000}
+THREADS=${2:-2}
+PORT=${PORT:-8443}
+HOLD=25  # Below the server's 30 s idle timeout
+
+ulimit -n $((IDLE + 1024)) 2> /dev/null || echo "warning: could not raise the file descriptor limit"
+
+make -j"$(nproc)"
+make -j"$(nproc)" bench
+
+rss_kib() {
+    awk '/^VmRSS/ { print $2 }' "/proc/$1/status"
+}
+
+active_tls() {
+    curl -sk "https://127.0.0.1:$PORT/performance_statistics" | python3 -c '
+import json, sys
+stats = {s["metric_name"]: s["total_value"] for s in json.load(sys.stdin)}
+print(int(stats["connections_tls_active"]))'
+}
+
+measure() {
+    label=$1
+    shift
+    ./bin/main 127.0.0.1 "$PORT" www "$THREADS" "$@" > /dev/null 2>&1 &
+    server=$!
+    sleep 1
+    before=$(rss_kib "$server")
+
+    ./bin/loadgen 127.0.0.1 "$PORT" --target /query_status/0 --connections 1 \
+        --duration "$HOLD" --threads 4 --hold "$IDLE" > /dev/null &
+    load=$!
+
+    # Wait until every connection is open and idle, then let the server settle
+    waited=0
+    while [ "$(active_tls)" -lt "$IDLE" ] && [ "$waited" -lt $((HOLD - 5)) ]; do
+        sleep 1
+        waited=$((waited + 1))
+    done
+    sleep 2
+    connections=$(active_tls)
+    after=$(rss_kib "$server")
+
+    if [ "$connections" -gt 0 ]; then
+        echo "$label: $connections connections, $(( (after - before) * 1024 / connections )) resident bytes per connection"
+    else
+        echo "$label: no connection stayed open"
+    fi
+
+    wait "$load" || true
+    kill -INT "$server"
+    wait "$server" 2> /dev/null || true
+}
+
+measure "before (buffers kept)" --keep-tls-buffers --idle-buffer-bytes 1048576
+measure "after (idle diet)   " --idle-buffer-bytes 4096
@@ -0,0 +1,351 @@
+#include <boost/asio.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/beast/version.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @file loadgen.cpp
+ * @brief Keep-alive HTTPS load generator used to compare server layouts.
+ *
+ * Opens a fixed number of connections spread over a number of client threads
+ * (one io_context each), sends requests back-to-back on every connection for a
+ * fixed duration and reports throughput and latency percentiles.
+ *
+ * With --churn, that many extra connections each do a full TLS handshake, send
+ * one request and close, over and over. Their results are reported separately,
+ * so the keep-alive latencies show how a connection storm affects established
+ * clients.
+ *
+ * With --hold, that many extra connections each send one request and then stay
+ * open without sending anything until the duration ends, as idle keep-alive
+ * clients do. The server's memory per connection can be read meanwhile.
+ *
+ * Usage: loadgen <host> <port> [--target /] [--connections 64] [--duration 10]
+ *                [--threads 2] [--method GET] [--body ""] [--churn 0] [--hold 0]
+ */
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+namespace ssl = net::ssl;
+using tcp = net::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+
+/**
+ * @brief Command line options of the load generator.
+ */
+struct loadgen_options
+{
+    std::string host;
+    std::string port;
+    std::string target = "/";
+    http::verb method = http::verb::get;
+    std::string body;
+    int connections = 64;
+    int duration = 10;  ///< Seconds to keep sending requests.
+    int threads = 2;
+    int churn = 0;  ///< Extra connections that reconnect after every request.
+    int hold = 0;  ///< Extra connections that stay idle after their first request.
+};
+
+/**
+ * @brief Results collected by one client thread; merged once all threads finished.
+ */
+struct loadgen_stats
+{
+    std::vector<uint32_t> latencies_us;  ///< Latency of every successful request.
+    uint64_t errors = 0;
+    uint64_t handshakes = 0;
+    uint64_t non_2xx = 0;
+    uint64_t held = 0;  ///< Idle connections still open at the deadline.
+
+    void merge(const loadgen_stats& other)
+    {
+        latencies_us.insert(latencies_us.end(), other.latencies_us.begin(), other.latencies_us.end());
+        errors += other.errors;
+        handshakes += other.handshakes;
+        non_2xx += other.non_2xx;
+        held += other.held;
+    }
+};
+
+/**
+ * @brief One keep-alive connection sending requests until the deadline.
+ *
+ * Reconnects after errors or when the server closes the connection, so a run
+ * measures the server rather than the number of connections that survived.
+ * A held connection sends one request per connect and then waits for the deadline.
+ */
+class connection : public std::enable_shared_from_this<connection>
+{
+    net::io_context& ioc_;
+    ssl::context& ctx_;
+    const loadgen_options& options_;
+    const tcp::resolver::results_type& endpoints_;
+    clock_type::time_point deadline_;
+    loadgen_stats& stats_;
+    bool churn_;  ///< Close after every response and reconnect with a new handshake.
+    bool hold_;  ///< Stay idle after the first response until the deadline.
+    char idle_byte_ = 0;  ///< Target of the read that notices the server closing a held connection.
+
+    std::unique_ptr<beast::ssl_stream<beast::tcp_stream>> stream_;
+    beast::flat_buffer buffer_;
+    http::request<http::string_body> req_;
+    http::response<http::string_body> res_;
+    clock_type::time_point sent_at_;
+
+public:
+    connection(net::io_context& ioc, ssl::context& ctx, const loadgen_options& options,
+               const tcp::resolver::results_type& endpoints, clock_type::time_point deadline, loadgen_stats& stats,
+               bool churn = false, bool hold = false)
+        : ioc_(ioc), ctx_(ctx), options_(options), endpoints_(endpoints), deadline_(deadline), stats_(stats),
+          churn_(churn), hold_(hold)
+    {
+        req_.method(options_.method);
+        req_.target(options_.target);
+        req_.version(11);
+        req_.set(http::field::host, options_.host);
+        req_.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+        req_.keep_alive(!churn_);
+        if (!options_.body.empty())
+        {
+            req_.set(http::field::content_type, "application/json");
+            req_.body() = options_.body;
+        }
+        req_.prepare_payload();
+    }
+
+    void start()
+    {
+        if (clock_type::now() >= deadline_)
+            return;
+
+        stream_ = std::make_unique<beast::ssl_stream<beast::tcp_stream>>(ioc_, ctx_);
+        SSL_set_tlsext_host_name(stream_->native_handle(), options_.host.c_str());
+        buffer_.clear();
+
+        beast::get_lowest_layer(*stream_).expires_after(std::chrono::seconds(10));
+        beast::get_lowest_layer(*stream_).async_connect(endpoints_,
+            [self = shared_from_this()](beast::error_code ec, tcp::endpoint) {
+                if (ec)
+                    return self->fail();
+                self->stream_->async_handshake(ssl::stream_base::client, [self](beast::error_code ec) {
+                    if (ec)
+                        return self->fail();
+                    ++self->stats_.handshakes;
+                    self->send();
+                });
+            });
+    }
+
+private:
+    void send()
+    {
+        if (clock_type::now() >= deadline_)
+            return close();
+
+        sent_at_ = clock_type::now();
+        beast::get_lowest_layer(*stream_).expires_after(std::chrono::seconds(30));
+        http::async_write(*stream_, req_, [self = shared_from_this()](beast::error_code ec, std::size_t) {
+            if (ec)
+                return self->fail();
+            self->res_ = {};
+            http::async_read(*self->stream_, self->buffer_, self->res_,
+                [self](beast::error_code ec, std::size_t) { self->on_response(ec); });
+        });
+    }
+
+    void on_response(beast::error_code ec)
+    {
+        if (ec)
+            return fail();
+
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(clock_type::now() - sent_at_).count();
+        stats_.latencies_us.push_back(static_cast<uint32_t>(latency));
+        if (res_.result_int() < 200 || res_.result_int() >= 300)
+            ++stats_.non_2xx;
+
+        if (churn_ || !res_.keep_alive())
+        {
+            close();
+            return start();
+        }
+        if (hold_)
+            return wait_idle();
+        send();
+    }
+
+    void wait_idle()
+    {
+        // The server sends nothing on an idle connection, so the read only completes
+        // when it closes the connection or at the deadline
+        beast::get_lowest_layer(*stream_).expires_at(deadline_);
+        stream_->async_read_some(net::buffer(&idle_byte_, 1), [self = shared_from_this()](beast::error_code, std::size_t) {
+            if (clock_type::now() >= self->deadline_)
+                ++self->stats_.held;
+            self->fail();
+        });
+    }
+
+    void fail()
+    {
+        if (clock_type::now() < deadline_)
+            ++stats_.errors;
+        close();
+        start();
+    }
+
+    void close()
+    {
+        if (!stream_)
+            return;
+        beast::error_code ec;
+        beast::get_lowest_layer(*stream_).socket().close(ec);
+        stream_.reset();
+    }
+};
+
+/**
+ * @brief Parses the command line; returns false on malformed input.
+ */
+bool parse_options(int argc, char* argv[], loadgen_options& options)
+{
+    if (argc < 3)
+        return false;
+
+    options.host = argv[1];
+    options.port = argv[2];
+    for (int i = 3; i + 1 < argc; i += 2)
+    {
+        std::string flag = argv[i];
+        std::string value = argv[i + 1];
+        if (flag == "--target")
+            options.target = value;
+        else if (flag == "--connections")
+            options.connections = std::max(1, std::atoi(value.c_str()));
+        else if (flag == "--duration")
+            options.duration = std::max(1, std::atoi(value.c_str()));
+        else if (flag == "--threads")
+            options.threads = std::max(1, std::atoi(value.c_str()));
+        else if (flag == "--method")
+            options.method = http::string_to_verb(value);
+        else if (flag == "--body")
+            options.body = value;
+        else if (flag == "--churn")
+            options.churn = std::max(0, std::atoi(value.c_str()));
+        else if (flag == "--hold")
+            options.hold = std::max(0, std::atoi(value.c_str()));
+        else
+            return false;
+    }
+    return (argc - 3) % 2 == 0 && options.method != http::verb::unknown;
+}
+
+/**
+ * @brief Returns the latency at percentile p of a sorted sample, in microseconds.
+ */
+uint32_t percentile(const std::vector<uint32_t>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    auto index = static_cast<std::size_t>(p * (sorted.size() - 1));
+    return sorted[index];
+}
+
+int main(int argc, char* argv[])
+{
+    loadgen_options options;
+    if (!parse_options(argc, argv, options))
+    {
+        std::cerr << "Usage: loadgen <host> <port> [--target /] [--connections 64] [--duration 10]"
+                     " [--threads 2] [--method GET] [--body \"\"] [--churn 0] [--hold 0]\n";
+        return EXIT_FAILURE;
+    }
+
+    ssl::context ctx{ssl::context::tlsv12_client};
+    ctx.set_verify_mode(ssl::verify_none);
+
+    tcp::resolver::results_type endpoints;
+    try
+    {
+        net::io_context resolve_ioc;
+        endpoints = tcp::resolver(resolve_ioc).resolve(options.host, options.port);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Cannot resolve " << options.host << ":" << options.port << ": " << e.what() << "\n";
+        return EXIT_FAILURE;
+    }
+
+    auto start = clock_type::now();
+    auto deadline = start + std::chrono::seconds(options.duration);
+
+    std::vector<loadgen_stats> stats(options.threads);
+    std::vector<loadgen_stats> churn_stats(options.threads);
+    std::vector<loadgen_stats> hold_stats(options.threads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < options.threads; ++t)
+    {
+        threads.emplace_back([&, t] {
+            net::io_context ioc{1};
+            for (int c = t; c < options.connections; c += options.threads)
+                std::make_shared<connection>(ioc, ctx, options, endpoints, deadline, stats[t])->start();
+            for (int c = t; c < options.churn; c += options.threads)
+                std::make_shared<connection>(ioc, ctx, options, endpoints, deadline, churn_stats[t], true)->start();
+            for (int c = t; c < options.hold; c += options.threads)
+                std::make_shared<connection>(ioc, ctx, options, endpoints, deadline, hold_stats[t], false, true)->start();
+            ioc.run();
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    double seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+    loadgen_stats total;
+    for (auto& s : stats)
+        total.merge(s);
+    std::sort(total.latencies_us.begin(), total.latencies_us.end());
+
+    std::cout << "connections: " << options.connections << ", threads: " << options.threads
+              << ", duration: " << seconds << " s\n"
+              << "requests:    " << total.latencies_us.size() << " (" << total.non_2xx << " non-2xx, "
+              << total.errors << " errors, " << total.handshakes << " handshakes)\n"
+              << "throughput:  " << (seconds > 0 ? total.latencies_us.size() / seconds : 0.0) << " req/s\n"
+              << "latency us:  p50 " << percentile(total.latencies_us, 0.50)
+              << ", p90 " << percentile(total.latencies_us, 0.90)
+              << ", p99 " << percentile(total.latencies_us, 0.99)
+              << ", max " << (total.latencies_us.empty() ? 0 : total.latencies_us.back()) << "\n";
+
+    if (options.churn > 0)
+    {
+        loadgen_stats churn;
+        for (auto& s : churn_stats)
+            churn.merge(s);
+        std::sort(churn.latencies_us.begin(), churn.latencies_us.end());
+        std::cout << "churn:       " << options.churn << " connections, "
+                  << (seconds > 0 ? churn.handshakes / seconds : 0.0) << " handshakes/s, "
+                  << churn.errors << " errors, request p99 " << percentile(churn.latencies_us, 0.99) << " us\n";
+    }
+
+    if (options.hold > 0)
+    {
+        loadgen_stats hold;
+        for (auto& s : hold_stats)
+            hold.merge(s);
+        std::cout << "hold:        " << options.hold << " connections, " << hold.held << " still open at the end, "
+                  << hold.handshakes << " handshakes, " << hold.errors << " errors\n";
+    }
+
+    return total.latencies_us.empty() ? EXIT_FAILURE : EXIT_SUCCESS;
+}
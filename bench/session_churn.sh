@@ -0,0 +1,46 @@
+#!/bin/sh
+# Measures the session pool under connection churn: its hit rates, and whether the
+# server's resident memory settles or keeps growing while clients reconnect.
+#
+# Usage: bench/session_churn.sh [churn connections] [duration] [server threads] [pool capacity]
+#
+# CHURN clients reconnect with a full TLS handshake for every request. The server's
+# VmRSS is sampled every second; a pooled server should plateau after the first
+# seconds. Run with a pool capacity of 0 to compare against no pooling.
+
+set -e
+
+CHURN=${1:-256}
+DURATION=${2:-30}
+THREADS=${3:-2}
+CAPACITY=${4:-256}
+PORT=${PORT:-8443}
+
+make -j"$(nproc)"
+make -j"$(nproc)" bench
+
+./bin/main 127.0.0.1 "$PORT" www "$THREADS" --session-pool "$CAPACITY" > /dev/null 2>&1 &
+server=$!
+sleep 1
+
+./bin/loadgen 127.0.0.1 "$PORT" --target /query_status/0 --connections 1 \
+    --duration "$DURATION" --threads 2 --churn "$CHURN" &
+load=$!
+
+echo "second rss_kib"
+second=0
+while kill -0 "$load" 2> /dev/null; do
+    echo "$second $(awk '/^VmRSS/ { print $2 }' "/proc/$server/status")"
+    second=$((second + 1))
+    sleep 1
+done
+wait "$load"
+
+curl -sk "https://127.0.0.1:$PORT/performance_statistics" | python3 -c '
+import json, sys
+for s in json.load(sys.stdin):
+    if s["metric_name"].startswith("session_pool_"):
+        print(s["metric_name"], round(s["total_value"], 1))'
+
+kill -INT "$server"
+wait "$server" 2> /dev/null || true
@@ -0,0 +1,86 @@
+#!/bin/sh
+# Checks that completion callbacks reach a local HTTPS receiver with a self-signed certificate.
+#
+# Usage: bench/webhook_stub.sh [timeout seconds]
+#
+# Generates a self-signed certificate for localhost, starts a stub receiver on
+# STUB_PORT (default 9443) that records every POST body, and starts bin/main
+# trusting that certificate through --webhook-ca-file. One query with a
+# callback_url is submitted; the check passes once the stub has received its
+# result. The query need not succeed: a query that fails because no Ollama
+# server is running is delivered all the same. A second run without the CA file
+# must fail the handshake with the receiver, whose certificate is then untrusted.
+
+set -e
+
+TIMEOUT=${1:-60}
+PORT=${PORT:-8443}
+STUB_PORT=${STUB_PORT:-9443}
+WORK=$(mktemp -d)
+trap 'kill $stub $server 2> /dev/null || true; rm -rf "$WORK"' EXIT
+
+make -j"$(nproc)"
+
+openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj "/CN=localhost" \
+    -addext "subjectAltName=DNS:localhost" \
+    -keyout "$WORK/stub.key" -out "$WORK/stub.pem" 2> /dev/null
+
+python3 - "$STUB_PORT" "$WORK" << 'EOF' &
+import http.server, ssl, sys
+
+port, work = int(sys.argv[1]), sys.argv[2]
+
+class Receiver(http.server.BaseHTTPRequestHandler):
+    def do_POST(self):
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        with open(work + "/received", "ab") as f:
+            f.write(body + b"\n")
+        self.send_response(204)
+        self.end_headers()
+
+    def log_message(self, *args):
+        pass
+
+server = http.server.HTTPServer(("127.0.0.1", port), Receiver)
+context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+context.load_cert_chain(work + "/stub.pem", work + "/stub.key")
+server.socket = context.wrap_socket(server.socket, server_side=True)
+server.serve_forever()
+EOF
+stub=$!
+
+# Submits one query with a callback and waits until the stub received it or the
+# TLS handshake with the stub failed; 0 if it was received.
+deliver() {
+    rm -f "$WORK/received"
+    ./bin/main 127.0.0.1 "$PORT" www 1 "$@" > "$WORK/server.log" 2>&1 &
+    server=$!
+    sleep 1
+
+    curl -sk "https://127.0.0.1:$PORT/" \
+        -d "{\"message\": \"ping\", \"callback_url\": \"https://localhost:$STUB_PORT/hook\"}" > /dev/null
+
+    waited=0
+    while [ ! -s "$WORK/received" ] && [ "$waited" -lt "$TIMEOUT" ] &&
+          ! grep -q "failed (handshake)" "$WORK/server.log"; do
+        sleep 1
+        waited=$((waited + 1))
+    done
+
+    kill -INT "$server"
+    wait "$server" 2> /dev/null || true
+    [ -s "$WORK/received" ]
+}
+
+if deliver --webhook-ca-file "$WORK/stub.pem"; then
+    echo "trusted receiver: delivered $(head -c 200 "$WORK/received")"
+else
+    echo "trusted receiver: no delivery within $TIMEOUT s"
+    exit 1
+fi
+
+if deliver; then
+    echo "untrusted receiver: delivered although its certificate is not trusted"
+    exit 1
+fi
+echo "untrusted receiver: rejected"
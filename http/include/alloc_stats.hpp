@@ -0,0 +1,63 @@
+#ifndef ALLOC_STATS_HPP
+#define ALLOC_STATS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include "../../ollama/include/json.hpp"
+
+/**
+ * @brief Heap allocations of this process per request served.
+ *
+ * Allocations are only counted in a build with `make ALLOC_STATS=1`, which replaces
+ * the global operator new with a counting one; requests are always counted. The
+ * handler memory of sessions reports how many of its allocations were recycled. All are
+ * process-wide, so background work is included: compare the counters before and
+ * after a load run rather than reading the average of an idle server.
+ */
+class allocation_stats
+{
+public:
+    /**
+     * @brief Counts one request read by a session.
+     */
+    void count_request()
+    {
+        requests_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Counts an allocation of session handler memory; only in a counting build.
+     *
+     * @param recycled Whether a cached block was reused instead of calling operator new.
+     */
+    void count_handler_allocation(bool recycled)
+    {
+#ifdef COUNT_ALLOCATIONS
+        (recycled ? handler_recycled_ : handler_new_).fetch_add(1, std::memory_order_relaxed);
+#else
+        (void)recycled;
+#endif
+    }
+
+    /**
+     * @brief The counters as entries shaped like the performance statistics.
+     */
+    nlohmann::json to_json() const;
+
+private:
+    std::atomic<uint64_t> requests_{0};
+    std::atomic<uint64_t> handler_recycled_{0};
+    std::atomic<uint64_t> handler_new_{0};
+};
+
+/**
+ * @brief The allocation counters of this process.
+ */
+allocation_stats& heap_allocation_stats();
+
+/**
+ * @brief Calls of the global operator new so far; 0 unless built with ALLOC_STATS=1.
+ */
+uint64_t heap_allocations();
+
+#endif // ALLOC_STATS_HPP
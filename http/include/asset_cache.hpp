@@ -0,0 +1,149 @@
+#ifndef ASSET_CACHE_HPP
+#define ASSET_CACHE_HPP
+
+#include "beast.hpp"
+#include <boost/optional.hpp>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include "../../log/include/log.hpp"
+
+/**
+ * @brief A static file held in memory with its precompressed variants and validators.
+ */
+struct asset {
+    std::string identity;  ///< The file contents.
+    std::string gzip;  ///< gzip variant; empty if it would not be smaller.
+    std::string brotli;  ///< Brotli variant; empty if it would not be smaller.
+    std::string etag;  ///< Strong ETag of the identity variant, quoted; variants append "-gz"/"-br".
+    std::string last_modified;  ///< mtime as an IMF-fixdate.
+    std::string content_type;  ///< MIME type derived from the extension.
+};
+
+/**
+ * @brief Body serving a slice of a cached asset without copying it.
+ *
+ * The body holds a reference on the asset, so the bytes stay valid while the
+ * response is written even if the cache drops the entry in the meantime.
+ */
+struct asset_body
+{
+    struct value_type
+    {
+        std::shared_ptr<const asset> owner;
+        beast::string_view data;
+    };
+
+    static std::uint64_t size(value_type const& body)
+    {
+        return body.data.size();
+    }
+
+    class writer
+    {
+        value_type const& body_;
+
+    public:
+        using const_buffers_type = net::const_buffer;
+
+        template <bool isRequest, class Fields>
+        writer(http::header<isRequest, Fields> const&, value_type const& body)
+            : body_(body)
+        {
+        }
+
+        void init(beast::error_code& ec)
+        {
+            ec = {};
+        }
+
+        boost::optional<std::pair<const_buffers_type, bool>> get(beast::error_code& ec)
+        {
+            ec = {};
+            return {{const_buffers_type(body_.data.data(), body_.data.size()), false}};
+        }
+    };
+};
+
+/**
+ * @brief In-memory cache of the files below the document root.
+ *
+ * Every file up to max_file_bytes is loaded at startup together with gzip and
+ * Brotli variants, a strong ETag and its Last-Modified date, so serving it takes
+ * no file system calls. An inotify watch on every directory drops entries whose
+ * files change. A request for a file that is not cached is served from disk while
+ * the file is reloaded on the blocking pool, compressed at a faster level than at
+ * startup; once the cached variants take max_total_bytes, the least recently used
+ * assets make room for it. Files that are larger, missing or not regular files are
+ * remembered as not cacheable until the watcher sees them change, so requests for
+ * them do not go back to the blocking pool.
+ */
+class asset_cache
+{
+public:
+    /**
+     * @brief Loads the document root and starts the inotify watcher.
+     *
+     * @param doc_root The document root directory.
+     * @param max_file_bytes Files larger than this are served from disk.
+     * @param max_total_bytes Memory for the cached variants; startup loading stops there, later loads evict.
+     */
+    explicit asset_cache(std::string doc_root, std::size_t max_file_bytes = 4 * 1024 * 1024,
+                         std::size_t max_total_bytes = 64 * 1024 * 1024);
+
+    /**
+     * @brief Returns the cached asset for a file path; starts loading it on the blocking pool if needed.
+     *
+     * @param path Path of the file, as built from the document root and request target.
+     * @return The asset, or nullptr if it is not cached (yet); the caller then serves the file from disk.
+     */
+    std::shared_ptr<const asset> find(const std::string& path);
+
+private:
+    std::string doc_root_;
+    std::size_t max_file_bytes_;
+    std::size_t max_total_bytes_;
+    std::shared_mutex mutex_;
+    struct cached_asset {
+        std::shared_ptr<const asset> entry;
+        mutable std::atomic<int64_t> last_used{0};  ///< Seconds on the steady clock, updated at most once a second.
+    };
+
+    static constexpr std::size_t max_uncacheable = 10000;  ///< Not-cacheable markers kept before they are all dropped.
+
+    std::unordered_map<std::string, cached_asset> assets_;
+    std::unordered_set<std::string> loading_;  ///< Paths being loaded on the blocking pool, guarded by mutex_.
+    std::unordered_set<std::string> uncacheable_;  ///< Paths a load found not cacheable, guarded by mutex_.
+    std::size_t total_bytes_ = 0;  ///< Size of all cached variants, guarded by mutex_.
+    int inotify_fd_ = -1;
+    std::unordered_map<int, std::string> watches_;  ///< inotify watch descriptor to directory, guarded by mutex_.
+    std::atomic<uint64_t> invalidations_{0};  ///< Bumped on every change, so loads racing a change are not kept.
+    std::shared_ptr<Logger> logger_;
+
+    std::string key_of(const std::string& path) const;
+    std::shared_ptr<const asset> load(const std::string& path, bool startup) const;
+    void load_async(const std::string& key);
+    bool store(const std::string& key, std::shared_ptr<const asset> entry, bool evict);
+    void erase(const std::string& key);
+    void forget_uncacheable(const std::string& path, bool directory);
+    void load_directory(const std::string& directory);
+    void watch_directory(const std::string& directory);
+    void run_watcher();
+};
+
+/**
+ * @brief Formats a time as an IMF-fixdate, as used by Last-Modified.
+ */
+std::string http_date(std::time_t time);
+
+/**
+ * @brief The process-wide asset cache for a document root, created on first use.
+ */
+asset_cache& shared_asset_cache(beast::string_view doc_root);
+
+#endif // ASSET_CACHE_HPP
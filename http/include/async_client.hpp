@@ -0,0 +1,145 @@
+#ifndef ASYNC_CLIENT_HPP
+#define ASYNC_CLIENT_HPP
+
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/beast/version.hpp>
+#include <boost/asio/ssl.hpp>
+#include <boost/asio/strand.hpp>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "../../log/include/log.hpp"
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+namespace ssl = net::ssl;
+using tcp = net::ip::tcp;
+
+/**
+ * @brief Host, port and target of an https:// URL.
+ */
+struct url_parts {
+    std::string host;
+    std::string port;
+    std::string target;
+};
+
+/**
+ * @brief Splits an https:// URL into host, port and target.
+ *
+ * @param url The URL to parse.
+ * @param parts Receives the components; the port defaults to 443 and the target to "/".
+ * @return False if the URL is not a well-formed https:// URL.
+ */
+bool parse_url(const std::string& url, url_parts& parts);
+
+/**
+ * @brief Tunables for the AsyncClient.
+ */
+struct AsyncClientOptions {
+    std::size_t max_connections = 8;  ///< Hosts that may have a delivery in flight at the same time.
+    std::size_t max_pending = 10000;  ///< Deliveries queued across all hosts before new ones are rejected.
+    std::size_t max_hosts = 1024;  ///< Hosts tracked at once, idle pooled connections included.
+    int max_retries = 3;  ///< Attempts after the first one before a delivery is dropped.
+    std::chrono::milliseconds retry_backoff{500};  ///< Delay before the first retry, doubled on each attempt.
+    std::chrono::seconds timeout{30};  ///< Timeout for each connect, handshake, write and read.
+    std::chrono::seconds idle_timeout{30};  ///< How long an idle pooled connection is kept open.
+    std::string ca_file;  ///< PEM file of CAs trusted next to the system's, e.g. for a self-signed test receiver.
+};
+
+/**
+ * @brief Asynchronous, connection-pooled HTTPS POST client.
+ *
+ * Unlike Client, which opens a new TLS connection per synchronous request, this
+ * client keeps one keep-alive connection per host:port. Deliveries to the same
+ * host are queued and sent back-to-back over that connection. Failed deliveries
+ * are retried with exponential backoff on a fresh connection. The number of hosts
+ * with a delivery in flight, the number of hosts tracked and the number of queued
+ * deliveries are bounded; a host is forgotten once it has nothing queued and its
+ * connection is closed.
+ * All state lives on a strand, so post() may be called from any thread.
+ * Servers are verified against the system's trusted CAs, plus those of ca_file, and
+ * the requested host name.
+ */
+class AsyncClient : public std::enable_shared_from_this<AsyncClient> {
+public:
+    /// Invoked once a delivery succeeded (2xx status) or was given up on.
+    using completion_handler = std::function<void(beast::error_code ec, unsigned status)>;
+
+    /**
+     * @brief Constructs an AsyncClient.
+     *
+     * @param io_context The I/O context running the deliveries.
+     * @param options Connection and retry limits.
+     * @throws boost::system::system_error if options.ca_file cannot be loaded.
+     */
+    AsyncClient(net::io_context& io_context, AsyncClientOptions options = AsyncClientOptions());
+
+    /**
+     * @brief Queues an HTTPS POST request.
+     *
+     * @param host The host to connect to.
+     * @param port The port to connect to.
+     * @param target The target resource to post to.
+     * @param body The JSON body to send.
+     * @param on_complete Optional callback invoked on the client's strand when the delivery finishes.
+     */
+    void post(const std::string& host, const std::string& port, const std::string& target,
+              std::string body, completion_handler on_complete = nullptr);
+
+private:
+    struct delivery {
+        std::string target;
+        std::string body;
+        int attempts = 0;
+        completion_handler on_complete;
+    };
+
+    struct host_state {
+        std::string host;
+        std::string port;
+        std::deque<delivery> queue;
+        std::unique_ptr<ssl::stream<beast::tcp_stream>> stream;
+        tcp::resolver resolver;
+        net::steady_timer timer;
+        beast::flat_buffer buffer;
+        http::request<http::string_body> req;
+        http::response<http::string_body> res;
+        bool active = false;  ///< Holds one of the max_connections slots.
+        bool waiting = false;  ///< Queued for a free slot.
+
+        host_state(net::strand<net::io_context::executor_type> const& strand)
+            : resolver(strand), timer(strand) {}
+    };
+
+    using host_ptr = std::shared_ptr<host_state>;
+
+    net::strand<net::io_context::executor_type> strand_;
+    ssl::context ssl_ctx_;  ///< Client context verifying the servers delivered to.
+    AsyncClientOptions options_;
+    std::unordered_map<std::string, host_ptr> hosts_;
+    std::deque<host_ptr> waiting_hosts_;  ///< Hosts with pending deliveries waiting for a slot.
+    std::size_t active_ = 0;
+    std::size_t pending_ = 0;
+    std::shared_ptr<Logger> logger_;
+
+    void enqueue(const std::string& host, const std::string& port, delivery item);
+    bool make_room();
+    void forget(const host_ptr& h);
+    void schedule(const host_ptr& h);
+    void release(const host_ptr& h);
+    void connect(const host_ptr& h);
+    void send_next(const host_ptr& h);
+    void on_response(const host_ptr& h, beast::error_code ec);
+    void fail(const host_ptr& h, beast::error_code ec, const std::string& what);
+    void finish(const host_ptr& h, beast::error_code ec, unsigned status);
+    void close(const host_ptr& h);
+};
+
+#endif // ASYNC_CLIENT_HPP
@@ -0,0 +1,47 @@
+#ifndef ASYNC_HANDLER_HPP
+#define ASYNC_HANDLER_HPP
+
+#include "beast.hpp"
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <functional>
+#include <utility>
+
+/**
+ * @file async_handler.hpp
+ * @brief Contract for request handlers that complete asynchronously.
+ *
+ * A handler receives a response_callback instead of returning its response. Work
+ * that blocks (SQLite, file parsing, backend calls) runs on the shared blocking
+ * pool, and the response is handed back on the session's executor. The io thread
+ * therefore keeps serving other connections while a slow endpoint is in progress.
+ */
+
+/// Invoked on the session's executor with the response of an asynchronous handler.
+using response_callback = std::function<void(http::message_generator)>;
+
+/**
+ * @brief Shared thread pool for handler work that would otherwise block an io thread.
+ *
+ * Sized to the number of hardware threads (at least two) and created on first use.
+ */
+net::thread_pool& blocking_pool();
+
+/**
+ * @brief Runs `work` on the blocking pool and delivers its response on `ex`.
+ *
+ * @param ex The executor of the session the response belongs to.
+ * @param work Callable returning an http::message_generator; may block.
+ * @param done Callback receiving the response on `ex`.
+ */
+template <class Executor, class Work>
+void respond_async(Executor ex, Work&& work, response_callback done)
+{
+    net::post(blocking_pool(), [ex, work = std::forward<Work>(work), done = std::move(done)]() mutable {
+        net::post(ex, [msg = work(), done = std::move(done)]() mutable {
+            done(std::move(msg));
+        });
+    });
+}
+
+#endif // ASYNC_HANDLER_HPP
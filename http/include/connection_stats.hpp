@@ -0,0 +1,67 @@
+#ifndef CONNECTION_STATS_HPP
+#define CONNECTION_STATS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include "../../ollama/include/json.hpp"
+
+/**
+ * @brief Transport a connection was detected to use.
+ */
+enum class connection_protocol {
+    plain,  ///< Plaintext HTTP from a trusted caller.
+    tls,  ///< HTTPS.
+    local,  ///< Plaintext HTTP over the Unix domain socket.
+    h2  ///< HTTP/2 over TLS; counted as tls until ALPN hands the connection over.
+};
+
+/**
+ * @brief Accepted and currently open connections of this process, per protocol.
+ */
+class connection_stats
+{
+public:
+    /**
+     * @brief Counts a new connection; called when its session is created.
+     */
+    void opened(connection_protocol protocol);
+
+    /**
+     * @brief Counts a connection as closed; called when its session is destroyed.
+     */
+    void closed(connection_protocol protocol);
+
+    /**
+     * @brief The counters as entries shaped like the performance statistics.
+     */
+    nlohmann::json to_json() const;
+
+private:
+    struct counters
+    {
+        std::atomic<uint64_t> accepted{0};
+        std::atomic<int64_t> active{0};
+    };
+
+    counters plain_;
+    counters tls_;
+    counters local_;
+    counters h2_;
+
+    counters& of(connection_protocol protocol)
+    {
+        switch (protocol) {
+        case connection_protocol::tls: return tls_;
+        case connection_protocol::local: return local_;
+        case connection_protocol::h2: return h2_;
+        default: return plain_;
+        }
+    }
+};
+
+/**
+ * @brief The connection counters of this process.
+ */
+connection_stats& session_connection_stats();
+
+#endif // CONNECTION_STATS_HPP
@@ -0,0 +1,204 @@
+#ifndef FILE_RANGE_BODY_HPP
+#define FILE_RANGE_BODY_HPP
+
+#include "beast.hpp"
+#include <boost/optional.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Body sending a whole file or one or more byte ranges of it.
+ *
+ * Like http::file_body it streams straight from the file through a fixed buffer,
+ * seeking to each range in turn. With several ranges, every range is preceded by
+ * its multipart/byteranges part header and the body ends with the closing boundary.
+ * The buffer holds one full TLS record, so each chunk read is encrypted by a single
+ * SSL_write instead of the four that http::file_body's 4 KiB chunks take.
+ */
+struct file_range_body
+{
+    /**
+     * @brief One range of the file plus the part header sent before it.
+     */
+    struct part
+    {
+        std::string header;  ///< Multipart part header; empty for a single-range response.
+        std::uint64_t offset = 0;
+        std::uint64_t length = 0;
+    };
+
+    class writer;
+
+    class value_type
+    {
+        friend class writer;
+        friend struct file_range_body;
+
+        beast::file file_;
+        std::vector<part> parts_;
+        std::string trailer_;  ///< Closing boundary of a multipart body.
+        std::uint64_t size_ = 0;
+
+    public:
+        /**
+         * @brief Opens the file; use file_mode::scan when it is read front to back.
+         */
+        void open(char const* path, beast::error_code& ec, beast::file_mode mode = beast::file_mode::read)
+        {
+            file_.open(path, mode, ec);
+        }
+
+        /**
+         * @brief Size of the whole file.
+         */
+        std::uint64_t file_size(beast::error_code& ec) const
+        {
+            return file_.size(ec);
+        }
+
+        /**
+         * @brief The underlying file, e.g. to stat it.
+         */
+        beast::file& file()
+        {
+            return file_;
+        }
+
+        /**
+         * @brief Sends the whole file, for a Range request that is ignored.
+         */
+        void set_whole(std::uint64_t file_size)
+        {
+            parts_.clear();
+            if (file_size > 0)
+                parts_.push_back(part{std::string(), 0, file_size});
+            trailer_.clear();
+            size_ = file_size;
+        }
+
+        /**
+         * @brief Sends a single range; the caller sets Content-Range.
+         */
+        void set_range(std::uint64_t first, std::uint64_t last)
+        {
+            parts_ = {part{std::string(), first, last - first + 1}};
+            trailer_.clear();
+            size_ = last - first + 1;
+        }
+
+        /**
+         * @brief Sends several ranges as multipart/byteranges with the given boundary.
+         *
+         * @param ranges Inclusive [first, last] byte ranges.
+         * @param file_size Size of the whole file, for each part's Content-Range.
+         * @param content_type Content type of the file, repeated in each part.
+         * @param boundary Multipart boundary; the response Content-Type must name it.
+         */
+        void set_ranges(const std::vector<std::pair<std::uint64_t, std::uint64_t>>& ranges, std::uint64_t file_size,
+                        beast::string_view content_type, const std::string& boundary)
+        {
+            parts_.clear();
+            size_ = 0;
+            for (const auto& range : ranges)
+            {
+                part p;
+                p.header = (parts_.empty() ? "--" : "\r\n--") + boundary +
+                           "\r\nContent-Type: " + std::string(content_type) +
+                           "\r\nContent-Range: bytes " + std::to_string(range.first) + "-" +
+                           std::to_string(range.second) + "/" + std::to_string(file_size) + "\r\n\r\n";
+                p.offset = range.first;
+                p.length = range.second - range.first + 1;
+                size_ += p.header.size() + p.length;
+                parts_.push_back(std::move(p));
+            }
+            trailer_ = "\r\n--" + boundary + "--\r\n";
+            size_ += trailer_.size();
+        }
+    };
+
+    static std::uint64_t size(value_type const& body)
+    {
+        return body.size_;
+    }
+
+    class writer
+    {
+        value_type& body_;
+        std::size_t part_ = 0;
+        bool started_ = false;  ///< The current part's header was sent and the file positioned.
+        bool trailer_sent_ = false;
+        std::uint64_t remain_ = 0;
+        char buf_[16 * 1024];  ///< Largest TLS record payload.
+
+    public:
+        using const_buffers_type = net::const_buffer;
+
+        template <bool isRequest, class Fields>
+        writer(http::header<isRequest, Fields>&, value_type& body)
+            : body_(body)
+        {
+        }
+
+        void init(beast::error_code& ec)
+        {
+            ec = {};
+        }
+
+        boost::optional<std::pair<const_buffers_type, bool>> get(beast::error_code& ec)
+        {
+            ec = {};
+            while (part_ < body_.parts_.size())
+            {
+                const part& p = body_.parts_[part_];
+                if (!started_)
+                {
+                    started_ = true;
+                    remain_ = p.length;
+                    body_.file_.seek(p.offset, ec);
+                    if (ec)
+                        return boost::none;
+                    if (!p.header.empty())
+                        return {{const_buffers_type(p.header.data(), p.header.size()), true}};
+                }
+
+                if (remain_ == 0)
+                {
+                    ++part_;
+                    started_ = false;
+                    continue;
+                }
+
+                auto amount = static_cast<std::size_t>(std::min<std::uint64_t>(remain_, sizeof(buf_)));
+                auto n = body_.file_.read(buf_, amount, ec);
+                if (ec)
+                    return boost::none;
+                if (n == 0)
+                {
+                    ec = http::error::short_read;
+                    return boost::none;
+                }
+
+                remain_ -= n;
+                if (remain_ == 0)
+                {
+                    ++part_;
+                    started_ = false;
+                }
+                bool more = part_ < body_.parts_.size() || !body_.trailer_.empty();
+                return {{const_buffers_type(buf_, n), more}};
+            }
+
+            if (!trailer_sent_ && !body_.trailer_.empty())
+            {
+                trailer_sent_ = true;
+                return {{const_buffers_type(body_.trailer_.data(), body_.trailer_.size()), false}};
+            }
+            return boost::none;
+        }
+    };
+};
+
+#endif // FILE_RANGE_BODY_HPP
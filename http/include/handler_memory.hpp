@@ -0,0 +1,147 @@
+#ifndef HANDLER_MEMORY_HPP
+#define HANDLER_MEMORY_HPP
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @brief Recycles the memory of a session's asynchronous operations.
+ *
+ * Every async_read, async_write and the composed operations inside them allocate
+ * their state through the completion handler's associated allocator. A session
+ * runs the same few operations over and over, so the blocks they free are kept
+ * and handed to the next operation of the same or a smaller size. Not thread safe:
+ * use it only from the session's executor.
+ */
+class handler_memory
+{
+public:
+    static constexpr std::size_t cached_blocks = 4;  ///< Blocks kept for reuse; a write nests two or three.
+
+    handler_memory() = default;
+    handler_memory(const handler_memory&) = delete;
+    handler_memory& operator=(const handler_memory&) = delete;
+    ~handler_memory();
+
+    /**
+     * @brief Returns a cached block of at least `size` bytes, or a new one.
+     */
+    void* allocate(std::size_t size);
+
+    /**
+     * @brief Keeps the block for reuse, or frees it if the cache is full.
+     */
+    void deallocate(void* pointer);
+
+    /**
+     * @brief Frees the cached blocks, e.g. while the session is idle.
+     */
+    void release();
+
+private:
+    struct block
+    {
+        void* data = nullptr;
+        std::size_t size = 0;
+    };
+
+    std::array<block, cached_blocks> free_{};
+};
+
+/**
+ * @brief Allocator handing out handler_memory, the associated allocator of recycling_handler.
+ */
+template <class T>
+class handler_allocator
+{
+public:
+    using value_type = T;
+
+    explicit handler_allocator(handler_memory& memory) noexcept
+        : memory_(&memory)
+    {
+    }
+
+    template <class U>
+    handler_allocator(const handler_allocator<U>& other) noexcept
+        : memory_(other.memory())
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(memory_->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* pointer, std::size_t) noexcept
+    {
+        memory_->deallocate(pointer);
+    }
+
+    handler_memory* memory() const noexcept
+    {
+        return memory_;
+    }
+
+    template <class U>
+    bool operator==(const handler_allocator<U>& other) const noexcept
+    {
+        return memory_ == other.memory();
+    }
+
+    template <class U>
+    bool operator!=(const handler_allocator<U>& other) const noexcept
+    {
+        return memory_ != other.memory();
+    }
+
+private:
+    handler_memory* memory_;
+};
+
+/**
+ * @brief Completion handler whose operations allocate from a handler_memory.
+ *
+ * Wraps handlers that have no associated executor of their own, i.e. the lambdas
+ * a session passes to operations on its stream.
+ */
+template <class Handler>
+class recycling_handler
+{
+public:
+    using allocator_type = handler_allocator<char>;
+
+    recycling_handler(handler_memory& memory, Handler handler)
+        : memory_(memory)
+        , handler_(std::move(handler))
+    {
+    }
+
+    allocator_type get_allocator() const noexcept
+    {
+        return allocator_type(memory_);
+    }
+
+    template <class... Args>
+    void operator()(Args&&... args)
+    {
+        handler_(std::forward<Args>(args)...);
+    }
+
+private:
+    handler_memory& memory_;
+    Handler handler_;
+};
+
+/**
+ * @brief Wraps a completion handler so its operation allocates from `memory`.
+ */
+template <class Handler>
+recycling_handler<typename std::decay<Handler>::type> make_recycling_handler(handler_memory& memory, Handler&& handler)
+{
+    return recycling_handler<typename std::decay<Handler>::type>(memory, std::forward<Handler>(handler));
+}
+
+#endif // HANDLER_MEMORY_HPP
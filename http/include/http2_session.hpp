@@ -0,0 +1,131 @@
+#ifndef HTTP2_SESSION_HPP
+#define HTTP2_SESSION_HPP
+
+// HTTP/2 is only built with `make HTTP2=1`, which defines WITH_HTTP2 and links libnghttp2.
+#ifdef WITH_HTTP2
+
+#include "../../app/include/application.hpp"
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/ssl.hpp>
+#include <boost/asio.hpp>
+#include <nghttp2/nghttp2.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+/// ALPN protocol identifier of HTTP/2 over TLS.
+constexpr char http2_alpn[] = "h2";
+
+/**
+ * @brief An HTTP/2 connection, for TLS clients that negotiated h2 through ALPN.
+ *
+ * nghttp2 does the framing, HPACK and per-stream and connection flow control; this
+ * class moves bytes between it and the TLS stream. Every stream becomes a request
+ * for the same handlers the HTTP/1.1 sessions use, so concurrent polls share one
+ * connection and their responses are interleaved as they complete.
+ */
+class http2_session : public std::enable_shared_from_this<http2_session>
+{
+public:
+    /**
+     * @brief Takes over a TLS stream whose handshake selected h2.
+     *
+     * @param stream The TLS stream, after the handshake.
+     * @param buffer Bytes already read from the connection past the handshake.
+     * @param doc_root The document root directory for serving files.
+     * @param app The application serving the API.
+     */
+    http2_session(
+        boost::beast::ssl_stream<boost::beast::tcp_stream>&& stream,
+        boost::beast::flat_buffer buffer,
+        std::shared_ptr<std::string const> const& doc_root,
+        std::shared_ptr<Application> app);
+
+    ~http2_session();
+
+    /**
+     * @brief Sends the server preface and starts reading frames.
+     */
+    void run();
+
+private:
+    class response_source;
+
+    /**
+     * @brief A request being received, handled or answered.
+     */
+    struct stream_state
+    {
+        boost::beast::http::request<boost::beast::http::string_body> req;
+        bool head = false;  // A HEAD request; its response has no body
+        bool dispatched = false;  // Handed to the request handlers
+        bool rejected = false;  // Reset for an oversized body; never dispatched
+        std::size_t body_limit = 0;  // Looked up from the route once the body starts
+        std::unique_ptr<response_source> response;  // Body of the submitted response
+    };
+
+    static constexpr uint32_t max_concurrent_streams = 100;
+    static constexpr uint32_t initial_window_size = 1024 * 1024;  // Per-stream receive window
+    static constexpr std::size_t max_write_batch = 64 * 1024;  // Frames coalesced into one write
+
+    boost::beast::ssl_stream<boost::beast::tcp_stream> stream_;
+    boost::beast::flat_buffer buffer_;  // Buffer for reading frames
+    std::shared_ptr<std::string const> doc_root_;
+    std::shared_ptr<Application> app_;
+    nghttp2_session* session_ = nullptr;
+    std::unordered_map<int32_t, stream_state> streams_;
+    std::string write_buffer_;  // Frames being written
+    bool writing_ = false;
+    bool receiving_ = false;  // Inside nghttp2_session_mem_recv, where sending is not allowed
+    bool closing_ = false;
+
+    void on_run();
+
+    /**
+     * @brief Feeds the bytes in buffer_ to nghttp2; false once the connection is unusable.
+     */
+    bool receive();
+
+    void do_read();
+    void on_read(boost::beast::error_code ec, std::size_t bytes_transferred);
+
+    /**
+     * @brief Writes the frames nghttp2 has queued, or closes once neither side has more to say.
+     */
+    void do_write();
+    void on_write(boost::beast::error_code ec, std::size_t bytes_transferred);
+
+    /**
+     * @brief Idle timeout while no stream is open, none while handlers are still working.
+     */
+    void arm_timer();
+
+    void do_close();
+    void on_shutdown(boost::beast::error_code ec);
+
+    /**
+     * @brief Hands a complete request to the request handlers.
+     */
+    void dispatch(int32_t stream_id, stream_state& state);
+
+    /**
+     * @brief Submits the response of a stream; dropped if the client reset the stream meanwhile.
+     */
+    void on_response(int32_t stream_id, boost::beast::http::message_generator&& msg);
+
+    static int on_begin_headers(nghttp2_session*, const nghttp2_frame* frame, void* user_data);
+    static int on_header(nghttp2_session*, const nghttp2_frame* frame, const uint8_t* name, std::size_t namelen,
+                         const uint8_t* value, std::size_t valuelen, uint8_t flags, void* user_data);
+    static int on_data_chunk(nghttp2_session*, uint8_t flags, int32_t stream_id, const uint8_t* data,
+                             std::size_t len, void* user_data);
+    static int on_frame_recv(nghttp2_session*, const nghttp2_frame* frame, void* user_data);
+    static int on_stream_close(nghttp2_session*, int32_t stream_id, uint32_t error_code, void* user_data);
+    static ssize_t read_body(nghttp2_session*, int32_t stream_id, uint8_t* buf, std::size_t length,
+                             uint32_t* data_flags, nghttp2_data_source* source, void* user_data);
+};
+
+#endif // WITH_HTTP2
+
+#endif // HTTP2_SESSION_HPP
@@ -3,6 +3,7 @@
 
 #include "../../app/include/application.hpp"
 #include "beast.hpp"
+#include "async_handler.hpp"
 #include <boost/config.hpp>
 #include <boost/asio/dispatch.hpp>
 #include <boost/asio/strand.hpp>
@@ -44,5 +45,57 @@ boost::beast::http::message_generator handle_request(
     boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>>&& req,
     std::shared_ptr<Application> app);
 
+/**
+ * @brief Handle an HTTP request and deliver the response asynchronously.
+ *
+ * Endpoints that block (SQLite statistics, JSON file parsing) run on the blocking pool,
+ * all others are answered inline through handle_request(). Either way the response is
+ * passed to `done` on `ex`, the executor of the requesting session.
+ *
+ * @param doc_root The document root directory.
+ * @param req The HTTP request object.
+ * @param app A shared pointer to the Application.
+ * @param ex The executor of the session that received the request.
+ * @param done Callback receiving the response.
+ */
+template <class Body, class Allocator>
+void async_handle_request(
+    beast::string_view doc_root,
+    boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>>&& req,
+    std::shared_ptr<Application> app,
+    net::any_io_executor ex,
+    response_callback done);
+
+/**
+ * @brief Sets the request body limit of routes that do not set their own.
+ *
+ * @param bytes Largest request body accepted; 8 MiB unless set.
+ */
+void set_default_body_limit(std::size_t bytes);
+
+/**
+ * @brief The largest request body accepted for a method and target.
+ *
+ * Sessions call this once the header has arrived, to reject an oversized body
+ * before reading it.
+ *
+ * @param method The request method.
+ * @param target The request target.
+ * @return The route's own limit, or the default one.
+ */
+std::size_t request_body_limit(boost::beast::http::verb method, beast::string_view target);
+
+/**
+ * @brief The 413 response to a request whose body exceeds its limit.
+ *
+ * @param req The request; only its header is used.
+ * @param limit The limit that was exceeded.
+ * @return The HTTP response as a message generator.
+ */
+template <class Body, class Allocator>
+boost::beast::http::message_generator payload_too_large(
+    boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>> const& req,
+    std::size_t limit);
+
 #endif // HTTP_TOOLS_HPP
 
@@ -0,0 +1,83 @@
+#ifndef LOCAL_SERVER_HPP
+#define LOCAL_SERVER_HPP
+
+#include "../../app/include/application.hpp"
+#include "../../log/include/log.hpp"
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <sys/types.h>
+#include <memory>
+#include <string>
+
+/**
+ * @file local_server.hpp
+ * @brief Plain HTTP listener on a Unix domain socket for clients on the same host.
+ *
+ * Reverse proxies and batch jobs running next to the server connect through the
+ * socket file instead of TCP and TLS. Access is controlled by the file's owner,
+ * group and mode: connecting requires write permission on the socket.
+ */
+
+/**
+ * @brief Location and permissions of the Unix domain socket.
+ */
+struct local_listener_options
+{
+    std::string path;  ///< Path of the socket file; empty disables the listener.
+    mode_t mode = 0660;  ///< Permissions of the socket file.
+    std::string group;  ///< Group owning the socket file, e.g. the proxy's group; empty keeps the default.
+};
+
+/**
+ * @brief Creates, binds and listens on the socket file with the requested permissions.
+ *
+ * A stale socket left by a previous run is removed; any other file at the path is
+ * left alone and reported as an error. The socket is created with no permissions
+ * for others, then chgrp'ed and chmod'ed, so it is never reachable by more users
+ * than configured.
+ *
+ * @param options Path and permissions.
+ * @param logger Logger for errors.
+ * @return The listening descriptor, or -1 on error.
+ */
+int open_local_listener(const local_listener_options& options, std::shared_ptr<Logger> logger);
+
+/**
+ * @class local_server
+ * @brief Accepts connections on a Unix domain socket and serves them as plain HTTP.
+ *
+ * Requests go through the same routing as the TCP server, only without TLS.
+ */
+class local_server : public std::enable_shared_from_this<local_server>
+{
+    boost::asio::io_context& ioc_;
+    boost::asio::local::stream_protocol::acceptor acceptor_;
+    std::shared_ptr<std::string const> doc_root_;
+    std::shared_ptr<Application> app_;
+    std::shared_ptr<Logger> logger_;
+public:
+    /**
+     * @brief Adopts a listening socket created by open_local_listener.
+     *
+     * @param ioc The io_context serving the connections.
+     * @param listener The listening descriptor; owned by the server from now on.
+     * @param doc_root The document root directory for serving files.
+     * @param app The application serving the API.
+     */
+    local_server(
+        boost::asio::io_context& ioc,
+        int listener,
+        std::shared_ptr<std::string const> const& doc_root,
+        std::shared_ptr<Application> app);
+
+    /**
+     * @brief Starts accepting connections.
+     */
+    void run();
+
+private:
+    void do_accept();
+    void on_accept(boost::beast::error_code ec, boost::asio::local::stream_protocol::socket socket);
+};
+
+#endif // LOCAL_SERVER_HPP
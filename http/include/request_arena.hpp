@@ -0,0 +1,111 @@
+#ifndef REQUEST_ARENA_HPP
+#define REQUEST_ARENA_HPP
+
+#include "beast.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Monotonic memory for the header fields and body of one request.
+ *
+ * Allocation bumps a pointer through a list of blocks and deallocation does nothing;
+ * reset() rewinds to the first block and keeps up to retained_bytes of blocks, so a
+ * keep-alive connection serving requests of similar size stops touching the heap
+ * after its first few requests.
+ */
+class request_arena
+{
+public:
+    static constexpr std::size_t block_size = 16 * 1024;  ///< Size of a regular block; holds a typical request.
+    static constexpr std::size_t retained_bytes = 256 * 1024;  ///< Blocks kept across resets; larger bodies are freed.
+
+    /**
+     * @brief Returns `bytes` of memory aligned to `alignment`.
+     */
+    void* allocate(std::size_t bytes, std::size_t alignment);
+
+    /**
+     * @brief Makes all memory available again; nothing allocated before may be in use.
+     *
+     * @param retain Bytes of blocks to keep; the rest is freed.
+     */
+    void reset(std::size_t retain = retained_bytes);
+
+private:
+    struct block
+    {
+        std::unique_ptr<unsigned char[]> data;
+        std::size_t size = 0;
+    };
+
+    std::vector<block> blocks_;
+    std::size_t current_ = 0;  ///< Block being allocated from.
+    std::size_t used_ = 0;  ///< Bytes used in the current block.
+};
+
+/**
+ * @brief Allocator drawing from a request_arena.
+ *
+ * Every copy holds a reference on the arena, so the request that owns them keeps
+ * the arena alive wherever it is moved, e.g. onto the blocking pool. The session
+ * recycles an arena once it holds the only reference left.
+ */
+template <class T>
+class arena_allocator
+{
+public:
+    using value_type = T;
+
+    explicit arena_allocator(std::shared_ptr<request_arena> arena) noexcept
+        : arena_(std::move(arena))
+    {
+    }
+
+    template <class U>
+    arena_allocator(const arena_allocator<U>& other) noexcept
+        : arena_(other.arena())
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, std::size_t) noexcept
+    {
+    }
+
+    const std::shared_ptr<request_arena>& arena() const noexcept
+    {
+        return arena_;
+    }
+
+    template <class U>
+    bool operator==(const arena_allocator<U>& other) const noexcept
+    {
+        return arena_ == other.arena();
+    }
+
+    template <class U>
+    bool operator!=(const arena_allocator<U>& other) const noexcept
+    {
+        return arena_ != other.arena();
+    }
+
+private:
+    std::shared_ptr<request_arena> arena_;
+};
+
+/// Body of requests read into a session's arena.
+using arena_string_body = http::basic_string_body<char, std::char_traits<char>, arena_allocator<char>>;
+
+/// Header fields of requests read into a session's arena.
+using arena_fields = http::basic_fields<arena_allocator<char>>;
+
+/// A request whose fields and body live in a request_arena.
+using arena_request = http::request<arena_string_body, arena_fields>;
+
+#endif // REQUEST_ARENA_HPP
@@ -0,0 +1,248 @@
+#ifndef ROUTER_HPP
+#define ROUTER_HPP
+
+#include "beast.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @file router.hpp
+ * @brief Segment trie mapping request paths to handlers.
+ *
+ * Routes are patterns such as "/batch_status/{batch_id}": literal segments must match
+ * exactly, "{name}" segments match any non-empty segment and are captured as
+ * string_views into the request target. Lookup walks one trie node per path segment,
+ * so its cost grows with the length of the path, not with the number of routes.
+ */
+
+/**
+ * @brief Path parameters captured while matching a route.
+ *
+ * Values are views into the request target and stay valid as long as the request does.
+ */
+class route_params
+{
+public:
+    static constexpr std::size_t capacity = 8;
+
+    /**
+     * @brief Returns the value of a parameter, or an empty view if the route has none by that name.
+     */
+    beast::string_view operator[](beast::string_view name) const
+    {
+        for (std::size_t i = 0; i < size_; ++i)
+            if (items_[i].first == name)
+                return items_[i].second;
+        return {};
+    }
+
+    std::size_t size() const { return size_; }
+
+    bool push(beast::string_view name, beast::string_view value)
+    {
+        if (size_ == capacity)
+            return false;
+        items_[size_++] = {name, value};
+        return true;
+    }
+
+    void pop() { --size_; }
+
+private:
+    std::array<std::pair<beast::string_view, beast::string_view>, capacity> items_;
+    std::size_t size_ = 0;
+};
+
+/**
+ * @brief Router over requests of type Request, passing a per-request Context to handlers.
+ *
+ * Each route has a set of methods, a handler, optional middleware, a flag telling
+ * the server to run it off the io threads and an optional request body limit, which
+ * sessions check as soon as the header has arrived. Middleware wraps the handler when the
+ * route is added, so a request pays only for the middleware of its own route.
+ */
+template <class Request, class Context>
+class router
+{
+public:
+    using handler = std::function<http::message_generator(Request&&, const route_params&, Context&)>;
+
+    /// Runs before a handler; calls `next` to continue or returns its own response.
+    using middleware = std::function<http::message_generator(Request&&, const route_params&, Context&, const handler& next)>;
+
+    /**
+     * @brief A registered route.
+     */
+    struct route
+    {
+        std::string pattern;  ///< Pattern the route was registered with, e.g. "/query_status/{query_id}".
+        uint64_t methods = 0;  ///< Bit set of allowed http::verb values.
+        handler fn;  ///< Handler with its middleware applied.
+        bool blocking = false;  ///< The handler may block and should run on the blocking pool.
+        std::size_t body_limit = 0;  ///< Largest request body accepted; 0 for the server default.
+
+        bool allows(http::verb method) const { return (methods & method_bit(method)) != 0; }
+    };
+
+    /**
+     * @brief Result of a successful lookup.
+     */
+    struct match
+    {
+        const route* matched = nullptr;
+        route_params params;
+    };
+
+    /**
+     * @brief Registers a route.
+     *
+     * @param methods Methods the route answers.
+     * @param pattern Path pattern; "{name}" segments capture parameters.
+     * @param fn The handler.
+     * @param chain Middleware, outermost first.
+     * @param blocking Whether the handler may block.
+     * @param body_limit Largest request body accepted; 0 for the server default.
+     */
+    void add(std::initializer_list<http::verb> methods, const std::string& pattern, handler fn,
+             std::vector<middleware> chain = {}, bool blocking = false, std::size_t body_limit = 0)
+    {
+        node* current = &root_;
+        for_each_segment(pattern, [&](beast::string_view segment) {
+            if (segment.size() > 2 && segment.front() == '{' && segment.back() == '}')
+            {
+                if (!current->param)
+                {
+                    current->param = std::make_unique<node>();
+                    current->param_name = std::string(segment.substr(1, segment.size() - 2));
+                }
+                current = current->param.get();
+                return;
+            }
+
+            auto it = std::lower_bound(current->literals.begin(), current->literals.end(), segment,
+                                       [](const auto& child, beast::string_view s) { return child.first < s; });
+            if (it == current->literals.end() || it->first != segment)
+                it = current->literals.emplace(it, std::string(segment), std::make_unique<node>());
+            current = it->second.get();
+        });
+
+        // Wrap the handler, innermost middleware last, so the first one runs first.
+        for (auto mw = chain.rbegin(); mw != chain.rend(); ++mw)
+        {
+            fn = [mw = *mw, next = std::move(fn)](Request&& req, const route_params& params, Context& ctx) {
+                return mw(std::move(req), params, ctx, next);
+            };
+        }
+
+        auto entry = std::make_unique<route>();
+        entry->pattern = pattern;
+        for (auto method : methods)
+            entry->methods |= method_bit(method);
+        entry->fn = std::move(fn);
+        entry->blocking = blocking;
+        entry->body_limit = body_limit;
+        current->routes.push_back(std::move(entry));
+    }
+
+    /**
+     * @brief Finds the route for a method and target; the query string is ignored.
+     *
+     * Literal segments take precedence over parameters. A path that exists but does
+     * not allow the method is reported as no match, so the caller's fallback applies.
+     *
+     * @return True if a route matched.
+     */
+    bool find(http::verb method, beast::string_view target, match& result) const
+    {
+        auto query = target.find('?');
+        if (query != beast::string_view::npos)
+            target = target.substr(0, query);
+
+        result.params = route_params();
+        result.matched = find(root_, method, target, result.params);
+        return result.matched != nullptr;
+    }
+
+private:
+    struct node
+    {
+        std::vector<std::pair<std::string, std::unique_ptr<node>>> literals;  ///< Sorted by segment.
+        std::unique_ptr<node> param;
+        std::string param_name;
+        std::vector<std::unique_ptr<route>> routes;
+    };
+
+    node root_;
+
+    static uint64_t method_bit(http::verb method)
+    {
+        return uint64_t(1) << (static_cast<unsigned>(method) % 64);
+    }
+
+    template <class F>
+    static void for_each_segment(beast::string_view path, F&& f)
+    {
+        std::size_t pos = 0;
+        while (pos < path.size())
+        {
+            if (path[pos] == '/')
+            {
+                ++pos;
+                continue;
+            }
+            auto end = path.find('/', pos);
+            if (end == beast::string_view::npos)
+                end = path.size();
+            f(path.substr(pos, end - pos));
+            pos = end;
+        }
+    }
+
+    /// Splits off the first segment of `path`; returns false once the path is exhausted.
+    static bool next_segment(beast::string_view& path, beast::string_view& segment)
+    {
+        while (!path.empty() && path.front() == '/')
+            path.remove_prefix(1);
+        if (path.empty())
+            return false;
+        auto end = std::min(path.find('/'), path.size());
+        segment = path.substr(0, end);
+        path.remove_prefix(end);
+        return true;
+    }
+
+    const route* find(const node& current, http::verb method, beast::string_view path, route_params& params) const
+    {
+        beast::string_view segment;
+        if (!next_segment(path, segment))
+        {
+            for (const auto& entry : current.routes)
+                if (entry->allows(method))
+                    return entry.get();
+            return nullptr;
+        }
+
+        auto it = std::lower_bound(current.literals.begin(), current.literals.end(), segment,
+                                   [](const auto& child, beast::string_view s) { return child.first < s; });
+        if (it != current.literals.end() && it->first == segment)
+            if (const route* found = find(*it->second, method, path, params))
+                return found;
+
+        if (current.param && params.push(current.param_name, segment))
+        {
+            if (const route* found = find(*current.param, method, path, params))
+                return found;
+            params.pop();
+        }
+        return nullptr;
+    }
+};
+
+#endif // ROUTER_HPP
@@ -3,6 +3,7 @@
 
 #include "../../app/include/application.hpp"
 #include "../../log/include/log.hpp"
+#include "server_certificate.hpp"
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/ssl.hpp>
@@ -19,6 +20,26 @@
  * these connections to a session for processing.
  */
 
+/**
+ * @brief Acceptor and executor settings for a server.
+ */
+struct server_options
+{
+    bool reuse_port = false;  ///< Set SO_REUSEPORT so one acceptor per io_context can bind the same endpoint.
+    bool strand_per_session = true;  ///< Put each session on its own strand; not needed when the io_context runs on one thread.
+    int native_listener = -1;  ///< Already listening socket inherited from a supervisor; the endpoint is then only used for its protocol.
+    int handshake_threads = 0;  ///< Threads of the pool running TLS handshakes; 0 runs them on the io threads.
+    bool allow_plaintext = false;  ///< Detect TLS per connection and also serve plaintext HTTP, for trusted internal callers.
+    tls_options tls;  ///< Settings of the SSL context the server is given.
+};
+
+/**
+ * @brief Process-wide thread pool for TLS handshakes, created on first use.
+ *
+ * @param threads Number of threads; only the first call's value is used.
+ */
+boost::asio::thread_pool& handshake_pool(std::size_t threads);
+
 /**
  * @class server
  * @brief Manages the lifecycle of incoming connections, including accepting
@@ -38,6 +59,8 @@ class server : public std::enable_shared_from_this<server>
     std::shared_ptr<std::string const> doc_root_;  ///< Shared pointer to the document root directory.
     std::shared_ptr<Logger> logger_;
     std::shared_ptr<Application> app_;
+    server_options options_;  ///< Acceptor and executor settings.
+    boost::asio::any_io_executor handshake_executor_;  ///< Executor of the handshake pool; empty to handshake on the io threads.
 public:
     /**
      * @brief Constructs the server object.
@@ -47,13 +70,15 @@ public:
      * @param endpoint The TCP endpoint (address and port) where the server will listen for connections.
      * @param doc_root Shared pointer to the document root directory for serving static files.
      * @param app Shared pointer to the application instance.
+     * @param options Acceptor and executor settings.
      */
     server(
         boost::asio::io_context& ioc,
         boost::asio::ssl::context& ctx,
         boost::asio::ip::tcp::endpoint endpoint,
         std::shared_ptr<std::string const> const& doc_root,
-        std::shared_ptr<Application> app);
+        std::shared_ptr<Application> app,
+        server_options options = server_options());
 
     /**
      * @brief Starts the server to begin accepting incoming connections.
@@ -14,16 +14,44 @@
  */
 std::string load_file_content(const std::string& file_path);
 
+/**
+ * @brief Protocol and resumption settings applied by load_server_certificate.
+ */
+struct tls_options {
+    bool enable_tls13 = true;  ///< Accept TLS 1.3 as well as TLS 1.2.
+    std::string groups = "X25519:P-256:P-384";  ///< ECDHE groups, most preferred first.
+    long session_cache_size = 20480;  ///< Sessions kept for TLS 1.2 session ID resumption.
+    long session_timeout_seconds = 7200;  ///< Lifetime of cached sessions and tickets.
+    long ticket_key_rotation_seconds = 3600;  ///< A new ticket key is started this often.
+    int ticket_keys_kept = 2;  ///< Keys still accepted for decryption, the current one included.
+    bool release_buffers = true;  ///< Free OpenSSL's record buffers while a connection is idle.
+};
+
 /**
  * @brief Load the server certificate, private key, and DH parameters into the SSL context.
  * 
  * The function reads the necessary file paths and password from environment variables,
- * loads the files' content, and configures the SSL context.
+ * loads the files' content, and configures the SSL context: TLS 1.2 and 1.3, ECDHE groups,
+ * a server-side session cache and session tickets encrypted with rotating keys, and
+ * SSL_MODE_RELEASE_BUFFERS so idle connections hold no record buffers. If
+ * ECDSA_CERT_PATH and ECDSA_KEY_PATH are set, an ECDSA certificate is served to clients
+ * that support it next to the RSA one.
  * 
  * @param ctx The SSL context to configure.
+ * @param options Protocol and resumption settings.
  * @throws std::runtime_error if required environment variables are missing or if file loading fails.
  */
-void load_server_certificate(boost::asio::ssl::context& ctx);
+void load_server_certificate(boost::asio::ssl::context& ctx, const tls_options& options = tls_options());
+
+/**
+ * @brief Creates the session ticket key ring in memory shared with processes forked later.
+ *
+ * Called by the prefork supervisor before it forks, so every worker encrypts tickets
+ * with the same keys and a ticket from one worker resumes on any other.
+ *
+ * @param options Key rotation period and number of keys kept.
+ */
+void share_ticket_keys(const tls_options& options = tls_options());
 
 #endif // SERVER_CERTIFICATE_HPP
 
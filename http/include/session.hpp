@@ -2,116 +2,375 @@
 #define SESSION_HPP
 
 #include "../../app/include/application.hpp"
+#include "connection_stats.hpp"
+#include "handler_memory.hpp"
 #include "http_tools.hpp"
+#include "request_arena.hpp"
+#include "session_pool.hpp"
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/ssl.hpp>
 #include <boost/asio.hpp>
+#include <boost/optional.hpp>
+#include <chrono>
+#include <cstdint>
+#include <deque>
 #include <memory>
 #include <string>
+#include <vector>
 
 /**
- * @brief The session class manages an individual HTTP session.
- * 
- * This class handles the SSL handshake, reading HTTP requests, sending HTTP responses,
- * and closing the session.
+ * @brief Request/response loop shared by the TLS and plaintext sessions.
+ *
+ * Derived provides `stream()`, `do_close()` and `shared_from_this()`; this class reads
+ * requests, hands them to the request handlers and writes the responses. The member
+ * functions are defined in session.cpp and instantiated there for the session types.
+ *
+ * Requests are pipelined: the next request is read while earlier ones are still being
+ * handled or written, up to pipeline_limit outstanding responses. Responses complete
+ * in any order but are written in request order.
+ *
+ * Header fields and bodies are allocated from per-request arenas owned by the session.
+ * An arena is rewound and reused once the request that used it has been destroyed,
+ * which is after its handler ran, so keep-alive traffic reuses the same memory. The
+ * read and write operations likewise allocate their state from the session's
+ * handler_memory. The read buffer and the arenas come from the session pool and go
+ * back to it when the connection closes.
+ *
+ * @tparam Derived The concrete session type (CRTP).
  */
-class session : public std::enable_shared_from_this<session>
+template <class Derived>
+class http_session
 {
-    boost::beast::ssl_stream<boost::beast::tcp_stream> stream_;  // SSL stream for the session
+protected:
+    static constexpr std::size_t pipeline_limit = 8;  // Responses outstanding before reading pauses
+
     boost::beast::flat_buffer buffer_;  // Buffer for reading requests
     std::shared_ptr<std::string const> doc_root_;  // Document root directory
-    boost::beast::http::request<boost::beast::http::string_body> req_;  // HTTP request object
+    boost::optional<boost::beast::http::request_parser<arena_string_body, arena_allocator<char>>> parser_;  // Request being read
+    std::vector<std::shared_ptr<request_arena>> arenas_;  // Recycled once their request is gone
+    handler_memory handler_memory_;  // State of the read and write operations, reused across requests
     std::shared_ptr<Application> app_;
+    std::deque<boost::optional<boost::beast::http::message_generator>> responses_;  // In request order; empty until handled
+    uint64_t first_sequence_ = 0;  // Sequence number of responses_.front()
+    bool reading_ = false;  // A read is in progress
+    bool writing_ = false;  // A write is in progress
+    bool read_closed_ = false;  // No more requests will be read: end of stream, or a request without keep-alive
+    bool closing_ = false;  // The session is shutting down; late responses are dropped
+
+    Derived& derived() { return static_cast<Derived&>(*this); }
+
 public:
     /**
-     * @brief Constructs a session object.
-     * 
-     * Initializes the session with the given socket, SSL context, and document root.
-     * 
-     * @param socket The socket for the session.
-     * @param ctx The SSL context for managing SSL connections.
+     * @brief Constructs the request loop.
+     *
+     * @param buffer Bytes already read from the connection, e.g. while detecting TLS.
      * @param doc_root The document root directory for serving files.
+     * @param app The application serving the API.
      */
-    session(
-        boost::asio::ip::tcp::socket&& socket,
-        boost::asio::ssl::context& ctx,
+    http_session(
+        boost::beast::flat_buffer buffer,
         std::shared_ptr<std::string const> const& doc_root,
         std::shared_ptr<Application> app);
 
     /**
-     * @brief Starts the session by initiating the SSL handshake.
+     * @brief Returns the read buffer and the arenas to the session pool.
      */
-    void run();
+    ~http_session();
+
+    /**
+     * @brief Reads an HTTP request from the client.
+     *
+     * Initiates an asynchronous read of the request header, unless a read is already
+     * in progress or the pipeline is full. The body is read once the header passed.
+     * An idle connection first waits for the next bytes without holding an arena.
+     */
+    void do_read();
 
 private:
     /**
-     * @brief Handles the asynchronous run operation.
-     * 
-     * This method is called after the session is dispatched and starts the SSL handshake.
+     * @brief An arena no request uses anymore, rewound; a new one if all are in use.
      */
-    void on_run();
+    std::shared_ptr<request_arena> acquire_arena();
 
     /**
-     * @brief Handles the SSL handshake completion.
-     * 
-     * This method is called when the SSL handshake is complete.
-     * 
-     * @param ec The error code, if any, from the handshake operation.
+     * @brief Gives back the memory the last requests grew, while the connection is idle.
      */
-    void on_handshake(boost::beast::error_code ec);
+    void release_idle_memory();
 
     /**
-     * @brief Reads an HTTP request from the client.
-     * 
-     * Initiates an asynchronous read operation to receive the client's HTTP request.
+     * @brief Handles the first bytes of a request that arrived on an idle connection.
      */
-    void do_read();
+    void on_idle_read(boost::beast::error_code ec, std::size_t bytes_transferred, std::chrono::steady_clock::time_point read_start_time);
 
     /**
-     * @brief Handles the completion of the asynchronous read operation.
-     * 
-     * Processes the received HTTP request or closes the session if an error occurs.
-     * 
+     * @brief Reads the request header into a new parser on a free arena.
+     */
+    void read_header(std::chrono::steady_clock::time_point read_start_time);
+
+    /**
+     * @brief Handles the completion of reading the request header.
+     *
+     * Rejects a body larger than the route accepts before any of it is read, answers
+     * `Expect: 100-continue`, then goes on to read the body.
+     *
      * @param ec The error code, if any, from the read operation.
      * @param bytes_transferred The number of bytes transferred during the read.
      */
-    void on_read(boost::beast::error_code ec, std::size_t bytes_transferred, std::chrono::steady_clock::time_point read_start_time);
+    void on_read_header(boost::beast::error_code ec, std::size_t bytes_transferred, std::chrono::steady_clock::time_point read_start_time);
+
+    /**
+     * @brief Tells a client waiting on `Expect: 100-continue` to send the body.
+     */
+    void send_continue(std::chrono::steady_clock::time_point read_start_time);
+
+    /**
+     * @brief Reads the next piece of the request body, or hands over the complete request.
+     *
+     * The timeout is renewed for every piece, so a large upload only fails if it stalls.
+     */
+    void do_read_body(std::chrono::steady_clock::time_point read_start_time);
 
     /**
-     * @brief Sends an HTTP response to the client.
-     * 
+     * @brief Handles a read that ended without a request.
+     */
+    void read_failed(boost::beast::error_code ec);
+
+    /**
+     * @brief Answers 413 to a request whose body exceeds its limit and stops reading.
+     */
+    void reject_body(std::size_t limit);
+
+    /**
+     * @brief Hands a complete request to the request handlers.
+     */
+    void on_request(std::chrono::steady_clock::time_point read_start_time);
+
+    /**
+     * @brief Stores the response to a request and writes whatever is next in order.
+     *
+     * @param sequence Sequence number of the request.
      * @param msg The HTTP response to send.
      */
-    void send_response(boost::beast::http::message_generator&& msg);
+    void on_response(uint64_t sequence, boost::beast::http::message_generator&& msg);
+
+    /**
+     * @brief Writes the next response if it is ready and no write is in progress.
+     */
+    void do_write();
 
     /**
      * @brief Handles the completion of the asynchronous write operation.
-     * 
-     * Determines whether to keep the connection alive or close it.
-     * 
+     *
+     * Determines whether to keep the connection alive or close it, and resumes
+     * reading if it paused at the pipeline limit.
+     *
      * @param keep_alive Whether to keep the connection alive.
      * @param ec The error code, if any, from the write operation.
      * @param bytes_transferred The number of bytes transferred during the write.
      */
     void on_write(bool keep_alive, boost::beast::error_code ec, std::size_t bytes_transferred);
+};
+
+/**
+ * @brief The session class manages an individual HTTPS session.
+ *
+ * This class handles the SSL handshake, reading HTTP requests, sending HTTP responses,
+ * and closing the session.
+ */
+class session
+    : public http_session<session>
+    , public std::enable_shared_from_this<session>
+{
+    boost::beast::ssl_stream<boost::beast::tcp_stream> stream_;  // SSL stream for the session
+    std::chrono::steady_clock::time_point handshake_start_;  // When the TLS handshake began
+    boost::asio::any_io_executor handshake_executor_;  // Pool running the handshake, or empty for the io threads
+    boost::optional<boost::asio::steady_timer> handshake_timer_;  // Handshake timeout on the pool strand
+    bool handshake_done_ = false;  // Set on the pool strand once the handshake completed
+public:
+    /**
+     * @brief Constructs a session object.
+     *
+     * Initializes the session with the given socket, SSL context, and document root.
+     *
+     * @param socket The socket for the session.
+     * @param ctx The SSL context for managing SSL connections.
+     * @param doc_root The document root directory for serving files.
+     * @param app The application serving the API.
+     * @param handshake_executor Executor to run the TLS handshake on; empty to run it on the session's executor.
+     * @param buffer Bytes of the ClientHello already read while detecting TLS.
+     */
+    session(
+        boost::asio::ip::tcp::socket&& socket,
+        boost::asio::ssl::context& ctx,
+        std::shared_ptr<std::string const> const& doc_root,
+        std::shared_ptr<Application> app,
+        boost::asio::any_io_executor handshake_executor = {},
+        boost::beast::flat_buffer buffer = {});
+
+    ~session();
+
+    /**
+     * @brief Starts the session by initiating the SSL handshake.
+     */
+    void run();
+
+    /**
+     * @brief The SSL stream, used by the request loop.
+     */
+    boost::beast::ssl_stream<boost::beast::tcp_stream>& stream() { return stream_; }
 
     /**
      * @brief Closes the session.
-     * 
+     *
      * Initiates the SSL shutdown process and closes the connection.
      */
     void do_close();
 
+private:
+    /**
+     * @brief Handles the asynchronous run operation.
+     *
+     * This method is called after the session is dispatched and starts the SSL handshake.
+     */
+    void on_run();
+
+    /**
+     * @brief Handles the SSL handshake completion.
+     *
+     * This method is called when the SSL handshake is complete.
+     *
+     * @param ec The error code, if any, from the handshake operation.
+     * @param bytes_used Bytes of the detection buffer consumed by the handshake.
+     */
+    void on_handshake(boost::beast::error_code ec, std::size_t bytes_used);
+
     /**
      * @brief Handles the completion of the asynchronous shutdown operation.
-     * 
+     *
      * Finalizes the session closure after the SSL shutdown is complete.
-     * 
+     *
      * @param ec The error code, if any, from the shutdown operation.
      */
     void on_shutdown(boost::beast::error_code ec);
 };
 
-#endif // SESSION_HPP
+/**
+ * @brief Sets the read buffer capacity a connection keeps while it waits for its next request.
+ *
+ * @param bytes Capacity kept; 16 KiB unless set, below which the request arenas are released too.
+ */
+void set_idle_buffer_limit(std::size_t bytes);
+
+/**
+ * @brief Sets the largest read buffer of a connection, which bounds how much is read ahead.
+ *
+ * @param bytes Largest read buffer; 64 KiB unless set, and at least 16 KiB.
+ */
+void set_read_buffer_limit(std::size_t bytes);
+
+/// Plain stream over a Unix domain socket.
+using local_stream = boost::beast::basic_stream<boost::asio::local::stream_protocol>;
+
+/**
+ * @brief A plaintext HTTP session, for trusted callers behind a TLS-terminating proxy
+ * or on the same host.
+ *
+ * @tparam Stream beast::tcp_stream for TCP, local_stream for Unix domain sockets.
+ */
+template <class Stream>
+class basic_plain_session
+    : public http_session<basic_plain_session<Stream>>
+    , public std::enable_shared_from_this<basic_plain_session<Stream>>
+{
+    Stream stream_;  // Plain stream for the session
+    connection_protocol protocol_;  // What the session is counted as
+public:
+    /**
+     * @brief Constructs a plaintext session.
+     *
+     * @param stream The connection, on the session's executor.
+     * @param buffer Bytes of the first request already read while detecting TLS.
+     * @param doc_root The document root directory for serving files.
+     * @param app The application serving the API.
+     * @param protocol What the connection is counted as in the connection statistics.
+     */
+    basic_plain_session(
+        Stream&& stream,
+        boost::beast::flat_buffer buffer,
+        std::shared_ptr<std::string const> const& doc_root,
+        std::shared_ptr<Application> app,
+        connection_protocol protocol = connection_protocol::plain);
+
+    ~basic_plain_session();
+
+    /**
+     * @brief Starts reading requests.
+     */
+    void run();
+
+    /**
+     * @brief The stream, used by the request loop.
+     */
+    Stream& stream() { return stream_; }
+
+    /**
+     * @brief Closes the session by shutting down the sending side of the socket.
+     */
+    void do_close();
+};
+
+/// Plaintext HTTP over TCP.
+using plain_session = basic_plain_session<boost::beast::tcp_stream>;
 
+/// Plaintext HTTP over a Unix domain socket.
+using local_session = basic_plain_session<local_stream>;
+
+/**
+ * @brief Reads the first bytes of a connection and hands it to a TLS or plaintext session.
+ */
+class detect_session : public std::enable_shared_from_this<detect_session>
+{
+    boost::beast::tcp_stream stream_;
+    boost::asio::ssl::context& ctx_;
+    std::shared_ptr<std::string const> doc_root_;
+    std::shared_ptr<Application> app_;
+    boost::asio::any_io_executor handshake_executor_;
+    boost::beast::flat_buffer buffer_;
+public:
+    /**
+     * @brief Constructs the detector for an accepted connection.
+     *
+     * @param socket The socket for the session.
+     * @param ctx The SSL context for TLS connections.
+     * @param doc_root The document root directory for serving files.
+     * @param app The application serving the API.
+     * @param handshake_executor Executor to run TLS handshakes on; empty to run them on the session's executor.
+     */
+    detect_session(
+        boost::asio::ip::tcp::socket&& socket,
+        boost::asio::ssl::context& ctx,
+        std::shared_ptr<std::string const> const& doc_root,
+        std::shared_ptr<Application> app,
+        boost::asio::any_io_executor handshake_executor = {});
+
+    ~detect_session();
+
+    /**
+     * @brief Starts detecting the protocol.
+     */
+    void run();
+
+private:
+    void on_run();
+
+    /**
+     * @brief Creates the session for the detected protocol.
+     *
+     * @param ec The error code, if any, from reading the first bytes.
+     * @param is_tls Whether the bytes start a TLS ClientHello.
+     */
+    void on_detect(boost::beast::error_code ec, bool is_tls);
+};
+
+#endif // SESSION_HPP
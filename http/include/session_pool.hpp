@@ -0,0 +1,162 @@
+#ifndef SESSION_POOL_HPP
+#define SESSION_POOL_HPP
+
+#include "request_arena.hpp"
+#include <boost/beast/core.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "../../ollama/include/json.hpp"
+
+/**
+ * @brief Memory of closed sessions, handed to the next connections.
+ *
+ * Clients that reconnect for every poll would otherwise allocate a session object,
+ * a read buffer grown over the first requests and a request arena per connection,
+ * and free them all again moments later. The pool keeps up to capacity() of each:
+ * session objects by size, read buffers with their capacity and arenas with their
+ * first block. It is shared by all threads, so every call takes a lock. Connections
+ * use it when they open and close and when they go idle after pipelined requests;
+ * with an idle buffer limit below request_arena::block_size, every time they go idle.
+ */
+class session_pool
+{
+public:
+    static constexpr std::size_t default_capacity = 256;  ///< Objects, buffers and arenas kept of each kind.
+    static constexpr std::size_t max_buffer_capacity = 64 * 1024;  ///< Larger read buffers are freed, not kept.
+
+    /**
+     * @brief Returns the memory of a closed session of the same size, or new memory.
+     */
+    void* allocate(std::size_t size);
+
+    /**
+     * @brief Keeps the memory of a session for reuse, or frees it if the pool is full.
+     */
+    void deallocate(void* pointer, std::size_t size) noexcept;
+
+    /**
+     * @brief An empty read buffer, with the capacity a closed session grew it to if one is cached.
+     */
+    boost::beast::flat_buffer acquire_buffer();
+
+    /**
+     * @brief Takes back the read buffer of a closed session.
+     */
+    void release_buffer(boost::beast::flat_buffer&& buffer) noexcept;
+
+    /**
+     * @brief A rewound arena of a closed session, or a new one.
+     */
+    std::shared_ptr<request_arena> acquire_arena();
+
+    /**
+     * @brief Takes back an arena of a closed session; ignored while a request still uses it.
+     */
+    void release_arena(std::shared_ptr<request_arena>&& arena) noexcept;
+
+    /**
+     * @brief Sets how many objects, buffers and arenas of each kind are kept; 0 disables the pool.
+     */
+    void set_capacity(std::size_t capacity);
+
+    /**
+     * @brief How many objects, buffers and arenas of each kind are kept.
+     */
+    std::size_t capacity() const
+    {
+        return capacity_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Hits, misses and cached bytes as entries shaped like the performance statistics.
+     */
+    nlohmann::json to_json() const;
+
+private:
+    struct object_cache
+    {
+        std::size_t size = 0;
+        std::vector<void*> free;
+    };
+
+    struct counters
+    {
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+    };
+
+    std::atomic<std::size_t> capacity_{default_capacity};
+    mutable std::mutex mutex_;
+    std::vector<object_cache> objects_;  ///< One cache per session type, guarded by mutex_.
+    std::vector<boost::beast::flat_buffer> buffers_;  ///< Guarded by mutex_.
+    std::vector<std::shared_ptr<request_arena>> arenas_;  ///< Guarded by mutex_.
+    std::size_t cached_bytes_ = 0;  ///< Memory held by the caches, guarded by mutex_.
+    counters object_counters_;
+    counters buffer_counters_;
+    counters arena_counters_;
+
+    /**
+     * @brief Frees cached entries beyond capacity(); called with mutex_ held.
+     */
+    void trim();
+};
+
+/**
+ * @brief The session pool of this process.
+ */
+session_pool& shared_session_pool();
+
+/**
+ * @brief Allocator drawing from the shared session pool, for std::allocate_shared.
+ */
+template <class T>
+class session_pool_allocator
+{
+public:
+    using value_type = T;
+
+    session_pool_allocator() noexcept = default;
+
+    template <class U>
+    session_pool_allocator(const session_pool_allocator<U>&) noexcept
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(shared_session_pool().allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* pointer, std::size_t n) noexcept
+    {
+        shared_session_pool().deallocate(pointer, n * sizeof(T));
+    }
+
+    template <class U>
+    bool operator==(const session_pool_allocator<U>&) const noexcept
+    {
+        return true;
+    }
+
+    template <class U>
+    bool operator!=(const session_pool_allocator<U>&) const noexcept
+    {
+        return false;
+    }
+};
+
+/**
+ * @brief Creates a session, or any object living as long as a connection, in pooled memory.
+ */
+template <class T, class... Args>
+std::shared_ptr<T> make_pooled(Args&&... args)
+{
+    return std::allocate_shared<T>(session_pool_allocator<T>(), std::forward<Args>(args)...);
+}
+
+#endif // SESSION_POOL_HPP
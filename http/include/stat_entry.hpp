@@ -0,0 +1,21 @@
+#ifndef STAT_ENTRY_HPP
+#define STAT_ENTRY_HPP
+
+#include <cstdint>
+#include <string>
+#include "../../ollama/include/json.hpp"
+
+/**
+ * @brief A single value as an entry shaped like the performance statistics.
+ *
+ * The value is reported as the average, minimum, maximum and total alike, so counters
+ * and gauges can be listed next to the metrics aggregated from the database.
+ *
+ * @param name The metric name.
+ * @param value The value.
+ * @param count The number of samples behind the value.
+ * @return A JSON object with the fields of MetricStatistic.
+ */
+nlohmann::json stat_entry(std::string name, double value, uint64_t count = 1);
+
+#endif // STAT_ENTRY_HPP
@@ -0,0 +1,65 @@
+#ifndef TLS_STATS_HPP
+#define TLS_STATS_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include "../../ollama/include/json.hpp"
+
+/**
+ * @brief Handshake counters and latencies of the TLS sessions served by this process.
+ *
+ * Full and resumed handshakes are tracked separately, since resumption is what
+ * keeps reconnecting clients cheap. The handshake rate is averaged over the last
+ * ten seconds.
+ */
+class handshake_stats
+{
+public:
+    /**
+     * @brief Records one handshake.
+     *
+     * @param latency Time from starting the handshake to its completion.
+     * @param resumed Whether the session was resumed from the cache or a ticket.
+     * @param failed Whether the handshake failed; its latency is not recorded.
+     */
+    void record(std::chrono::microseconds latency, bool resumed, bool failed);
+
+    /**
+     * @brief The statistics as entries shaped like the performance statistics.
+     */
+    nlohmann::json to_json() const;
+
+private:
+    struct latency_stat
+    {
+        double total_ms = 0;
+        double min_ms = 0;
+        double max_ms = 0;
+        uint64_t count = 0;
+
+        void add(double ms);
+        nlohmann::json to_json(const char* name) const;
+    };
+
+    static constexpr std::size_t rate_window = 10;  ///< Seconds averaged for the handshake rate.
+
+    mutable std::mutex mutex_;
+    latency_stat full_;
+    latency_stat resumed_;
+    uint64_t failed_ = 0;
+    struct second_bucket
+    {
+        int64_t second = 0;
+        uint64_t handshakes = 0;
+    };
+    std::array<second_bucket, rate_window> per_second_{};  ///< Indexed by second % rate_window.
+};
+
+/**
+ * @brief The handshake statistics of this process.
+ */
+handshake_stats& tls_handshake_stats();
+
+#endif // TLS_STATS_HPP
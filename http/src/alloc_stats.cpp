@@ -0,0 +1,113 @@
+#include "../include/alloc_stats.hpp"
+#include "../include/stat_entry.hpp"
+#include <cstdlib>
+#include <new>
+
+#ifdef COUNT_ALLOCATIONS
+
+namespace {
+
+std::atomic<uint64_t> allocations{0};
+
+void* counted_alloc(std::size_t size, std::size_t alignment)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (size == 0) {
+        size = 1;
+    }
+
+    void* p = nullptr;
+    if (alignment <= alignof(std::max_align_t)) {
+        p = std::malloc(size);
+    } else if (posix_memalign(&p, alignment, size) != 0) {
+        p = nullptr;
+    }
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+} // namespace
+
+// The array and nothrow forms call these, so every allocation is counted once.
+void* operator new(std::size_t size)
+{
+    return counted_alloc(size, alignof(std::max_align_t));
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    return counted_alloc(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+/**
+ * @brief Calls of the global operator new so far; 0 unless built with ALLOC_STATS=1.
+ */
+uint64_t heap_allocations()
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+#else
+
+/**
+ * @brief Calls of the global operator new so far; 0 unless built with ALLOC_STATS=1.
+ */
+uint64_t heap_allocations()
+{
+    return 0;
+}
+
+#endif // COUNT_ALLOCATIONS
+
+/**
+ * @brief The counters as entries shaped like the performance statistics.
+ *
+ * @return Requests read and, in a counting build, heap allocations in total and per request
+ *         and the recycled and new allocations of session handler memory.
+ */
+nlohmann::json allocation_stats::to_json() const
+{
+    auto requests = requests_.load(std::memory_order_relaxed);
+    nlohmann::json stats_json = nlohmann::json::array();
+    stats_json.push_back(stat_entry("requests_read", static_cast<double>(requests)));
+#ifdef COUNT_ALLOCATIONS
+    auto allocations = heap_allocations();
+    stats_json.push_back(stat_entry("heap_allocations", static_cast<double>(allocations)));
+    stats_json.push_back(stat_entry("heap_allocations_per_request",
+                                    requests ? static_cast<double>(allocations) / static_cast<double>(requests) : 0.0));
+    stats_json.push_back(stat_entry("handler_allocations_recycled", static_cast<double>(handler_recycled_.load(std::memory_order_relaxed))));
+    stats_json.push_back(stat_entry("handler_allocations_new", static_cast<double>(handler_new_.load(std::memory_order_relaxed))));
+#endif
+    return stats_json;
+}
+
+/**
+ * @brief The allocation counters of this process.
+ */
+allocation_stats& heap_allocation_stats()
+{
+    static allocation_stats stats;
+    return stats;
+}
@@ -0,0 +1,438 @@
+#include "../include/asset_cache.hpp"
+#include "../include/async_handler.hpp"
+#include "../include/http_tools.hpp"
+#include <brotli/encode.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace {
+
+/// Compressed variants are only kept when they save at least this fraction.
+constexpr double min_saving = 0.1;
+
+/// Compression levels while loading the document root at startup, where time is not an issue.
+constexpr int startup_gzip_level = Z_BEST_COMPRESSION;
+constexpr int startup_brotli_quality = BROTLI_MAX_QUALITY;
+
+/// Compression levels for files reloaded while serving; Brotli 11 takes seconds on a large file.
+constexpr int runtime_gzip_level = 6;
+constexpr int runtime_brotli_quality = 5;
+
+std::string gzip_compress(const std::string& input, int level)
+{
+    z_stream stream{};
+    if (deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return {};
+    }
+
+    std::string output(deflateBound(&stream, input.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+    stream.avail_in = static_cast<uInt>(input.size());
+    stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+    stream.avail_out = static_cast<uInt>(output.size());
+
+    int result = deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END ? output : std::string();
+}
+
+std::string brotli_compress(const std::string& input, int quality)
+{
+    std::size_t size = BrotliEncoderMaxCompressedSize(input.size());
+    if (size == 0) {
+        return {};
+    }
+
+    std::string output(size, '\0');
+    if (!BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_GENERIC,
+                               input.size(), reinterpret_cast<const uint8_t*>(input.data()),
+                               &size, reinterpret_cast<uint8_t*>(&output[0]))) {
+        return {};
+    }
+    output.resize(size);
+    return output;
+}
+
+/// Keeps a compressed variant only if it is meaningfully smaller than the original.
+std::string worth_keeping(std::string compressed, std::size_t original_size)
+{
+    if (compressed.empty() || compressed.size() > original_size * (1.0 - min_saving)) {
+        return {};
+    }
+    return compressed;
+}
+
+/// Seconds on the steady clock, for the least-recently-used order of cached assets.
+int64_t now_seconds()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Memory taken by the variants of an asset.
+std::size_t asset_bytes(const asset& entry)
+{
+    return entry.identity.size() + entry.gzip.size() + entry.brotli.size();
+}
+
+/// FNV-1a over the contents; the size is part of the tag as well.
+std::string strong_etag(const std::string& contents)
+{
+    uint64_t hash = 1469598103934665603ull;
+    for (unsigned char c : contents) {
+        hash = (hash ^ c) * 1099511628211ull;
+    }
+
+    std::ostringstream tag;
+    tag << '"' << std::hex << contents.size() << '-' << hash << '"';
+    return tag.str();
+}
+
+} // namespace
+
+/**
+ * @brief Formats a time as an IMF-fixdate, as used by Last-Modified.
+ *
+ * @param time Seconds since the epoch.
+ * @return The formatted date, e.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+ */
+std::string http_date(std::time_t time)
+{
+    std::tm tm{};
+    gmtime_r(&time, &tm);
+    char buffer[64];
+    std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buffer;
+}
+
+/**
+ * @brief Loads the document root and starts the inotify watcher.
+ *
+ * @param doc_root The document root directory.
+ * @param max_file_bytes Files larger than this are served from disk.
+ * @param max_total_bytes Memory for the cached variants; startup loading stops there, later loads evict.
+ */
+asset_cache::asset_cache(std::string doc_root, std::size_t max_file_bytes, std::size_t max_total_bytes)
+    : doc_root_(std::move(doc_root)), max_file_bytes_(max_file_bytes), max_total_bytes_(max_total_bytes),
+      logger_(LoggerManager::getLogger("asset_cache_logger", LogLevel::INFO, LogOutput::CONSOLE))
+{
+    while (doc_root_.size() > 1 && doc_root_.back() == '/') {
+        doc_root_.pop_back();  // Keys are built as <doc_root>/<file>, like path_cat() does
+    }
+
+    inotify_fd_ = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd_ < 0) {
+        logger_->log(LogLevel::ERROR, "inotify unavailable, cached assets will not be refreshed: " + std::string(std::strerror(errno)));
+    }
+
+    load_directory(doc_root_);
+    logger_->log(LogLevel::INFO, "Cached " + std::to_string(assets_.size()) + " static assets (" +
+                 std::to_string(total_bytes_) + " bytes) from " + doc_root_ + ".");
+
+    if (inotify_fd_ >= 0) {
+        std::thread(&asset_cache::run_watcher, this).detach();
+    }
+}
+
+/**
+ * @brief Returns the cached asset for a file path; starts loading it on the blocking pool if needed.
+ *
+ * The lookup uses the normalized path, so `/./app.js` and `//app.js` find `/app.js`.
+ * Loading compresses the file, which must not hold up an io thread; until it is
+ * cached, the caller serves the file from disk. Paths known not to be cacheable
+ * are not loaded again.
+ *
+ * @param path Path of the file, as built from the document root and request target.
+ * @return The asset, or nullptr if it is not cached (yet).
+ */
+std::shared_ptr<const asset> asset_cache::find(const std::string& path)
+{
+    std::string key = key_of(path);
+    if (key.empty()) {
+        return nullptr;
+    }
+
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        auto it = assets_.find(key);
+        if (it != assets_.end()) {
+            // Written at most once a second, so hits on a hot asset do not all dirty its cache line
+            int64_t now = now_seconds();
+            if (it->second.last_used.load(std::memory_order_relaxed) != now) {
+                it->second.last_used.store(now, std::memory_order_relaxed);
+            }
+            return it->second.entry;
+        }
+        if (uncacheable_.count(key) > 0) {
+            return nullptr;
+        }
+    }
+
+    load_async(key);
+    return nullptr;
+}
+
+/**
+ * @brief The cache key of a file path: the document root and the normalized rest of the path.
+ *
+ * Normalizing the rest as an absolute path drops `.`, `..` and repeated slashes
+ * without ever leaving the document root.
+ *
+ * @return The key, or an empty string if the path is not below the document root.
+ */
+std::string asset_cache::key_of(const std::string& path) const
+{
+    if (path.compare(0, doc_root_.size(), doc_root_) != 0 || path.size() == doc_root_.size() ||
+        path[doc_root_.size()] != '/') {
+        return {};
+    }
+    return doc_root_ + std::filesystem::path(path.substr(doc_root_.size())).lexically_normal().string();
+}
+
+/**
+ * @brief Loads a file on the blocking pool and caches it, unless it is already being loaded.
+ *
+ * A file that changed while it was being read is not kept; the next request loads it again.
+ * A file that cannot be cached is marked so, as long as the watcher can clear the mark.
+ */
+void asset_cache::load_async(const std::string& key)
+{
+    {
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        if (uncacheable_.count(key) > 0 || !loading_.insert(key).second) {
+            return;
+        }
+    }
+
+    uint64_t invalidations = invalidations_.load(std::memory_order_acquire);
+    net::post(blocking_pool(), [this, key, invalidations] {
+        auto loaded = load(key, false);
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        loading_.erase(key);
+        if (invalidations_.load(std::memory_order_relaxed) != invalidations) {
+            return;
+        }
+        if (!(loaded && store(key, std::move(loaded), true)) && inotify_fd_ >= 0) {
+            if (uncacheable_.size() >= max_uncacheable) {
+                uncacheable_.clear();  // Requests for many missing paths must not grow it without bound
+            }
+            uncacheable_.insert(key);
+        }
+    });
+}
+
+/**
+ * @brief Caches an asset within max_total_bytes; called with mutex_ held.
+ *
+ * @param evict Whether the least recently used assets make room; otherwise an asset
+ *              that does not fit is not cached.
+ * @return False if the asset was not cached.
+ */
+bool asset_cache::store(const std::string& key, std::shared_ptr<const asset> entry, bool evict)
+{
+    erase(key);
+    std::size_t bytes = asset_bytes(*entry);
+    if (bytes > max_total_bytes_ || (!evict && total_bytes_ + bytes > max_total_bytes_)) {
+        logger_->log(LogLevel::DEBUG, "Asset cache full, serving " + key + " from disk.");
+        return false;
+    }
+
+    while (total_bytes_ + bytes > max_total_bytes_) {
+        auto oldest = assets_.begin();
+        for (auto it = assets_.begin(); it != assets_.end(); ++it) {
+            if (it->second.last_used.load(std::memory_order_relaxed) < oldest->second.last_used.load(std::memory_order_relaxed)) {
+                oldest = it;
+            }
+        }
+        logger_->log(LogLevel::DEBUG, "Evicting cached asset " + oldest->first + " for " + key + ".");
+        total_bytes_ -= asset_bytes(*oldest->second.entry);
+        assets_.erase(oldest);
+    }
+
+    total_bytes_ += bytes;
+    auto& cached = assets_[key];
+    cached.entry = std::move(entry);
+    cached.last_used.store(now_seconds(), std::memory_order_relaxed);
+    return true;
+}
+
+/**
+ * @brief Drops an asset from the cache; called with mutex_ held.
+ */
+void asset_cache::erase(const std::string& key)
+{
+    auto it = assets_.find(key);
+    if (it != assets_.end()) {
+        total_bytes_ -= asset_bytes(*it->second.entry);
+        assets_.erase(it);
+    }
+}
+
+/**
+ * @brief Clears the not-cacheable mark of a changed path; called with mutex_ held.
+ *
+ * @param path The path that changed.
+ * @param directory Whether it is a directory, whose marks below it are cleared too.
+ */
+void asset_cache::forget_uncacheable(const std::string& path, bool directory)
+{
+    uncacheable_.erase(path);
+    if (!directory) {
+        return;
+    }
+    std::string prefix = path + "/";
+    for (auto it = uncacheable_.begin(); it != uncacheable_.end();) {
+        if (it->compare(0, prefix.size(), prefix) == 0) {
+            it = uncacheable_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/**
+ * @brief Reads a file and builds its variants; returns nullptr if it cannot be cached.
+ *
+ * @param path Path of the file.
+ * @param startup Whether the document root is being loaded at startup, which uses the
+ *                best compression; reloads while serving use faster levels.
+ */
+std::shared_ptr<const asset> asset_cache::load(const std::string& path, bool startup) const
+{
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode) ||
+        static_cast<std::size_t>(info.st_size) > max_file_bytes_) {
+        return nullptr;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return nullptr;
+    }
+
+    auto entry = std::make_shared<asset>();
+    entry->identity.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    entry->gzip = worth_keeping(gzip_compress(entry->identity, startup ? startup_gzip_level : runtime_gzip_level),
+                                entry->identity.size());
+    entry->brotli = worth_keeping(brotli_compress(entry->identity, startup ? startup_brotli_quality : runtime_brotli_quality),
+                                  entry->identity.size());
+    entry->etag = strong_etag(entry->identity);
+    entry->last_modified = http_date(info.st_mtime);
+    entry->content_type = std::string(mime_type(path));
+
+    logger_->log(LogLevel::DEBUG, "Cached " + path + " (" + std::to_string(entry->identity.size()) + " bytes, gzip " +
+                 std::to_string(entry->gzip.size()) + ", br " + std::to_string(entry->brotli.size()) + ").");
+    return entry;
+}
+
+/**
+ * @brief Loads every cacheable file below a directory and watches its subdirectories.
+ */
+void asset_cache::load_directory(const std::string& directory)
+{
+    std::error_code ec;
+    watch_directory(directory);
+    for (auto it = std::filesystem::recursive_directory_iterator(directory, ec);
+         !ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec)) {
+        if (it->is_directory(ec)) {
+            watch_directory(it->path().string());
+        } else if (auto loaded = load(it->path().string(), true)) {
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            store(key_of(it->path().string()), std::move(loaded), false);
+        }
+    }
+}
+
+void asset_cache::watch_directory(const std::string& directory)
+{
+    if (inotify_fd_ < 0) {
+        return;
+    }
+
+    int wd = inotify_add_watch(inotify_fd_, directory.c_str(),
+                               IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB);
+    if (wd < 0) {
+        logger_->log(LogLevel::ERROR, "Cannot watch " + directory + ": " + std::strerror(errno));
+        return;
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    watches_[wd] = directory;
+}
+
+/**
+ * @brief Drops the cache entry of every file that changes; new directories are watched too.
+ */
+void asset_cache::run_watcher()
+{
+    alignas(inotify_event) char buffer[16 * 1024];
+
+    while (true) {
+        ssize_t length = ::read(inotify_fd_, buffer, sizeof(buffer));
+        if (length < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            logger_->log(LogLevel::ERROR, "inotify read failed: " + std::string(std::strerror(errno)));
+            return;
+        }
+
+        for (char* p = buffer; p < buffer + length;) {
+            auto* event = reinterpret_cast<inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+            if (event->len == 0) {
+                continue;
+            }
+
+            std::string directory;
+            {
+                std::shared_lock<std::shared_mutex> lock(mutex_);
+                auto it = watches_.find(event->wd);
+                if (it == watches_.end()) {
+                    continue;
+                }
+                directory = it->second;
+            }
+
+            std::string path = directory + "/" + event->name;
+            if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+                watch_directory(path);
+                std::unique_lock<std::shared_mutex> lock(mutex_);
+                forget_uncacheable(path, true);
+                continue;
+            }
+
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            invalidations_.fetch_add(1, std::memory_order_release);
+            forget_uncacheable(path, (event->mask & IN_ISDIR) != 0);
+            if (assets_.count(path) > 0) {
+                erase(path);
+                logger_->log(LogLevel::DEBUG, "Invalidated cached asset " + path + ".");
+            }
+        }
+    }
+}
+
+/**
+ * @brief The process-wide asset cache for a document root, created on first use.
+ *
+ * @param doc_root The document root directory; only the first call's value is used.
+ * @return The cache.
+ */
+asset_cache& shared_asset_cache(beast::string_view doc_root)
+{
+    static asset_cache cache{std::string(doc_root)};
+    return cache;
+}
@@ -0,0 +1,345 @@
+#include "../include/async_client.hpp"
+#include <boost/asio/connect.hpp>
+#include <boost/asio/post.hpp>
+
+/**
+ * @brief Splits an https:// URL into host, port and target.
+ *
+ * @param url The URL to parse.
+ * @param parts Receives the components; the port defaults to 443 and the target to "/".
+ * @return False if the URL is not a well-formed https:// URL.
+ */
+bool parse_url(const std::string& url, url_parts& parts)
+{
+    const std::string scheme = "https://";
+    if (url.compare(0, scheme.size(), scheme) != 0) {
+        return false;
+    }
+
+    auto authority_end = url.find('/', scheme.size());
+    std::string authority = url.substr(scheme.size(), authority_end == std::string::npos ? std::string::npos : authority_end - scheme.size());
+    parts.target = authority_end == std::string::npos ? "/" : url.substr(authority_end);
+
+    auto colon = authority.rfind(':');
+    if (colon != std::string::npos && authority.find(']', colon) == std::string::npos) {
+        parts.host = authority.substr(0, colon);
+        parts.port = authority.substr(colon + 1);
+    } else {
+        parts.host = authority;
+        parts.port = "443";
+    }
+
+    return !parts.host.empty() && !parts.port.empty() &&
+           parts.port.find_first_not_of("0123456789") == std::string::npos;
+}
+
+/**
+ * @brief Constructs an AsyncClient.
+ *
+ * @param io_context The I/O context running the deliveries.
+ * @param options Connection and retry limits.
+ * @throws boost::system::system_error if options.ca_file cannot be loaded.
+ */
+AsyncClient::AsyncClient(net::io_context& io_context, AsyncClientOptions options)
+    : strand_(net::make_strand(io_context)), ssl_ctx_(ssl::context::tlsv12_client), options_(options),
+      logger_(LoggerManager::getLogger("AsyncClientLogger", LogLevel::DEBUG))
+{
+    options_.max_connections = std::max<std::size_t>(1, options_.max_connections);
+    ssl_ctx_.set_default_verify_paths();
+    if (!options_.ca_file.empty()) {
+        ssl_ctx_.load_verify_file(options_.ca_file);
+    }
+    ssl_ctx_.set_verify_mode(ssl::verify_peer);
+    logger_->log(LogLevel::INFO, "Async client initialized.");
+}
+
+/**
+ * @brief Queues an HTTPS POST request.
+ *
+ * @param host The host to connect to.
+ * @param port The port to connect to.
+ * @param target The target resource to post to.
+ * @param body The JSON body to send.
+ * @param on_complete Optional callback invoked on the client's strand when the delivery finishes.
+ */
+void AsyncClient::post(const std::string& host, const std::string& port, const std::string& target,
+                       std::string body, completion_handler on_complete)
+{
+    delivery item;
+    item.target = target;
+    item.body = std::move(body);
+    item.on_complete = std::move(on_complete);
+
+    net::post(strand_, [self = shared_from_this(), host, port, item = std::move(item)]() mutable {
+        self->enqueue(host, port, std::move(item));
+    });
+}
+
+void AsyncClient::enqueue(const std::string& host, const std::string& port, delivery item)
+{
+    if (pending_ >= options_.max_pending) {
+        logger_->log(LogLevel::ERROR, "Too many pending deliveries, dropping POST to " + host + ":" + port + item.target);
+        if (item.on_complete) {
+            item.on_complete(net::error::no_buffer_space, 0);
+        }
+        return;
+    }
+
+    std::string key = host + ":" + port;
+    auto it = hosts_.find(key);
+    if (it == hosts_.end()) {
+        if (hosts_.size() >= options_.max_hosts && !make_room()) {
+            logger_->log(LogLevel::ERROR, "Too many callback hosts, dropping POST to " + key + item.target);
+            if (item.on_complete) {
+                item.on_complete(net::error::no_buffer_space, 0);
+            }
+            return;
+        }
+        auto h = std::make_shared<host_state>(strand_);
+        h->host = host;
+        h->port = port;
+        it = hosts_.emplace(std::move(key), std::move(h)).first;
+    }
+    auto& h = it->second;
+
+    h->queue.push_back(std::move(item));
+    ++pending_;
+    schedule(h);
+}
+
+/**
+ * @brief Closes the pooled connection of an idle host and forgets the host, to make room for a new one.
+ *
+ * @return False if every host still has deliveries queued or in flight.
+ */
+bool AsyncClient::make_room()
+{
+    for (auto it = hosts_.begin(); it != hosts_.end(); ++it) {
+        host_ptr h = it->second;
+        if (!h->active && !h->waiting && h->queue.empty()) {
+            h->timer.cancel();
+            close(h);
+            hosts_.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Forgets a host that has nothing queued and no open connection.
+ */
+void AsyncClient::forget(const host_ptr& h)
+{
+    if (h->active || h->waiting || !h->queue.empty() || h->stream) {
+        return;
+    }
+    auto it = hosts_.find(h->host + ":" + h->port);
+    if (it != hosts_.end() && it->second == h) {
+        hosts_.erase(it);
+    }
+}
+
+/**
+ * @brief Gives a host with pending deliveries a connection slot, or queues it for one.
+ */
+void AsyncClient::schedule(const host_ptr& h)
+{
+    if (h->active || h->waiting) {
+        return;
+    }
+
+    if (active_ >= options_.max_connections) {
+        h->waiting = true;
+        waiting_hosts_.push_back(h);
+        return;
+    }
+
+    h->active = true;
+    ++active_;
+    h->timer.cancel();  // Stop the idle timer of a pooled connection.
+
+    if (h->stream) {
+        send_next(h);
+    } else {
+        connect(h);
+    }
+}
+
+/**
+ * @brief Returns the slot of a host whose queue is drained and keeps its connection for reuse.
+ *
+ * The host is forgotten when its idle connection is closed, or right away if it has none.
+ */
+void AsyncClient::release(const host_ptr& h)
+{
+    h->active = false;
+    --active_;
+
+    if (h->stream) {
+        h->timer.expires_after(options_.idle_timeout);
+        h->timer.async_wait(net::bind_executor(strand_, [self = shared_from_this(), h](beast::error_code ec) {
+            if (!ec && !h->active) {
+                self->close(h);
+                self->forget(h);
+            }
+        }));
+    }
+
+    while (!waiting_hosts_.empty() && active_ < options_.max_connections) {
+        auto next = waiting_hosts_.front();
+        waiting_hosts_.pop_front();
+        next->waiting = false;
+        schedule(next);
+    }
+
+    forget(h);
+}
+
+void AsyncClient::connect(const host_ptr& h)
+{
+    logger_->log(LogLevel::DEBUG, "Connecting to " + h->host + ":" + h->port);
+
+    h->resolver.async_resolve(h->host, h->port,
+        net::bind_executor(strand_, [self = shared_from_this(), h](beast::error_code ec, tcp::resolver::results_type results) {
+            if (ec) {
+                return self->fail(h, ec, "resolve");
+            }
+
+            h->stream = std::make_unique<ssl::stream<beast::tcp_stream>>(self->strand_, self->ssl_ctx_);
+            if (!SSL_set_tlsext_host_name(h->stream->native_handle(), h->host.c_str())) {
+                beast::error_code sni_ec{static_cast<int>(::ERR_get_error()), net::error::get_ssl_category()};
+                return self->fail(h, sni_ec, "sni");
+            }
+            h->stream->set_verify_callback(ssl::host_name_verification(h->host));
+
+            beast::get_lowest_layer(*h->stream).expires_after(self->options_.timeout);
+            beast::get_lowest_layer(*h->stream).async_connect(results,
+                net::bind_executor(self->strand_, [self, h](beast::error_code ec, tcp::endpoint) {
+                    if (ec) {
+                        return self->fail(h, ec, "connect");
+                    }
+
+                    beast::get_lowest_layer(*h->stream).expires_after(self->options_.timeout);
+                    h->stream->async_handshake(ssl::stream_base::client,
+                        net::bind_executor(self->strand_, [self, h](beast::error_code ec) {
+                            if (ec) {
+                                return self->fail(h, ec, "handshake");
+                            }
+                            self->send_next(h);
+                        }));
+                }));
+        }));
+}
+
+/**
+ * @brief Sends the next queued delivery of a host over its pooled connection.
+ */
+void AsyncClient::send_next(const host_ptr& h)
+{
+    if (h->queue.empty()) {
+        return release(h);
+    }
+
+    const delivery& item = h->queue.front();
+    h->req = {};
+    h->req.method(http::verb::post);
+    h->req.target(item.target);
+    h->req.version(11);
+    h->req.set(http::field::host, h->host);
+    h->req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
+    h->req.set(http::field::content_type, "application/json");
+    h->req.keep_alive(true);
+    h->req.body() = item.body;
+    h->req.prepare_payload();
+
+    beast::get_lowest_layer(*h->stream).expires_after(options_.timeout);
+    http::async_write(*h->stream, h->req,
+        net::bind_executor(strand_, [self = shared_from_this(), h](beast::error_code ec, std::size_t) {
+            if (ec) {
+                return self->fail(h, ec, "write");
+            }
+
+            h->res = {};
+            http::async_read(*h->stream, h->buffer, h->res,
+                net::bind_executor(self->strand_, [self, h](beast::error_code ec, std::size_t) {
+                    self->on_response(h, ec);
+                }));
+        }));
+}
+
+void AsyncClient::on_response(const host_ptr& h, beast::error_code ec)
+{
+    if (ec) {
+        return fail(h, ec, "read");
+    }
+
+    unsigned status = h->res.result_int();
+    bool keep_alive = h->res.keep_alive();
+
+    // Server errors and throttling are retried, anything else is final.
+    if (status >= 500 || status == 429) {
+        return fail(h, http::make_error_code(http::error::bad_status), "status " + std::to_string(status));
+    }
+
+    logger_->log(LogLevel::DEBUG, "Delivered POST to " + h->host + ":" + h->port + " with status " + std::to_string(status));
+    finish(h, {}, status);
+
+    if (!keep_alive) {
+        close(h);
+        if (!h->queue.empty()) {
+            return connect(h);
+        }
+    }
+    send_next(h);
+}
+
+/**
+ * @brief Drops the connection and retries the front delivery with exponential backoff.
+ */
+void AsyncClient::fail(const host_ptr& h, beast::error_code ec, const std::string& what)
+{
+    logger_->log(LogLevel::ERROR, "Delivery to " + h->host + ":" + h->port + " failed (" + what + "): " + ec.message());
+    close(h);
+
+    if (!h->queue.empty()) {
+        auto& item = h->queue.front();
+        if (++item.attempts > options_.max_retries) {
+            logger_->log(LogLevel::ERROR, "Giving up on POST to " + h->host + ":" + h->port + item.target);
+            finish(h, ec, 0);
+        }
+    }
+
+    if (h->queue.empty()) {
+        return release(h);
+    }
+
+    auto backoff = options_.retry_backoff * (1 << std::min(std::max(h->queue.front().attempts - 1, 0), 10));
+    h->timer.expires_after(backoff);
+    h->timer.async_wait(net::bind_executor(strand_, [self = shared_from_this(), h](beast::error_code ec) {
+        if (!ec) {
+            self->connect(h);
+        }
+    }));
+}
+
+void AsyncClient::finish(const host_ptr& h, beast::error_code ec, unsigned status)
+{
+    delivery item = std::move(h->queue.front());
+    h->queue.pop_front();
+    --pending_;
+
+    if (item.on_complete) {
+        item.on_complete(ec, status);
+    }
+}
+
+void AsyncClient::close(const host_ptr& h)
+{
+    if (h->stream) {
+        beast::error_code ec;
+        beast::get_lowest_layer(*h->stream).socket().close(ec);
+        h->stream.reset();
+    }
+    h->buffer.clear();
+}
@@ -0,0 +1,14 @@
+#include "../include/async_handler.hpp"
+#include <algorithm>
+#include <thread>
+
+/**
+ * @brief Shared thread pool for handler work that would otherwise block an io thread.
+ *
+ * @return The pool, created on first use.
+ */
+net::thread_pool& blocking_pool()
+{
+    static net::thread_pool pool(std::max(2u, std::thread::hardware_concurrency()));
+    return pool;
+}
@@ -0,0 +1,48 @@
+#include "../include/connection_stats.hpp"
+#include "../include/stat_entry.hpp"
+
+/**
+ * @brief Counts a new connection; called when its session is created.
+ */
+void connection_stats::opened(connection_protocol protocol)
+{
+    auto& c = of(protocol);
+    c.accepted.fetch_add(1, std::memory_order_relaxed);
+    c.active.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Counts a connection as closed; called when its session is destroyed.
+ */
+void connection_stats::closed(connection_protocol protocol)
+{
+    of(protocol).active.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief The counters as entries shaped like the performance statistics.
+ *
+ * @return Accepted and active connection counts for plaintext HTTP, TLS, the Unix socket and HTTP/2.
+ */
+nlohmann::json connection_stats::to_json() const
+{
+    nlohmann::json stats_json = nlohmann::json::array();
+    stats_json.push_back(stat_entry("connections_plain_accepted", static_cast<double>(plain_.accepted.load(std::memory_order_relaxed))));
+    stats_json.push_back(stat_entry("connections_plain_active", static_cast<double>(plain_.active.load(std::memory_order_relaxed))));
+    stats_json.push_back(stat_entry("connections_tls_accepted", static_cast<double>(tls_.accepted.load(std::memory_order_relaxed))));
+    stats_json.push_back(stat_entry("connections_tls_active", static_cast<double>(tls_.active.load(std::memory_order_relaxed))));
+    stats_json.push_back(stat_entry("connections_local_accepted", static_cast<double>(local_.accepted.load(std::memory_order_relaxed))));
+    stats_json.push_back(stat_entry("connections_local_active", static_cast<double>(local_.active.load(std::memory_order_relaxed))));
+    stats_json.push_back(stat_entry("connections_h2_accepted", static_cast<double>(h2_.accepted.load(std::memory_order_relaxed))));
+    stats_json.push_back(stat_entry("connections_h2_active", static_cast<double>(h2_.active.load(std::memory_order_relaxed))));
+    return stats_json;
+}
+
+/**
+ * @brief The connection counters of this process.
+ */
+connection_stats& session_connection_stats()
+{
+    static connection_stats stats;
+    return stats;
+}
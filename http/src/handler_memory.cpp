@@ -0,0 +1,91 @@
+#include "../include/handler_memory.hpp"
+#include "../include/alloc_stats.hpp"
+#include <new>
+
+namespace {
+
+/// Each block starts with its capacity, padded so the memory after it stays aligned.
+constexpr std::size_t header_size = alignof(std::max_align_t);
+
+} // namespace
+
+handler_memory::~handler_memory()
+{
+    release();
+}
+
+/**
+ * @brief Returns a cached block of at least `size` bytes, or a new one.
+ *
+ * The smallest cached block that fits is used.
+ *
+ * @param size Bytes needed.
+ * @return The memory, aligned for any fundamental type.
+ */
+void* handler_memory::allocate(std::size_t size)
+{
+    block* best = nullptr;
+    for (auto& cached : free_) {
+        if (cached.data && cached.size >= size && (!best || cached.size < best->size)) {
+            best = &cached;
+        }
+    }
+
+    if (best) {
+        void* data = best->data;
+        *best = block{};
+        heap_allocation_stats().count_handler_allocation(true);
+        return data;
+    }
+
+    heap_allocation_stats().count_handler_allocation(false);
+    auto* raw = static_cast<unsigned char*>(::operator new(header_size + size));
+    *reinterpret_cast<std::size_t*>(raw) = size;
+    return raw + header_size;
+}
+
+/**
+ * @brief Keeps the block for reuse, or frees it if the cache is full.
+ *
+ * A full cache swaps out its smallest block if the returned one is larger.
+ *
+ * @param pointer Memory returned by allocate().
+ */
+void handler_memory::deallocate(void* pointer)
+{
+    auto* raw = static_cast<unsigned char*>(pointer) - header_size;
+    block returned{pointer, *reinterpret_cast<std::size_t*>(raw)};
+
+    block* slot = nullptr;
+    for (auto& cached : free_) {
+        if (!cached.data) {
+            slot = &cached;
+            break;
+        }
+        if (cached.size < returned.size && (!slot || cached.size < slot->size)) {
+            slot = &cached;
+        }
+    }
+
+    if (!slot) {
+        ::operator delete(raw);
+        return;
+    }
+    if (slot->data) {
+        ::operator delete(static_cast<unsigned char*>(slot->data) - header_size);
+    }
+    *slot = returned;
+}
+
+/**
+ * @brief Frees the cached blocks, e.g. while the session is idle.
+ */
+void handler_memory::release()
+{
+    for (auto& cached : free_) {
+        if (cached.data) {
+            ::operator delete(static_cast<unsigned char*>(cached.data) - header_size);
+            cached = block{};
+        }
+    }
+}
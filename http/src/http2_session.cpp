@@ -0,0 +1,601 @@
+#include "../include/http2_session.hpp"
+
+#ifdef WITH_HTTP2
+
+#include "../include/connection_stats.hpp"
+#include "../include/http_tools.hpp"
+#include "../include/utils.hpp"
+#include "../../log/include/log.hpp"
+#include <algorithm>
+#include <cctype>
+#include <utility>
+#include <vector>
+
+namespace {
+
+/// Connection-specific fields HTTP/2 forbids; their meaning is carried by the framing.
+bool is_connection_field(beast::string_view name)
+{
+    return beast::iequals(name, "connection") || beast::iequals(name, "keep-alive") ||
+           beast::iequals(name, "proxy-connection") || beast::iequals(name, "transfer-encoding") ||
+           beast::iequals(name, "upgrade");
+}
+
+nghttp2_nv make_nv(const std::string& name, const std::string& value)
+{
+    return nghttp2_nv{
+        reinterpret_cast<uint8_t*>(const_cast<char*>(name.data())),
+        reinterpret_cast<uint8_t*>(const_cast<char*>(value.data())),
+        name.size(), value.size(), NGHTTP2_NV_FLAG_NONE};
+}
+
+} // namespace
+
+/**
+ * @brief The status, header and body of a response produced by the request handlers.
+ *
+ * The handlers hand back an http::message_generator, which serializes an HTTP/1.1
+ * message. This parser reads it back as it is generated: the header becomes the
+ * HEADERS frame and the body is handed to nghttp2 piece by piece, so a file body is
+ * still streamed instead of loaded whole.
+ */
+class http2_session::response_source : public http::basic_parser<false>
+{
+public:
+    int status = 0;
+    std::vector<std::pair<std::string, std::string>> fields;  // Lowercase names, connection fields removed
+
+    response_source(http::message_generator&& msg, bool head)
+        : msg_(std::move(msg))
+    {
+        body_limit(boost::none);
+        if (head) {
+            skip(true);  // Content-Length describes the GET response; no body follows
+        }
+    }
+
+    /**
+     * @brief Parses the serialized message until its header is complete.
+     */
+    bool read_header(beast::error_code& ec)
+    {
+        while (!is_header_done()) {
+            if (!pump(ec)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Whether the whole body has been handed out.
+     */
+    bool finished() const
+    {
+        return is_done() && body_.size() == 0;
+    }
+
+    /**
+     * @brief Copies up to `length` bytes of the body.
+     *
+     * @param eof Set once the body is complete.
+     * @return The number of bytes copied.
+     */
+    std::size_t read(uint8_t* out, std::size_t length, bool& eof, beast::error_code& ec)
+    {
+        while (body_.size() == 0 && !is_done()) {
+            if (!pump(ec)) {
+                return 0;
+            }
+        }
+        auto n = net::buffer_copy(net::buffer(out, length), body_.data());
+        body_.consume(n);
+        eof = finished();
+        return n;
+    }
+
+private:
+    http::message_generator msg_;
+    beast::flat_buffer in_;  // Serialized bytes not parsed yet
+    beast::flat_buffer body_;  // Parsed body bytes not sent yet
+
+    /// Parses what is buffered, or generates more; always makes progress or fails.
+    bool pump(beast::error_code& ec)
+    {
+        if (in_.size() > 0) {
+            auto used = put(in_.data(), ec);
+            if (ec == http::error::need_more) {
+                ec = {};
+            }
+            if (ec) {
+                return false;
+            }
+            in_.consume(used);
+            if (used > 0) {
+                return true;
+            }
+        }
+
+        if (msg_.is_done()) {
+            put_eof(ec);  // A body delimited by the end of the message
+            return !ec && is_done();
+        }
+
+        auto buffers = msg_.prepare(ec);
+        if (ec) {
+            return false;
+        }
+        auto n = net::buffer_copy(in_.prepare(net::buffer_size(buffers)), buffers);
+        in_.commit(n);
+        msg_.consume(n);
+        return true;
+    }
+
+    void on_request_impl(http::verb, beast::string_view, beast::string_view, int, beast::error_code&) override
+    {
+    }
+
+    void on_response_impl(int code, beast::string_view, int, beast::error_code&) override
+    {
+        status = code;
+    }
+
+    void on_field_impl(http::field, beast::string_view name, beast::string_view value, beast::error_code&) override
+    {
+        if (is_connection_field(name)) {
+            return;
+        }
+        std::string lower(name);
+        std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+        fields.emplace_back(std::move(lower), std::string(value));
+    }
+
+    void on_header_impl(beast::error_code&) override
+    {
+    }
+
+    void on_body_init_impl(boost::optional<std::uint64_t> const&, beast::error_code&) override
+    {
+    }
+
+    std::size_t on_body_impl(beast::string_view body, beast::error_code&) override
+    {
+        body_.commit(net::buffer_copy(body_.prepare(body.size()), net::buffer(body.data(), body.size())));
+        return body.size();
+    }
+
+    void on_chunk_header_impl(std::uint64_t, beast::string_view, beast::error_code&) override
+    {
+    }
+
+    std::size_t on_chunk_body_impl(std::uint64_t, beast::string_view body, beast::error_code& ec) override
+    {
+        return on_body_impl(body, ec);
+    }
+
+    void on_finish_impl(beast::error_code&) override
+    {
+    }
+};
+
+/**
+ * @brief Takes over a TLS stream whose handshake selected h2.
+ *
+ * @param stream The TLS stream, after the handshake.
+ * @param buffer Bytes already read from the connection past the handshake.
+ * @param doc_root The document root directory for serving files.
+ * @param app The application serving the API.
+ */
+http2_session::http2_session(
+        beast::ssl_stream<beast::tcp_stream>&& stream,
+        beast::flat_buffer buffer,
+        std::shared_ptr<std::string const> const& doc_root,
+        std::shared_ptr<Application> app)
+    : stream_(std::move(stream))
+    , buffer_(std::move(buffer))
+    , doc_root_(doc_root)
+    , app_(std::move(app))
+{
+    session_connection_stats().opened(connection_protocol::h2);
+    auto logger = LoggerManager::getLogger("session_logger", LogLevel::INFO);
+    logger->log(LogLevel::DEBUG, "HTTP/2 session created.");
+}
+
+http2_session::~http2_session()
+{
+    if (session_) {
+        nghttp2_session_del(session_);
+    }
+    session_connection_stats().closed(connection_protocol::h2);
+}
+
+/**
+ * @brief Sends the server preface and starts reading frames.
+ */
+void http2_session::run()
+{
+    net::dispatch(
+            stream_.get_executor(),
+            beast::bind_front_handler(
+                &http2_session::on_run,
+                shared_from_this()));
+}
+
+void http2_session::on_run()
+{
+    auto logger = LoggerManager::getLogger("session_logger");
+
+    nghttp2_session_callbacks* callbacks = nullptr;
+    if (nghttp2_session_callbacks_new(&callbacks) != 0) {
+        logger->log(LogLevel::ERROR, "Cannot allocate HTTP/2 callbacks.");
+        return do_close();
+    }
+    nghttp2_session_callbacks_set_on_begin_headers_callback(callbacks, &http2_session::on_begin_headers);
+    nghttp2_session_callbacks_set_on_header_callback(callbacks, &http2_session::on_header);
+    nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, &http2_session::on_data_chunk);
+    nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, &http2_session::on_frame_recv);
+    nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, &http2_session::on_stream_close);
+
+    int rv = nghttp2_session_server_new(&session_, callbacks, this);
+    nghttp2_session_callbacks_del(callbacks);
+    if (rv != 0) {
+        logger->log(LogLevel::ERROR, std::string("Cannot create HTTP/2 session: ") + nghttp2_strerror(rv));
+        return do_close();
+    }
+
+    nghttp2_settings_entry settings[] = {
+        {NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, max_concurrent_streams},
+        {NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, initial_window_size},
+    };
+    nghttp2_submit_settings(session_, NGHTTP2_FLAG_NONE, settings, sizeof(settings) / sizeof(settings[0]));
+
+    // The client preface may already have arrived with the end of the handshake
+    bool usable = receive();
+    do_write();
+    if (usable) {
+        do_read();
+    }
+}
+
+/**
+ * @brief Feeds the bytes in buffer_ to nghttp2; false once the connection is unusable.
+ */
+bool http2_session::receive()
+{
+    if (buffer_.size() == 0) {
+        return true;
+    }
+
+    receiving_ = true;
+    auto data = buffer_.data();
+    ssize_t rv = nghttp2_session_mem_recv(session_, static_cast<const uint8_t*>(data.data()), data.size());
+    receiving_ = false;
+    buffer_.consume(buffer_.size());
+
+    if (rv < 0) {
+        auto logger = LoggerManager::getLogger("session_logger");
+        logger->log(LogLevel::ERROR, std::string("HTTP/2 protocol error: ") + nghttp2_strerror(static_cast<int>(rv)));
+        nghttp2_session_terminate_session(session_, NGHTTP2_PROTOCOL_ERROR);
+        return false;
+    }
+    return true;
+}
+
+void http2_session::do_read()
+{
+    if (closing_) {
+        return;
+    }
+
+    arm_timer();
+    stream_.async_read_some(
+            buffer_.prepare(16 * 1024),
+            beast::bind_front_handler(
+                &http2_session::on_read,
+                shared_from_this()));
+}
+
+void http2_session::on_read(beast::error_code ec, std::size_t bytes_transferred)
+{
+    if (closing_) {
+        return;
+    }
+
+    if (ec) {
+        if (ec != net::error::eof && ec != ssl::error::stream_truncated) {
+            fail(ec, "h2 read");
+        }
+        closing_ = true;
+        return;
+    }
+
+    buffer_.commit(bytes_transferred);
+    bool usable = receive();
+    do_write();
+    if (usable) {
+        do_read();
+    }
+}
+
+/**
+ * @brief Writes the frames nghttp2 has queued, or closes once neither side has more to say.
+ */
+void http2_session::do_write()
+{
+    if (writing_ || receiving_ || closing_) {
+        return;
+    }
+
+    write_buffer_.clear();
+    while (write_buffer_.size() < max_write_batch) {
+        const uint8_t* data = nullptr;
+        ssize_t n = nghttp2_session_mem_send(session_, &data);
+        if (n < 0) {
+            auto logger = LoggerManager::getLogger("session_logger");
+            logger->log(LogLevel::ERROR, std::string("HTTP/2 send error: ") + nghttp2_strerror(static_cast<int>(n)));
+            return do_close();
+        }
+        if (n == 0) {
+            break;
+        }
+        write_buffer_.append(reinterpret_cast<const char*>(data), static_cast<std::size_t>(n));
+    }
+
+    if (write_buffer_.empty()) {
+        if (!nghttp2_session_want_read(session_) && !nghttp2_session_want_write(session_)) {
+            do_close();
+        }
+        return;
+    }
+
+    writing_ = true;
+    beast::get_lowest_layer(stream_).expires_after(std::chrono::seconds(30));
+    net::async_write(
+            stream_,
+            net::buffer(write_buffer_),
+            beast::bind_front_handler(
+                &http2_session::on_write,
+                shared_from_this()));
+}
+
+void http2_session::on_write(beast::error_code ec, std::size_t bytes_transferred)
+{
+    boost::ignore_unused(bytes_transferred);
+    writing_ = false;
+
+    if (closing_) {
+        return;
+    }
+
+    if (ec) {
+        closing_ = true;
+        return fail(ec, "h2 write");
+    }
+
+    do_write();
+    arm_timer();
+}
+
+/**
+ * @brief Idle timeout while no stream is open, none while handlers are still working.
+ */
+void http2_session::arm_timer()
+{
+    if (writing_ || closing_) {
+        return;  // The write's own timeout applies
+    }
+
+    bool handling = std::any_of(streams_.begin(), streams_.end(), [](const auto& entry) {
+        return entry.second.dispatched && !entry.second.response;
+    });
+    if (handling) {
+        beast::get_lowest_layer(stream_).expires_never();
+    } else {
+        beast::get_lowest_layer(stream_).expires_after(std::chrono::seconds(60));
+    }
+}
+
+void http2_session::do_close()
+{
+    if (closing_) {
+        return;
+    }
+    closing_ = true;
+
+    auto logger = LoggerManager::getLogger("session_logger");
+    logger->log(LogLevel::DEBUG, "Closing HTTP/2 session.");
+
+    beast::get_lowest_layer(stream_).expires_after(std::chrono::seconds(30));
+    stream_.async_shutdown(
+            beast::bind_front_handler(
+                &http2_session::on_shutdown,
+                shared_from_this()));
+}
+
+void http2_session::on_shutdown(beast::error_code ec)
+{
+    if (ec) {
+        return fail(ec, "h2 shutdown");
+    }
+}
+
+/**
+ * @brief Hands a complete request to the request handlers.
+ */
+void http2_session::dispatch(int32_t stream_id, stream_state& state)
+{
+    state.dispatched = true;
+    state.head = state.req.method() == http::verb::head;
+    if (!state.req.body().empty()) {
+        state.req.prepare_payload();
+    }
+
+    async_handle_request(*doc_root_, std::move(state.req), app_, stream_.get_executor(),
+            [self = shared_from_this(), stream_id](http::message_generator msg) {
+                self->on_response(stream_id, std::move(msg));
+            });
+}
+
+/**
+ * @brief Submits the response of a stream; dropped if the client reset the stream meanwhile.
+ */
+void http2_session::on_response(int32_t stream_id, http::message_generator&& msg)
+{
+    auto it = streams_.find(stream_id);
+    if (closing_ || it == streams_.end()) {
+        return;
+    }
+
+    auto logger = LoggerManager::getLogger("session_logger");
+    auto source = std::make_unique<response_source>(std::move(msg), it->second.head);
+    beast::error_code ec;
+    if (!source->read_header(ec)) {
+        logger->log(LogLevel::ERROR, "Cannot serialize HTTP/2 response: " + ec.message());
+        nghttp2_submit_rst_stream(session_, NGHTTP2_FLAG_NONE, stream_id, NGHTTP2_INTERNAL_ERROR);
+        return do_write();
+    }
+
+    std::string status = std::to_string(source->status);
+    static const std::string status_name = ":status";
+    std::vector<nghttp2_nv> nva;
+    nva.reserve(source->fields.size() + 1);
+    nva.push_back(make_nv(status_name, status));
+    for (const auto& field : source->fields) {
+        nva.push_back(make_nv(field.first, field.second));
+    }
+
+    // nghttp2 copies the header block; the body is pulled through read_body as the flow control windows allow
+    int rv;
+    if (source->finished()) {
+        rv = nghttp2_submit_response(session_, stream_id, nva.data(), nva.size(), nullptr);
+    } else {
+        nghttp2_data_provider provider;
+        provider.source.ptr = source.get();
+        provider.read_callback = &http2_session::read_body;
+        it->second.response = std::move(source);
+        rv = nghttp2_submit_response(session_, stream_id, nva.data(), nva.size(), &provider);
+    }
+    if (rv != 0) {
+        logger->log(LogLevel::ERROR, std::string("Cannot submit HTTP/2 response: ") + nghttp2_strerror(rv));
+        nghttp2_submit_rst_stream(session_, NGHTTP2_FLAG_NONE, stream_id, NGHTTP2_INTERNAL_ERROR);
+    }
+
+    do_write();
+    arm_timer();
+}
+
+int http2_session::on_begin_headers(nghttp2_session*, const nghttp2_frame* frame, void* user_data)
+{
+    if (frame->hd.type != NGHTTP2_HEADERS || frame->headers.cat != NGHTTP2_HCAT_REQUEST) {
+        return 0;
+    }
+
+    auto* self = static_cast<http2_session*>(user_data);
+    auto& state = self->streams_[frame->hd.stream_id];
+    state.req.version(11);
+    return 0;
+}
+
+int http2_session::on_header(nghttp2_session*, const nghttp2_frame* frame, const uint8_t* name, std::size_t namelen,
+                             const uint8_t* value, std::size_t valuelen, uint8_t, void* user_data)
+{
+    if (frame->hd.type != NGHTTP2_HEADERS || frame->headers.cat != NGHTTP2_HCAT_REQUEST) {
+        return 0;
+    }
+
+    auto* self = static_cast<http2_session*>(user_data);
+    auto it = self->streams_.find(frame->hd.stream_id);
+    if (it == self->streams_.end()) {
+        return 0;
+    }
+
+    auto& req = it->second.req;
+    beast::string_view field(reinterpret_cast<const char*>(name), namelen);
+    beast::string_view text(reinterpret_cast<const char*>(value), valuelen);
+
+    // nghttp2 has already validated the pseudo-headers and rejected connection fields
+    if (field == ":method") {
+        req.method_string(text);
+    } else if (field == ":path") {
+        req.target(text);
+    } else if (field == ":authority") {
+        req.set(http::field::host, text);
+    } else if (field.starts_with(':')) {
+        return 0;  // :scheme
+    } else if (field == "cookie" && req.find(http::field::cookie) != req.end()) {
+        // HTTP/2 clients may split the cookie header; handlers expect it joined
+        req.set(http::field::cookie, std::string(req[http::field::cookie]) + "; " + std::string(text));
+    } else {
+        req.insert(field, text);
+    }
+    return 0;
+}
+
+int http2_session::on_data_chunk(nghttp2_session* session, uint8_t, int32_t stream_id, const uint8_t* data,
+                                 std::size_t len, void* user_data)
+{
+    auto* self = static_cast<http2_session*>(user_data);
+    auto it = self->streams_.find(stream_id);
+    if (it == self->streams_.end() || it->second.rejected) {
+        return 0;
+    }
+
+    auto& state = it->second;
+    if (state.body_limit == 0) {
+        state.body_limit = request_body_limit(state.req.method(), state.req.target());
+    }
+
+    auto& body = state.req.body();
+    if (body.size() + len > state.body_limit) {
+        auto logger = LoggerManager::getLogger("session_logger");
+        logger->log(LogLevel::ERROR, "HTTP/2 request body exceeds " + std::to_string(state.body_limit) + " bytes, resetting stream.");
+        state.rejected = true;
+        body.clear();
+        nghttp2_submit_rst_stream(session, NGHTTP2_FLAG_NONE, stream_id, NGHTTP2_CANCEL);
+        return 0;
+    }
+    body.append(reinterpret_cast<const char*>(data), len);
+    return 0;
+}
+
+int http2_session::on_frame_recv(nghttp2_session*, const nghttp2_frame* frame, void* user_data)
+{
+    if ((frame->hd.type != NGHTTP2_HEADERS && frame->hd.type != NGHTTP2_DATA) ||
+        !(frame->hd.flags & NGHTTP2_FLAG_END_STREAM)) {
+        return 0;
+    }
+
+    auto* self = static_cast<http2_session*>(user_data);
+    auto it = self->streams_.find(frame->hd.stream_id);
+    if (it != self->streams_.end() && !it->second.dispatched && !it->second.rejected) {
+        self->dispatch(frame->hd.stream_id, it->second);
+    }
+    return 0;
+}
+
+int http2_session::on_stream_close(nghttp2_session*, int32_t stream_id, uint32_t, void* user_data)
+{
+    auto* self = static_cast<http2_session*>(user_data);
+    self->streams_.erase(stream_id);
+    return 0;
+}
+
+ssize_t http2_session::read_body(nghttp2_session*, int32_t, uint8_t* buf, std::size_t length,
+                                 uint32_t* data_flags, nghttp2_data_source* source, void*)
+{
+    auto* response = static_cast<response_source*>(source->ptr);
+    bool eof = false;
+    beast::error_code ec;
+    std::size_t n = response->read(buf, length, eof, ec);
+    if (ec) {
+        auto logger = LoggerManager::getLogger("session_logger");
+        logger->log(LogLevel::ERROR, "Error reading HTTP/2 response body: " + ec.message());
+        return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;  // Resets just this stream
+    }
+    if (eof) {
+        *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+    }
+    return static_cast<ssize_t>(n);
+}
+
+#endif // WITH_HTTP2
@@ -1,4 +1,12 @@
 #include "../include/http_tools.hpp"
+#include "../include/alloc_stats.hpp"
+#include "../include/asset_cache.hpp"
+#include "../include/connection_stats.hpp"
+#include "../include/file_range_body.hpp"
+#include "../include/request_arena.hpp"
+#include "../include/router.hpp"
+#include "../include/session_pool.hpp"
+#include "../include/tls_stats.hpp"
 #include "../include/utils.hpp"
 #include "../../log/include/log.hpp"
 #include <boost/asio/dispatch.hpp>
@@ -7,10 +15,19 @@
 #include <boost/beast/http.hpp>
 #include <boost/beast/ssl.hpp>
 #include <boost/beast/version.hpp>
+#include <sys/stat.h>
+#include <atomic>
+#include <charconv>
 #include <string>
 
 LogLevel http_log_level = LogLevel::DEBUG;
 
+/// Request body limit of routes that do not set their own; see set_default_body_limit().
+std::atomic<std::size_t> default_body_limit{8 * 1024 * 1024};
+
+/// Bodies larger than this are handled on the blocking pool, whatever the route.
+constexpr std::size_t inline_body_bytes = 64 * 1024;
+
 /**
  * @brief Send an HTTP response with the given status and body.
  * 
@@ -95,8 +112,6 @@ http::message_generator handle_json_data_request(
  * @param req The POST request object.
  * @param logger A shared pointer to the logger used for logging.
  * @return The HTTP response as a message generator.
- *
- * @problem response times out if message is too big
  */
 template <class Body, class Allocator>
 http::message_generator handle_post_request(
@@ -113,14 +128,30 @@ http::message_generator handle_post_request(
             logger->log(LogLevel::DEBUG, "Received LLM message: " + message);
 
             // Handle context if provided
-            ollama::response context;
+            std::vector<int32_t> context;
             if (json_obj.contains("context")) {
-                context = ollama::response(json_obj["context"].dump());
-                logger->log(LogLevel::DEBUG, "Received context for LLM.");
+                context = parse_context_tokens(json_obj["context"]);
+                logger->log(LogLevel::DEBUG, "Received context for LLM (" + std::to_string(context.size()) + " tokens).");
+            }
+
+            // Chat turns of a conversation are kept within the model's context window by the application
+            std::string conversation_id;
+            if (json_obj.contains("conversation_id")) {
+                conversation_id = json_obj["conversation_id"].template get<std::string>();
+            }
+
+            // Optionally POST the final result to a callback URL instead of being polled
+            std::string callback_url;
+            if (json_obj.contains("callback_url")) {
+                callback_url = json_obj["callback_url"].template get<std::string>();
+                url_parts url;
+                if (!parse_url(callback_url, url)) {
+                    return send_(req, http::status::bad_request, R"({"error": "'callback_url' must be an https:// URL."})");
+                }
             }
 
             // Add the query with context to the queue and get the query ID
-            std::string query_id = app->add_query(message, context);
+            std::string query_id = app->add_query(message, std::move(context), conversation_id, nullptr, callback_url);
 
             nlohmann::json response_json;
             response_json["query_id"] = query_id;
@@ -142,6 +173,491 @@ http::message_generator handle_post_request(
 
 
 
+/**
+ * @brief Convert one element of a bulk submission into a batch item.
+ *
+ * An element is either a plain prompt string or an object shaped like the body of POST /.
+ *
+ * @param value The JSON element.
+ * @param item Receives the prompt, context, conversation ID and callback URL.
+ * @return False if the element does not contain a prompt or its callback URL is not an https:// URL.
+ */
+inline bool parse_batch_item(const nlohmann::json& value, BatchItem& item)
+{
+    if (value.is_string()) {
+        item.prompt = value.get<std::string>();
+        return true;
+    }
+    if (!value.is_object()) {
+        return false;
+    }
+
+    auto message = value.find("message");
+    if (message == value.end() || !message->is_string()) {
+        message = value.find("prompt");
+    }
+    if (message == value.end() || !message->is_string()) {
+        return false;
+    }
+
+    item.prompt = message->get<std::string>();
+    if (value.contains("context")) {
+        item.context = parse_context_tokens(value["context"]);
+    }
+    if (value.contains("conversation_id") && value["conversation_id"].is_string()) {
+        item.conversation_id = value["conversation_id"].get<std::string>();
+    }
+    if (value.contains("callback_url")) {
+        url_parts url;
+        if (!value["callback_url"].is_string() || !parse_url(value["callback_url"].get<std::string>(), url)) {
+            return false;
+        }
+        item.callback_url = value["callback_url"].get<std::string>();
+    }
+    return true;
+}
+
+/**
+ * @brief Handle an HTTP POST request submitting many prompts at once.
+ *
+ * The body is either a JSON array or NDJSON (one JSON value per line). Each element is
+ * a prompt string or an object with a 'message' (or 'prompt') field and optional
+ * 'context' and 'conversation_id'. All prompts are queued in one go.
+ *
+ * @param req The POST request object.
+ * @param app A shared pointer to the Application.
+ * @return The batch ID and the query ID of every item, in order.
+ */
+template <class Body, class Allocator>
+http::message_generator handle_batch_request(
+    http::request<Body, http::basic_fields<Allocator>>&& req,
+    std::shared_ptr<Application> app)
+{
+    auto logger = LoggerManager::getLogger("http_tools_logger", http_log_level);
+    const auto& body = req.body();
+
+    std::vector<BatchItem> items;
+    std::size_t index = 0;
+    try {
+        auto first = body.find_first_not_of(" \t\r\n");
+        if (first != std::string::npos && body[first] == '[') {
+            auto array = nlohmann::json::parse(body);
+            items.reserve(array.size());
+            for (const auto& value : array) {
+                BatchItem item;
+                if (!parse_batch_item(value, item)) {
+                    return send_(req, http::status::bad_request,
+                                 R"({"error": "Missing prompt or non-https 'callback_url' in batch item )" + std::to_string(index) + "\"}");
+                }
+                items.push_back(std::move(item));
+                ++index;
+            }
+        } else {
+            std::size_t pos = 0;
+            while (pos < body.size()) {
+                auto end = body.find('\n', pos);
+                if (end == std::string::npos) {
+                    end = body.size();
+                }
+                auto line = beast::string_view(body.data() + pos, end - pos);
+                pos = end + 1;
+                if (line.find_first_not_of(" \t\r") == beast::string_view::npos) {
+                    continue;
+                }
+
+                BatchItem item;
+                if (!parse_batch_item(nlohmann::json::parse(line.begin(), line.end()), item)) {
+                    return send_(req, http::status::bad_request,
+                                 R"({"error": "Missing prompt or non-https 'callback_url' in batch item )" + std::to_string(index) + "\"}");
+                }
+                items.push_back(std::move(item));
+                ++index;
+            }
+        }
+    } catch (const nlohmann::json::exception& e) {
+        logger->log(LogLevel::ERROR, "JSON parsing exception in batch item " + std::to_string(index) + ": " + std::string(e.what()));
+        return send_(req, http::status::bad_request,
+                     R"({"error": "Invalid JSON format in batch item )" + std::to_string(index) + "\"}");
+    }
+
+    if (items.empty()) {
+        return send_(req, http::status::bad_request, R"({"error": "Empty batch."})");
+    }
+
+    std::vector<std::string> query_ids;
+    std::string batch_id = app->add_batch(std::move(items), query_ids);
+    logger->log(LogLevel::DEBUG, "Queued batch " + batch_id + " with " + std::to_string(query_ids.size()) + " queries.");
+
+    nlohmann::json response_json;
+    response_json["batch_id"] = batch_id;
+    response_json["query_ids"] = query_ids;
+    response_json["status"] = "Batch added to the queue";
+
+    return send_(req, http::status::ok, response_json.dump(), "application/json");
+}
+
+/**
+ * @brief Handle an HTTP GET request for the progress of a batch (/batch_status/{batch_id}).
+ *
+ * @param req The GET request object.
+ * @param app A shared pointer to the Application.
+ * @param batch_id The batch ID captured from the path.
+ * @return The HTTP response as a message generator.
+ */
+template <class Body, class Allocator>
+http::message_generator handle_batch_status_request(
+    http::request<Body, http::basic_fields<Allocator>>&& req,
+    std::shared_ptr<Application> app,
+    const std::string& batch_id)
+{
+    std::string status = app->get_batch_status(batch_id);
+    auto result = status.find("\"error\"") == std::string::npos ? http::status::ok : http::status::not_found;
+    return send_(req, result, status, "application/json");
+}
+
+/**
+ * @brief Handle an HTTP GET request for the status of a query (/query_status/{query_id}).
+ *
+ * @param req The GET request object.
+ * @param app A shared pointer to the Application.
+ * @param query_id The query ID captured from the path.
+ * @return The HTTP response as a message generator.
+ */
+template <class Body, class Allocator>
+http::message_generator handle_query_status_request(
+    http::request<Body, http::basic_fields<Allocator>>&& req,
+    std::shared_ptr<Application> app,
+    const std::string& query_id)
+{
+    auto logger = LoggerManager::getLogger("http_tools_logger", http_log_level);
+    logger->log(LogLevel::DEBUG, "Query status request for query_id: " + query_id);
+
+    // Get the status from the Application
+    std::string status = app->get_query_status(query_id);
+
+    // Create a JSON response with the query status
+    nlohmann::json response_json;
+    response_json["query_id"] = query_id;
+    response_json["status"] = status;
+
+    // Send the JSON response back to the client
+    return send_(req, http::status::ok, response_json.dump(), "application/json");
+}
+
+/**
+ * @brief Whether an Accept-Encoding header accepts a content coding with a non-zero q-value.
+ */
+inline bool accepts_encoding(beast::string_view header, beast::string_view coding)
+{
+    while (!header.empty()) {
+        auto comma = header.find(',');
+        beast::string_view item = header.substr(0, comma);
+        header = comma == beast::string_view::npos ? beast::string_view() : header.substr(comma + 1);
+
+        auto semicolon = item.find(';');
+        beast::string_view name = item.substr(0, semicolon);
+        while (!name.empty() && name.front() == ' ') name.remove_prefix(1);
+        while (!name.empty() && name.back() == ' ') name.remove_suffix(1);
+        if (!beast::iequals(name, coding)) {
+            continue;
+        }
+
+        if (semicolon == beast::string_view::npos) {
+            return true;
+        }
+        auto q = item.find("q=", semicolon);
+        return q == beast::string_view::npos || std::atof(std::string(item.substr(q + 2)).c_str()) > 0.0;
+    }
+    return false;
+}
+
+/**
+ * @brief Whether an If-None-Match header matches an entity tag (weak comparison).
+ */
+inline bool etag_matches(beast::string_view header, beast::string_view etag)
+{
+    while (!header.empty()) {
+        auto comma = header.find(',');
+        beast::string_view tag = header.substr(0, comma);
+        header = comma == beast::string_view::npos ? beast::string_view() : header.substr(comma + 1);
+
+        while (!tag.empty() && tag.front() == ' ') tag.remove_prefix(1);
+        while (!tag.empty() && tag.back() == ' ') tag.remove_suffix(1);
+        if (tag.starts_with("W/")) {
+            tag.remove_prefix(2);
+        }
+        if (tag == "*" || tag == etag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Serve a file from the asset cache, honouring Accept-Encoding and conditional headers.
+ *
+ * Picks the Brotli, gzip or identity variant, answers a matching If-None-Match (or, without
+ * one, If-Modified-Since) with 304, and otherwise sends the bytes straight from memory.
+ *
+ * @param req The GET or HEAD request.
+ * @param cached The cached file.
+ * @return The HTTP response as a message generator.
+ */
+template <class Body, class Allocator>
+http::message_generator handle_cached_asset(
+    const http::request<Body, http::basic_fields<Allocator>>& req,
+    std::shared_ptr<const asset> cached)
+{
+    // Use the smallest variant the client accepts; each one has its own strong ETag.
+    beast::string_view accept = req[http::field::accept_encoding];
+    const std::string* data = &cached->identity;
+    beast::string_view encoding;
+    std::string etag = cached->etag;
+    if (!cached->brotli.empty() && accepts_encoding(accept, "br")) {
+        data = &cached->brotli;
+        encoding = "br";
+    } else if (!cached->gzip.empty() && accepts_encoding(accept, "gzip")) {
+        data = &cached->gzip;
+        encoding = "gzip";
+    }
+    if (!encoding.empty()) {
+        etag.insert(etag.size() - 1, encoding == "br" ? "-br" : "-gz");
+    }
+
+    auto set_headers = [&](auto& res) {
+        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.set(http::field::content_type, cached->content_type);
+        res.set(http::field::etag, etag);
+        res.set(http::field::last_modified, cached->last_modified);
+        res.set(http::field::cache_control, "no-cache");
+        res.set(http::field::vary, "Accept-Encoding");
+        res.set(http::field::accept_ranges, "bytes");
+        if (!encoding.empty()) {
+            res.set(http::field::content_encoding, encoding);
+        }
+        res.keep_alive(req.keep_alive());
+    };
+
+    beast::string_view if_none_match = req[http::field::if_none_match];
+    bool not_modified = !if_none_match.empty()
+        ? etag_matches(if_none_match, etag)
+        : req[http::field::if_modified_since] == cached->last_modified;
+
+    if (not_modified) {
+        http::response<http::empty_body> res{http::status::not_modified, req.version()};
+        set_headers(res);
+        return res;
+    }
+
+    if (req.method() == http::verb::head) {
+        http::response<http::empty_body> res{http::status::ok, req.version()};
+        set_headers(res);
+        res.content_length(data->size());
+        return res;
+    }
+
+    http::response<asset_body> res{
+        std::piecewise_construct,
+        std::make_tuple(asset_body::value_type{cached, beast::string_view(*data)}),
+        std::make_tuple(http::status::ok, req.version())
+    };
+    set_headers(res);
+    res.content_length(data->size());
+    return res;
+}
+
+/**
+ * @brief Format a number as lowercase hexadecimal.
+ */
+inline std::string to_hex(std::uint64_t value)
+{
+    char buffer[17];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value, 16);
+    return std::string(buffer, result.ptr);
+}
+
+/// Outcome of parsing a Range header against a file size.
+enum class range_outcome { ignore, satisfiable, unsatisfiable };
+
+/**
+ * @brief Parse a "bytes=" Range header into inclusive byte ranges within `size`.
+ *
+ * Malformed headers, other units and more than 16 ranges are ignored, so the whole
+ * file is sent. Ranges starting past the end are dropped; if none remain the
+ * request is unsatisfiable.
+ *
+ * @param header The Range header value.
+ * @param size Size of the file.
+ * @param ranges Receives the [first, last] pairs in request order.
+ * @return Whether to send the ranges, the whole file or 416.
+ */
+inline range_outcome parse_byte_ranges(beast::string_view header, std::uint64_t size,
+                                       std::vector<std::pair<std::uint64_t, std::uint64_t>>& ranges)
+{
+    constexpr std::size_t max_ranges = 16;
+
+    auto parse_number = [](beast::string_view text, std::uint64_t& value) {
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        return !text.empty() && result.ec == std::errc() && result.ptr == text.data() + text.size();
+    };
+
+    ranges.clear();
+    if (!header.starts_with("bytes=")) {
+        return range_outcome::ignore;
+    }
+    header.remove_prefix(6);
+
+    while (!header.empty()) {
+        auto comma = header.find(',');
+        beast::string_view item = header.substr(0, comma);
+        header = comma == beast::string_view::npos ? beast::string_view() : header.substr(comma + 1);
+
+        while (!item.empty() && item.front() == ' ') item.remove_prefix(1);
+        while (!item.empty() && item.back() == ' ') item.remove_suffix(1);
+        auto dash = item.find('-');
+        if (dash == beast::string_view::npos) {
+            return range_outcome::ignore;
+        }
+
+        std::uint64_t first, last;
+        if (dash == 0) {
+            // Suffix range: the last N bytes
+            std::uint64_t suffix;
+            if (!parse_number(item.substr(1), suffix)) {
+                return range_outcome::ignore;
+            }
+            if (suffix == 0 || size == 0) {
+                continue;
+            }
+            first = size > suffix ? size - suffix : 0;
+            last = size - 1;
+        } else {
+            if (!parse_number(item.substr(0, dash), first)) {
+                return range_outcome::ignore;
+            }
+            last = size > 0 ? size - 1 : 0;
+            if (dash + 1 < item.size() && !parse_number(item.substr(dash + 1), last)) {
+                return range_outcome::ignore;
+            }
+            if (last < first) {
+                return range_outcome::ignore;
+            }
+            if (first >= size) {
+                continue;
+            }
+            last = std::min(last, size - 1);
+        }
+
+        ranges.emplace_back(first, last);
+        if (ranges.size() > max_ranges) {
+            ranges.clear();
+            return range_outcome::ignore;
+        }
+    }
+
+    return ranges.empty() ? range_outcome::unsatisfiable : range_outcome::satisfiable;
+}
+
+/**
+ * @brief Serve a Range request for a file from disk.
+ *
+ * Sends 206 with one range, or multipart/byteranges with several, streaming each range
+ * through file_range_body. An If-Range that no longer matches the ETag or Last-Modified
+ * date, or a Range header that cannot be used, gets the whole file with 200; a Range
+ * entirely past the end of the file gets 416.
+ *
+ * @param req The GET request carrying a Range header.
+ * @param path Path of the file.
+ * @param cached The file's asset cache entry, whose ETag is reused; may be nullptr.
+ * @return The HTTP response as a message generator.
+ */
+template <class Body, class Allocator>
+http::message_generator handle_range_request(
+    const http::request<Body, http::basic_fields<Allocator>>& req,
+    const std::string& path,
+    std::shared_ptr<const asset> cached)
+{
+    auto logger = LoggerManager::getLogger("http_tools_logger", http_log_level);
+
+    beast::error_code ec;
+    file_range_body::value_type body;
+    body.open(path.c_str(), ec);
+    if (ec == beast::errc::no_such_file_or_directory) {
+        return send_(req, http::status::not_found, "The resource was not found.");
+    }
+    if (ec) {
+        logger->log(LogLevel::ERROR, "Error opening file: " + ec.message());
+        return send_(req, http::status::internal_server_error, "Error: " + ec.message());
+    }
+
+    struct stat info{};
+    std::uint64_t size = body.file_size(ec);
+    if (ec || ::fstat(body.file().native_handle(), &info) != 0) {
+        return send_(req, http::status::internal_server_error, "Error: cannot stat file.");
+    }
+
+    std::string etag = cached ? cached->etag : "\"" + to_hex(size) + "-" + to_hex(info.st_mtime) + "\"";
+    std::string last_modified = http_date(info.st_mtime);
+
+    // Only send ranges of the representation the client already has
+    beast::string_view if_range = req[http::field::if_range];
+    std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges;
+    range_outcome outcome = range_outcome::ignore;
+    if (if_range.empty() || if_range == etag || if_range == last_modified) {
+        outcome = parse_byte_ranges(req[http::field::range], size, ranges);
+    }
+
+    if (outcome == range_outcome::unsatisfiable) {
+        http::response<http::string_body> res{http::status::range_not_satisfiable, req.version()};
+        res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.set(http::field::content_range, "bytes */" + std::to_string(size));
+        res.keep_alive(req.keep_alive());
+        res.prepare_payload();
+        return res;
+    }
+
+    beast::string_view content_type = mime_type(path);
+    http::status status = http::status::partial_content;
+    std::string content_range;
+    std::string boundary;
+
+    if (outcome == range_outcome::ignore) {
+        status = http::status::ok;
+        body.set_whole(size);
+    } else if (ranges.size() == 1) {
+        body.set_range(ranges[0].first, ranges[0].second);
+        content_range = "bytes " + std::to_string(ranges[0].first) + "-" + std::to_string(ranges[0].second) +
+                        "/" + std::to_string(size);
+    } else {
+        boundary = "range_" + to_hex(std::hash<std::string>{}(path) ^
+                                     static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()));
+        body.set_ranges(ranges, size, content_type, boundary);
+    }
+
+    logger->log(LogLevel::DEBUG, "Range request for " + path + ": " + std::to_string(ranges.size()) + " range(s).");
+
+    http::response<file_range_body> res{
+        std::piecewise_construct,
+        std::make_tuple(std::move(body)),
+        std::make_tuple(status, req.version())
+    };
+    res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(http::field::accept_ranges, "bytes");
+    res.set(http::field::etag, etag);
+    res.set(http::field::last_modified, last_modified);
+    if (boundary.empty()) {
+        res.set(http::field::content_type, content_type);
+    } else {
+        res.set(http::field::content_type, "multipart/byteranges; boundary=" + boundary);
+    }
+    if (!content_range.empty()) {
+        res.set(http::field::content_range, content_range);
+    }
+    res.content_length(file_range_body::size(res.body()));
+    res.keep_alive(req.keep_alive());
+    return res;
+}
+
 /**
  * @brief Handle an HTTP GET request and serve the requested file.
  * 
@@ -163,25 +679,7 @@ http::message_generator handle_get_request(
         // Extract the target path
         std::string target = std::string(req.target());
 
-        // Check if the request is for querying the status of a query
-        if (target.rfind("/query_status/", 0) == 0) {
-            // Extract the query ID from the URL (e.g., /query_status/{query_id})
-            std::string query_id = target.substr(14);  // 14 is the length of "/query_status/"
-            logger->log(LogLevel::DEBUG, "Query status request for query_id: " + query_id);
-
-            // Get the status from the Application
-            std::string status = app->get_query_status(query_id);
-
-            // Create a JSON response with the query status
-            nlohmann::json response_json;
-            response_json["query_id"] = query_id;
-            response_json["status"] = status;
-
-            // Send the JSON response back to the client
-            return send_(req, http::status::ok, response_json.dump(), "application/json");
-        }
-
-        // If not a query status request, proceed with serving a file
+        // Serve the file below the document root
         std::string path = path_cat(doc_root, target);
         logger->log(LogLevel::DEBUG, "Computed path: " + path);
 
@@ -190,9 +688,19 @@ http::message_generator handle_get_request(
             logger->log(LogLevel::DEBUG, "Appended index.html to path: " + path);
         }
 
+        // Range requests stream the requested slices from disk
+        if (req.method() == http::verb::get && req.count(http::field::range) > 0) {
+            return handle_range_request(req, path, shared_asset_cache(doc_root).find(path));
+        }
+
+        // Small files come from memory; only files too large to cache are opened
+        if (auto cached = shared_asset_cache(doc_root).find(path)) {
+            return handle_cached_asset(req, std::move(cached));
+        }
+
         beast::error_code ec;
-        http::file_body::value_type body;
-        body.open(path.c_str(), beast::file_mode::scan, ec);
+        file_range_body::value_type body;
+        body.open(path.c_str(), ec, beast::file_mode::scan);
 
         if (ec == beast::errc::no_such_file_or_directory) {
             logger->log(LogLevel::DEBUG, "File not found: " + path);
@@ -204,7 +712,11 @@ http::message_generator handle_get_request(
             return send_(req, http::status::internal_server_error, "Error: " + ec.message());
         }
 
-        auto const size = body.size();
+        auto const size = body.file_size(ec);
+        if (ec) {
+            logger->log(LogLevel::ERROR, "Error reading file size: " + ec.message());
+            return send_(req, http::status::internal_server_error, "Error: " + ec.message());
+        }
         logger->log(LogLevel::DEBUG, "File opened successfully, size: " + std::to_string(size));
 
         if (req.method() == http::verb::head) {
@@ -218,12 +730,14 @@ http::message_generator handle_get_request(
         }
 
         logger->log(LogLevel::DEBUG, "GET request, preparing full response.");
-        http::response<http::file_body> res{
+        body.set_whole(size);
+        http::response<file_range_body> res{
             std::piecewise_construct,
             std::make_tuple(std::move(body)),
             std::make_tuple(http::status::ok, req.version())
         };
         res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.set(http::field::accept_ranges, "bytes");
         res.set(http::field::content_type, mime_type(path));
         res.content_length(size);
         res.keep_alive(req.keep_alive());
@@ -245,6 +759,18 @@ http::message_generator handle_performance_statistics_request(
     try {
         // Retrieve the performance statistics as JSON
         nlohmann::json stats_json = app->get_performance_statistics_json();
+        for (auto& stat : tls_handshake_stats().to_json()) {
+            stats_json.push_back(std::move(stat));
+        }
+        for (auto& stat : session_connection_stats().to_json()) {
+            stats_json.push_back(std::move(stat));
+        }
+        for (auto& stat : heap_allocation_stats().to_json()) {
+            stats_json.push_back(std::move(stat));
+        }
+        for (auto& stat : shared_session_pool().to_json()) {
+            stats_json.push_back(std::move(stat));
+        }
 
         // Send the JSON data as the response
         return send_(req, http::status::ok, stats_json.dump(), "application/json");
@@ -255,38 +781,118 @@ http::message_generator handle_performance_statistics_request(
 }
 
 /**
- * @brief Handle an HTTP request and generate an appropriate response.
- * 
- * This function routes the request to the appropriate handler based on the HTTP method.
- * 
- * @param doc_root The document root directory.
+ * @brief Per-request state handed to route handlers.
+ */
+struct request_context {
+    beast::string_view doc_root;  ///< The document root directory.
+    std::shared_ptr<Application> app;  ///< The application serving the API.
+};
+
+template <class Body, class Allocator>
+using api_router = router<http::request<Body, http::basic_fields<Allocator>>, request_context>;
+
+/**
+ * @brief Middleware recording the duration of a route under its own performance metric.
+ */
+template <class Body, class Allocator>
+typename api_router<Body, Allocator>::middleware record_metric(std::string metric_name)
+{
+    return [metric_name](http::request<Body, http::basic_fields<Allocator>>&& req, const route_params& params,
+                         request_context& ctx, const typename api_router<Body, Allocator>::handler& next) {
+        auto start_time = std::chrono::high_resolution_clock::now();
+        http::message_generator response = next(std::move(req), params, ctx);
+        auto duration = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::high_resolution_clock::now() - start_time).count();
+        ctx.app->log_performance_metric(metric_name, duration);
+        return response;
+    };
+}
+
+/**
+ * @brief The API routes, built once on first use.
+ *
+ * Requests that match no route fall back to static files (GET/HEAD) or 400.
+ */
+template <class Body, class Allocator>
+const api_router<Body, Allocator>& api_routes()
+{
+    using request_type = http::request<Body, http::basic_fields<Allocator>>;
+
+    static const api_router<Body, Allocator> routes = [] {
+        api_router<Body, Allocator> r;
+
+        r.add({http::verb::post}, "/",
+              [](request_type&& req, const route_params&, request_context& ctx) {
+                  return handle_post_request(std::move(req), ctx.app);
+              },
+              {}, false, 512 * 1024);
+
+        r.add({http::verb::get}, "/json_data",
+              [](request_type&& req, const route_params&, request_context& ctx) {
+                  return handle_json_data_request(std::move(req), ctx.app);
+              },
+              {}, true);
+
+        r.add({http::verb::post}, "/batch",
+              [](request_type&& req, const route_params&, request_context& ctx) {
+                  return handle_batch_request(std::move(req), ctx.app);
+              },
+              {record_metric<Body, Allocator>("Batch Submission Duration (µs)")});
+
+        r.add({http::verb::get}, "/batch_status/{batch_id}",
+              [](request_type&& req, const route_params& params, request_context& ctx) {
+                  return handle_batch_status_request(std::move(req), ctx.app, std::string(params["batch_id"]));
+              });
+
+        r.add({http::verb::get}, "/query_status/{query_id}",
+              [](request_type&& req, const route_params& params, request_context& ctx) {
+                  return handle_query_status_request(std::move(req), ctx.app, std::string(params["query_id"]));
+              });
+
+        r.add({http::verb::get}, "/performance_statistics",
+              [](request_type&& req, const route_params&, request_context& ctx) {
+                  return handle_performance_statistics_request(std::move(req), ctx.app);
+              },
+              {}, true);
+
+        return r;
+    }();
+
+    return routes;
+}
+
+/**
+ * @brief Run a request through its matched route, or the static file fallback.
+ *
+ * @param ctx The document root and application.
  * @param req The HTTP request object.
- * @param logger A shared pointer to the logger used for logging.
+ * @param match The matched route, or nullptr.
  * @return The HTTP response as a message generator.
  */
 template <class Body, class Allocator>
-http::message_generator handle_request(
-    beast::string_view doc_root,
-    boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>>&& req,
-    std::shared_ptr<Application> app) { 
+http::message_generator dispatch_request(
+    request_context& ctx,
+    http::request<Body, http::basic_fields<Allocator>>&& req,
+    const typename api_router<Body, Allocator>::match* match)
+{
     auto logger = LoggerManager::getLogger("http_tools_logger", http_log_level);
     logger->log(LogLevel::DEBUG, "Received request: " + std::string(req.method_string()) + " " + std::string(req.target()));
 
     auto process_start_time = std::chrono::high_resolution_clock::now();
 
     http::message_generator response = [&] {
-        if (req.method() == http::verb::post && req.target() == "/") {
-            logger->log(LogLevel::DEBUG, "Delegating to handle_post_request.");
-            return handle_post_request(std::move(req), app);
-        } else if (req.method() == http::verb::get && req.target() == "/json_data") {
-            logger->log(LogLevel::DEBUG, "Delegating to handle_json_data_request.");
-            return handle_json_data_request(std::move(req), app);
-        } else if (req.method() == http::verb::get && req.target() == "/performance_statistics") {
-            logger->log(LogLevel::DEBUG, "Delegating to handle_performance_statistics_request.");
-            return handle_performance_statistics_request(std::move(req), app);
+        // Sessions reject oversized bodies before reading them; this covers bodies of unknown length
+        std::size_t body_limit = match && match->matched->body_limit ? match->matched->body_limit : default_body_limit.load(std::memory_order_relaxed);
+        if (req.payload_size() && *req.payload_size() > body_limit) {
+            return payload_too_large(req, body_limit);
+        }
+
+        if (match) {
+            logger->log(LogLevel::DEBUG, "Routing to " + match->matched->pattern);
+            return match->matched->fn(std::move(req), match->params, ctx);
         } else if (req.method() == http::verb::get || req.method() == http::verb::head) {
             logger->log(LogLevel::DEBUG, "Delegating to handle_get_request.");
-            return handle_get_request(doc_root, std::move(req), app);
+            return handle_get_request(ctx.doc_root, std::move(req), ctx.app);
         } else {
             logger->log(LogLevel::DEBUG, "Unknown HTTP method, responding with bad request.");
             return send_(req, http::status::bad_request, "Unknown HTTP-method");
@@ -296,12 +902,118 @@ http::message_generator handle_request(
     auto process_end_time = std::chrono::high_resolution_clock::now();
     auto process_duration = std::chrono::duration_cast<std::chrono::microseconds>(process_end_time - process_start_time).count();
     logger->log(LogLevel::DEBUG, "Time to process request: " + std::to_string(process_duration) + " µs");
-    // Log the request processing time
-    app->log_performance_metric("Request Processing Duration (µs)", process_duration);
+    // Only buffered here; the application writes its metrics to SQLite in the background
+    ctx.app->log_performance_metric("Request Processing Duration (µs)", process_duration);
 
     return response;
 }
 
+/**
+ * @brief Handle an HTTP request and generate an appropriate response.
+ * 
+ * The request is matched against the API routes; anything else is served from the document root.
+ * 
+ * @param doc_root The document root directory.
+ * @param req The HTTP request object.
+ * @param app A shared pointer to the Application.
+ * @return The HTTP response as a message generator.
+ */
+template <class Body, class Allocator>
+http::message_generator handle_request(
+    beast::string_view doc_root,
+    boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>>&& req,
+    std::shared_ptr<Application> app) { 
+    request_context ctx{doc_root, std::move(app)};
+    typename api_router<Body, Allocator>::match match;
+    bool found = api_routes<Body, Allocator>().find(req.method(), req.target(), match);
+    return dispatch_request(ctx, std::move(req), found ? &match : nullptr);
+}
+
+/**
+ * @brief Handle an HTTP request and deliver the response asynchronously.
+ *
+ * Routes flagged as blocking (SQLite statistics, JSON file parsing) run on the blocking pool,
+ * all others are answered inline. Either way the response is passed to `done` on `ex`, the
+ * executor of the requesting session.
+ *
+ * @param doc_root The document root directory.
+ * @param req The HTTP request object.
+ * @param app A shared pointer to the Application.
+ * @param ex The executor of the session that received the request.
+ * @param done Callback receiving the response.
+ */
+template <class Body, class Allocator>
+void async_handle_request(
+    beast::string_view doc_root,
+    http::request<Body, http::basic_fields<Allocator>>&& req,
+    std::shared_ptr<Application> app,
+    net::any_io_executor ex,
+    response_callback done)
+{
+    auto logger = LoggerManager::getLogger("http_tools_logger", http_log_level);
+
+    request_context ctx{doc_root, std::move(app)};
+    typename api_router<Body, Allocator>::match match;
+    bool found = api_routes<Body, Allocator>().find(req.method(), req.target(), match);
+    // Parsing a large JSON body takes long enough to hold up the io thread's other connections
+    bool large_body = req.payload_size().value_or(0) > inline_body_bytes;
+    if (!found || (!match.matched->blocking && !large_body)) {
+        return done(dispatch_request(ctx, std::move(req), found ? &match : nullptr));
+    }
+
+    logger->log(LogLevel::DEBUG, "Offloading " + match.matched->pattern + " to the blocking pool.");
+    respond_async(ex, [req = std::move(req), ctx]() mutable {
+        // Match again: the captured parameters referred to the request before it was moved.
+        typename api_router<Body, Allocator>::match match;
+        api_routes<Body, Allocator>().find(req.method(), req.target(), match);
+        return dispatch_request(ctx, std::move(req), &match);
+    }, std::move(done));
+}
+
+/**
+ * @brief Sets the request body limit of routes that do not set their own.
+ *
+ * @param bytes Largest request body accepted.
+ */
+void set_default_body_limit(std::size_t bytes)
+{
+    default_body_limit.store(bytes, std::memory_order_relaxed);
+}
+
+/**
+ * @brief The largest request body accepted for a method and target.
+ *
+ * Sessions call this once the header has arrived, to reject an oversized body
+ * before reading it.
+ *
+ * @param method The request method.
+ * @param target The request target.
+ * @return The route's own limit, or the default one.
+ */
+std::size_t request_body_limit(http::verb method, beast::string_view target)
+{
+    api_router<http::string_body, std::allocator<char>>::match match;
+    if (api_routes<http::string_body, std::allocator<char>>().find(method, target, match) && match.matched->body_limit) {
+        return match.matched->body_limit;
+    }
+    return default_body_limit.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief The 413 response to a request whose body exceeds its limit.
+ *
+ * @param req The request; only its header is used.
+ * @param limit The limit that was exceeded.
+ * @return The HTTP response as a message generator.
+ */
+template <class Body, class Allocator>
+http::message_generator payload_too_large(
+    http::request<Body, http::basic_fields<Allocator>> const& req,
+    std::size_t limit)
+{
+    return send_(req, http::status::payload_too_large,
+                 R"({"error": "Request body exceeds )" + std::to_string(limit) + R"( bytes."})");
+}
 
 /**
  * @brief Determine the MIME type based on the file extension.
@@ -378,4 +1090,25 @@ template http::message_generator handle_request<http::string_body, std::allocato
     http::request<http::string_body, http::basic_fields<std::allocator<char>>>&& req,
     std::shared_ptr<Application> app);
 
+template http::message_generator payload_too_large<http::string_body, std::allocator<char>>(
+    http::request<http::string_body, http::basic_fields<std::allocator<char>>> const& req,
+    std::size_t limit);
 
+template void async_handle_request<http::string_body, std::allocator<char>>(
+    beast::string_view doc_root,
+    http::request<http::string_body, http::basic_fields<std::allocator<char>>>&& req,
+    std::shared_ptr<Application> app,
+    net::any_io_executor ex,
+    response_callback done);
+
+// Explicit template instantiation for requests read into a session's arena
+template http::message_generator payload_too_large<arena_string_body, arena_allocator<char>>(
+    arena_request const& req,
+    std::size_t limit);
+
+template void async_handle_request<arena_string_body, arena_allocator<char>>(
+    beast::string_view doc_root,
+    arena_request&& req,
+    std::shared_ptr<Application> app,
+    net::any_io_executor ex,
+    response_callback done);
@@ -0,0 +1,138 @@
+#include "../include/local_server.hpp"
+#include "../include/session.hpp"
+#include "../include/utils.hpp"
+#include <grp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+/**
+ * @brief Creates, binds and listens on the socket file with the requested permissions.
+ *
+ * A stale socket left by a previous run is removed; any other file at the path is
+ * left alone and reported as an error. The socket is created with no permissions
+ * for others, then chgrp'ed and chmod'ed, so it is never reachable by more users
+ * than configured.
+ *
+ * @param options Path and permissions.
+ * @param logger Logger for errors.
+ * @return The listening descriptor, or -1 on error.
+ */
+int open_local_listener(const local_listener_options& options, std::shared_ptr<Logger> logger)
+{
+    sockaddr_un address{};
+    if (options.path.empty() || options.path.size() >= sizeof(address.sun_path)) {
+        logger->log(LogLevel::ERROR, "Invalid Unix socket path: " + options.path);
+        return -1;
+    }
+
+    struct stat info;
+    if (::lstat(options.path.c_str(), &info) == 0) {
+        if (!S_ISSOCK(info.st_mode)) {
+            logger->log(LogLevel::ERROR, options.path + " exists and is not a socket.");
+            return -1;
+        }
+        ::unlink(options.path.c_str());
+    }
+
+    gid_t gid = static_cast<gid_t>(-1);
+    if (!options.group.empty()) {
+        group* entry = ::getgrnam(options.group.c_str());
+        if (!entry) {
+            logger->log(LogLevel::ERROR, "Unknown group for the Unix socket: " + options.group);
+            return -1;
+        }
+        gid = entry->gr_gid;
+    }
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        logger->log(LogLevel::ERROR, "Cannot create Unix socket: " + std::string(std::strerror(errno)));
+        return -1;
+    }
+
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, options.path.c_str(), options.path.size());
+
+    // bind() creates the file with the umask applied; keep it owner-only until it is chmod'ed.
+    mode_t previous = ::umask(0077);
+    int bound = ::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    ::umask(previous);
+
+    if (bound != 0 || (gid != static_cast<gid_t>(-1) && ::chown(options.path.c_str(), static_cast<uid_t>(-1), gid) != 0) ||
+        ::chmod(options.path.c_str(), options.mode) != 0 || ::listen(fd, SOMAXCONN) != 0) {
+        logger->log(LogLevel::ERROR, "Cannot set up Unix socket " + options.path + ": " + std::strerror(errno));
+        ::close(fd);
+        return -1;
+    }
+
+    logger->log(LogLevel::INFO, "Listening on Unix socket " + options.path + ".");
+    return fd;
+}
+
+/**
+ * @brief Adopts a listening socket created by open_local_listener.
+ *
+ * @param ioc The io_context serving the connections.
+ * @param listener The listening descriptor; owned by the server from now on.
+ * @param doc_root The document root directory for serving files.
+ * @param app The application serving the API.
+ */
+local_server::local_server(
+    boost::asio::io_context& ioc,
+    int listener,
+    std::shared_ptr<std::string const> const& doc_root,
+    std::shared_ptr<Application> app)
+    : ioc_(ioc)
+    , acceptor_(ioc)
+    , doc_root_(doc_root)
+    , app_(app)
+{
+    logger_ = LoggerManager::getLogger("server_logger", LogLevel::INFO, LogOutput::CONSOLE);
+
+    boost::beast::error_code ec;
+    acceptor_.assign(boost::asio::local::stream_protocol(), listener, ec);
+    if (ec)
+    {
+        logger_->log(LogLevel::ERROR, "Error adopting Unix socket: " + ec.message());
+        ::close(listener);
+    }
+}
+
+/**
+ * @brief Starts accepting connections.
+ */
+void local_server::run()
+{
+    do_accept();
+}
+
+void local_server::do_accept()
+{
+    acceptor_.async_accept(
+        boost::asio::make_strand(ioc_),
+        boost::beast::bind_front_handler(
+            &local_server::on_accept,
+            shared_from_this()));
+}
+
+void local_server::on_accept(boost::beast::error_code ec, boost::asio::local::stream_protocol::socket socket)
+{
+    if (ec)
+    {
+        logger_->log(LogLevel::ERROR, "Error accepting Unix socket connection: " + ec.message());
+        if (ec == boost::asio::error::bad_descriptor || ec == boost::asio::error::operation_aborted)
+            return;  // The acceptor is gone; do not spin.
+    }
+    else
+    {
+        make_pooled<local_session>(
+            local_stream(std::move(socket)), boost::beast::flat_buffer(), doc_root_, app_,
+            connection_protocol::local)->run();
+    }
+
+    do_accept();
+}
@@ -0,0 +1,54 @@
+#include "../include/request_arena.hpp"
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * @brief Returns `bytes` of memory aligned to `alignment`.
+ *
+ * Takes the memory from the current block, else from the next retained block that
+ * is large enough, else from a new block.
+ *
+ * @param bytes Size of the allocation.
+ * @param alignment Required alignment; a power of two.
+ * @return The memory; valid until reset().
+ */
+void* request_arena::allocate(std::size_t bytes, std::size_t alignment)
+{
+    for (; current_ < blocks_.size(); ++current_, used_ = 0) {
+        auto& b = blocks_[current_];
+        auto base = reinterpret_cast<std::uintptr_t>(b.data.get());
+        std::size_t offset = ((base + used_ + alignment - 1) & ~(alignment - 1)) - base;
+        if (offset + bytes <= b.size) {
+            used_ = offset + bytes;
+            return b.data.get() + offset;
+        }
+    }
+
+    // new[] memory is aligned for any fundamental type, which is all requests hold
+    std::size_t size = std::max(block_size, bytes);
+    blocks_.push_back(block{std::make_unique<unsigned char[]>(size), size});
+    current_ = blocks_.size() - 1;
+    used_ = bytes;
+    return blocks_.back().data.get();
+}
+
+/**
+ * @brief Makes all memory available again; nothing allocated before may be in use.
+ *
+ * Keeps the blocks up to `retain` bytes, in order, and frees the rest.
+ *
+ * @param retain Bytes of blocks to keep; the rest is freed.
+ */
+void request_arena::reset(std::size_t retain)
+{
+    std::size_t kept = 0;
+    std::size_t total = 0;
+    while (kept < blocks_.size() && total + blocks_[kept].size <= retain) {
+        total += blocks_[kept].size;
+        ++kept;
+    }
+    blocks_.erase(blocks_.begin() + static_cast<std::ptrdiff_t>(kept), blocks_.end());
+
+    current_ = 0;
+    used_ = 0;
+}
@@ -1,5 +1,20 @@
 #include "../include/server.hpp"
 #include "../include/session.hpp"
+#include "../include/asset_cache.hpp"
+
+/**
+ * @brief Process-wide thread pool for TLS handshakes, created on first use.
+ *
+ * Shared by every server in the process, so sharded servers do not each start their own.
+ *
+ * @param threads Number of threads; only the first call's value is used.
+ * @return The pool.
+ */
+boost::asio::thread_pool& handshake_pool(std::size_t threads)
+{
+    static boost::asio::thread_pool pool(threads);
+    return pool;
+}
 
 /**
  * @brief Constructs a server object.
@@ -11,24 +26,55 @@
  * @param ctx The SSL context used for managing SSL connections.
  * @param endpoint The endpoint on which the server will accept connections.
  * @param doc_root The document root directory for serving files.
+ * @param app Shared pointer to the application instance.
+ * @param options Acceptor and executor settings.
  */
 server::server(
     boost::asio::io_context& ioc,
     boost::asio::ssl::context& ctx,
     boost::asio::ip::tcp::endpoint endpoint,
     std::shared_ptr<std::string const> const& doc_root,
-    std::shared_ptr<Application> app)
+    std::shared_ptr<Application> app,
+    server_options options)
     : ioc_(ioc)
     , ctx_(ctx)
     , acceptor_(ioc)
     , doc_root_(doc_root)
     , app_(app)
+    , options_(options)
 {
     logger_ = LoggerManager::getLogger("server_logger", LogLevel::INFO, LogOutput::CONSOLE);
     logger_->log(LogLevel::DEBUG, "Initializing server.");
 
+    // Load the static assets before the first connection arrives.
+    shared_asset_cache(*doc_root_);
+
+    if (options_.handshake_threads > 0)
+    {
+        handshake_executor_ = handshake_pool(options_.handshake_threads).get_executor();
+        logger_->log(LogLevel::INFO, "TLS handshakes run on a pool of " +
+                     std::to_string(options_.handshake_threads) + " threads.");
+    }
+
+    if (options_.allow_plaintext)
+        logger_->log(LogLevel::INFO, "Accepting plaintext HTTP next to TLS; only expose this port to trusted networks.");
+
     boost::beast::error_code ec;
 
+    // Prefork workers share the socket the supervisor bound and listened on.
+    if (options_.native_listener >= 0)
+    {
+        acceptor_.assign(endpoint.protocol(), options_.native_listener, ec);
+        if (ec)
+        {
+            logger_->log(LogLevel::ERROR, "Error adopting listening socket: " + ec.message());
+            return;
+        }
+
+        logger_->log(LogLevel::DEBUG, "Server listening on inherited socket.");
+        return;
+    }
+
     // Open the acceptor to allow incoming connections.
     acceptor_.open(endpoint.protocol(), ec);
     if (ec)
@@ -49,6 +95,20 @@ server::server(
 
     logger_->log(LogLevel::DEBUG, "Socket option set for address reuse.");
 
+    // Let every shard bind its own acceptor to the endpoint; the kernel spreads connections across them.
+    if (options_.reuse_port)
+    {
+        using reuse_port = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+        acceptor_.set_option(reuse_port(true), ec);
+        if (ec)
+        {
+            logger_->log(LogLevel::ERROR, "Error setting SO_REUSEPORT: " + ec.message());
+            return;
+        }
+
+        logger_->log(LogLevel::DEBUG, "Socket option set for port reuse.");
+    }
+
     // Bind the acceptor to the specified endpoint.
     acceptor_.bind(endpoint, ec);
     if (ec)
@@ -85,17 +145,29 @@ void server::run()
  * @brief Asynchronously accepts incoming connections.
  * 
  * This method initiates an asynchronous accept operation to wait for new client connections.
- * When a connection is accepted, the on_accept handler is invoked.
+ * When a connection is accepted, the on_accept handler is invoked. A sharded server runs its
+ * io_context on a single thread, so its sessions use the io_context executor directly.
  */
 void server::do_accept()
 {
     logger_->log(LogLevel::DEBUG, "Waiting for connections...");
 
-    acceptor_.async_accept(
-        boost::asio::make_strand(ioc_),
-        boost::beast::bind_front_handler(
-            &server::on_accept,
-            shared_from_this()));
+    if (options_.strand_per_session)
+    {
+        acceptor_.async_accept(
+            boost::asio::make_strand(ioc_),
+            boost::beast::bind_front_handler(
+                &server::on_accept,
+                shared_from_this()));
+    }
+    else
+    {
+        acceptor_.async_accept(
+            ioc_.get_executor(),
+            boost::beast::bind_front_handler(
+                &server::on_accept,
+                shared_from_this()));
+    }
 }
 
 /**
@@ -115,9 +187,11 @@ void server::on_accept(boost::beast::error_code ec, boost::asio::ip::tcp::socket
     {
         logger_->log(LogLevel::DEBUG, "Connection accepted.");
         
-        // Create a new session and start it
-        auto new_session = std::make_shared<session>(std::move(socket), ctx_, doc_root_, app_);
-        new_session->run();
+        // Create a new session and start it; with plaintext allowed, the first bytes decide which kind
+        if (options_.allow_plaintext)
+            make_pooled<detect_session>(std::move(socket), ctx_, doc_root_, app_, handshake_executor_)->run();
+        else
+            make_pooled<session>(std::move(socket), ctx_, doc_root_, app_, handshake_executor_)->run();
 
         auto accept_end_time = std::chrono::steady_clock::now();
         auto accept_duration = std::chrono::duration_cast<std::chrono::microseconds>(accept_end_time - accept_start_time).count();
@@ -1,10 +1,209 @@
 #include "../include/server_certificate.hpp"
 #include "../include/dotenv.hpp"
 #include "../../log/include/log.hpp"
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
 #include <fstream>
+#include <new>
 #include <sstream>
 #include <stdexcept>
 
+namespace {
+
+/**
+ * @brief Session ticket keys: the current one encrypts, older ones still decrypt.
+ *
+ * A new key is generated on first use once the current one is older than the
+ * rotation period, so a leaked key exposes at most `kept` rotation periods of tickets.
+ *
+ * The keys live in an anonymous MAP_SHARED mapping guarded by a robust, process-shared
+ * mutex. Processes forked after the ring was created (see share_ticket_keys()) use the
+ * same keys and see each other's rotations, so a ticket issued by one prefork worker
+ * resumes on any other.
+ */
+class ticket_key_ring {
+public:
+    static constexpr std::size_t max_keys = 16;
+
+    struct key {
+        unsigned char name[16];
+        unsigned char aes[32];
+        unsigned char hmac[32];
+        std::chrono::steady_clock::time_point created;  // CLOCK_MONOTONIC, the same in every process
+    };
+
+    ticket_key_ring()
+    {
+        void* region = ::mmap(nullptr, sizeof(state), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED) {
+            // Still correct within this process; only prefork workers would each rotate their own keys
+            LoggerManager::getLogger("server_certificate_logger", LogLevel::INFO)
+                ->log(LogLevel::ERROR, "Cannot map shared ticket keys: " + std::string(std::strerror(errno)));
+            region = ::operator new(sizeof(state));
+        }
+        state_ = new (region) state;
+
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+        pthread_mutex_init(&state_->mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+
+    void configure(std::chrono::seconds rotation, std::size_t kept)
+    {
+        guard lock(*state_);
+        state_->rotation = rotation;
+        state_->kept = std::min(std::max<std::size_t>(1, kept), max_keys);
+    }
+
+    /// Copies the key to encrypt new tickets with; false if no random key could be made.
+    bool current(key& out)
+    {
+        guard lock(*state_);
+        auto now = std::chrono::steady_clock::now();
+        if (state_->count == 0 || now - state_->keys[0].created >= state_->rotation) {
+            key fresh;
+            if (RAND_bytes(fresh.name, sizeof(fresh.name)) != 1 || RAND_bytes(fresh.aes, sizeof(fresh.aes)) != 1 ||
+                RAND_bytes(fresh.hmac, sizeof(fresh.hmac)) != 1) {
+                return false;
+            }
+            fresh.created = now;
+            state_->count = std::min(state_->count + 1, state_->kept);
+            std::copy_backward(state_->keys, state_->keys + state_->count - 1, state_->keys + state_->count);
+            state_->keys[0] = fresh;
+        }
+        out = state_->keys[0];
+        return true;
+    }
+
+    /// Finds the key a ticket was encrypted with: 0 if unknown, 1 if current, 2 if it has been rotated out.
+    int find(const unsigned char* name, key& out)
+    {
+        guard lock(*state_);
+        for (std::size_t i = 0; i < state_->count; ++i) {
+            if (std::memcmp(state_->keys[i].name, name, sizeof(state_->keys[i].name)) == 0) {
+                out = state_->keys[i];
+                return i == 0 ? 1 : 2;
+            }
+        }
+        return 0;
+    }
+
+private:
+    struct state {
+        pthread_mutex_t mutex;
+        std::chrono::seconds rotation{3600};
+        std::size_t kept = 2;
+        std::size_t count = 0;
+        key keys[max_keys];  // Newest first
+    };
+
+    /// Locks the ring; recovers it if a worker died holding the lock.
+    class guard {
+    public:
+        explicit guard(state& s) : state_(s)
+        {
+            if (pthread_mutex_lock(&state_.mutex) == EOWNERDEAD) {
+                state_.count = std::min(state_.count, state_.kept);
+                pthread_mutex_consistent(&state_.mutex);
+            }
+        }
+        ~guard() { pthread_mutex_unlock(&state_.mutex); }
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+
+    private:
+        state& state_;
+    };
+
+    state* state_ = nullptr;  // Never unmapped; other processes may still use it
+};
+
+ticket_key_ring& ticket_keys()
+{
+    static ticket_key_ring ring;
+    return ring;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+bool set_ticket_hmac_key(EVP_MAC_CTX* hctx, unsigned char* hmac_key, std::size_t length)
+{
+    char digest[] = "SHA256";
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, hmac_key, length),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+        OSSL_PARAM_construct_end()
+    };
+    return EVP_MAC_CTX_set_params(hctx, params) == 1;
+}
+
+/**
+ * @brief OpenSSL session ticket callback encrypting with the key ring.
+ *
+ * Returning 2 on decryption accepts a ticket sealed with an older key and asks
+ * OpenSSL to issue a fresh one under the current key.
+ */
+int ticket_key_callback(SSL*, unsigned char key_name[16], unsigned char iv[EVP_MAX_IV_LENGTH],
+                        EVP_CIPHER_CTX* cipher_ctx, EVP_MAC_CTX* hctx, int enc)
+{
+    ticket_key_ring::key key;
+    if (enc) {
+        if (!ticket_keys().current(key) || RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1) {
+            return -1;
+        }
+        std::memcpy(key_name, key.name, sizeof(key.name));
+        if (EVP_EncryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key.aes, iv) != 1 ||
+            !set_ticket_hmac_key(hctx, key.hmac, sizeof(key.hmac))) {
+            return -1;
+        }
+        return 1;
+    }
+
+    int found = ticket_keys().find(key_name, key);
+    if (found == 0) {
+        return 0;  // Unknown key: fall back to a full handshake
+    }
+    if (!set_ticket_hmac_key(hctx, key.hmac, sizeof(key.hmac)) ||
+        EVP_DecryptInit_ex(cipher_ctx, EVP_aes_256_cbc(), nullptr, key.aes, iv) != 1) {
+        return -1;
+    }
+    return found;
+}
+#endif
+
+/**
+ * @brief ALPN callback: h2 when built with HTTP/2 support and offered, else HTTP/1.1.
+ *
+ * A client offering neither gets no ALPN answer and speaks HTTP/1.1 as before.
+ */
+int alpn_select_callback(SSL*, const unsigned char** out, unsigned char* outlen,
+                         const unsigned char* in, unsigned int inlen, void*)
+{
+#ifdef WITH_HTTP2
+    static const unsigned char protocols[] = "\x02h2\x08http/1.1";
+#else
+    static const unsigned char protocols[] = "\x08http/1.1";
+#endif
+    unsigned char* selected = nullptr;
+    if (SSL_select_next_proto(&selected, outlen, protocols, sizeof(protocols) - 1, in, inlen) != OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+} // namespace
+
 /**
  * @brief Load the content of a file into a string.
  * 
@@ -35,12 +234,18 @@ std::string load_file_content(const std::string& file_path) {
  * @brief Load the server certificate, private key, and DH parameters into the SSL context.
  * 
  * This function reads the necessary file paths and password from environment variables,
- * loads the files' content, and configures the SSL context accordingly.
+ * loads the files' content, and configures the SSL context accordingly: TLS 1.2 and 1.3,
+ * ECDHE groups, a server-side session cache and session tickets encrypted with rotating
+ * keys. If ECDSA_CERT_PATH and ECDSA_KEY_PATH are set, an ECDSA certificate is served to
+ * clients that support it next to the RSA one. DH_PATH is optional. ALPN selects h2 when
+ * the server is built with HTTP/2 support, http/1.1 otherwise. Idle connections release
+ * their record buffers unless options.release_buffers is cleared.
  * 
  * @param ctx The SSL context to configure.
+ * @param options Protocol and resumption settings.
  * @throws std::runtime_error if required environment variables are missing or if file loading fails.
  */
-void load_server_certificate(boost::asio::ssl::context& ctx)
+void load_server_certificate(boost::asio::ssl::context& ctx, const tls_options& options)
 {
     auto logger = LoggerManager::getLogger("server_certificate_logger", LogLevel::INFO);
     logger->log(LogLevel::DEBUG, "Loading server certificate.");
@@ -54,9 +259,11 @@ void load_server_certificate(boost::asio::ssl::context& ctx)
     const char* key_path = std::getenv("KEY_PATH");
     const char* dh_path = std::getenv("DH_PATH");
     const char* password_cstr = std::getenv("SSL_PASSWORD");
+    const char* ecdsa_cert_path = std::getenv("ECDSA_CERT_PATH");
+    const char* ecdsa_key_path = std::getenv("ECDSA_KEY_PATH");
 
-    // Ensure all required environment variables are set
-    if (!cert_path || !key_path || !dh_path || !password_cstr) {
+    // Ensure all required environment variables are set; DH parameters only matter to DHE suites
+    if (!cert_path || !key_path || !password_cstr) {
         logger->log(LogLevel::ERROR, "Missing one or more required environment variables.");
         throw std::runtime_error("Missing one or more required environment variables");
     }
@@ -66,7 +273,6 @@ void load_server_certificate(boost::asio::ssl::context& ctx)
     // Load the contents of the certificate, key, and DH parameter files
     std::string cert = load_file_content(cert_path);
     std::string key = load_file_content(key_path);
-    std::string dh = load_file_content(dh_path);
     std::string password(password_cstr);
 
     logger->log(LogLevel::DEBUG, "Setting SSL context password callback.");
@@ -83,6 +289,35 @@ void load_server_certificate(boost::asio::ssl::context& ctx)
         boost::asio::ssl::context::no_sslv2 |
         boost::asio::ssl::context::single_dh_use);
 
+    SSL_CTX* native = ctx.native_handle();
+    SSL_CTX_set_min_proto_version(native, TLS1_2_VERSION);
+    SSL_CTX_set_max_proto_version(native, options.enable_tls13 ? 0 : TLS1_2_VERSION);
+    SSL_CTX_set_options(native, SSL_OP_CIPHER_SERVER_PREFERENCE);
+    if (SSL_CTX_set_cipher_list(native, "ECDHE+AESGCM:ECDHE+CHACHA20:DHE+AESGCM") != 1 ||
+        SSL_CTX_set1_groups_list(native, options.groups.c_str()) != 1) {
+        logger->log(LogLevel::ERROR, "Invalid TLS cipher or group list.");
+        throw std::runtime_error("Invalid TLS cipher or group list");
+    }
+
+    // Resumption: a session cache for TLS 1.2 session IDs, and tickets for TLS 1.2 and 1.3
+    static const unsigned char session_id_context[] = "ollama_server";
+    SSL_CTX_set_session_id_context(native, session_id_context, sizeof(session_id_context) - 1);
+    SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(native, options.session_cache_size);
+    SSL_CTX_set_timeout(native, options.session_timeout_seconds);
+    SSL_CTX_set_num_tickets(native, 1);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    ticket_keys().configure(std::chrono::seconds(options.ticket_key_rotation_seconds), options.ticket_keys_kept);
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(native, ticket_key_callback);
+#endif
+
+    SSL_CTX_set_alpn_select_cb(native, alpn_select_callback, nullptr);
+
+    // OpenSSL otherwise keeps about 34 KiB of record buffers per connection for its lifetime;
+    // with this it frees them whenever no record is in flight, at the cost of reallocating
+    if (options.release_buffers)
+        SSL_CTX_set_mode(native, SSL_MODE_RELEASE_BUFFERS);
+
     logger->log(LogLevel::DEBUG, "Loading certificate chain.");
     ctx.use_certificate_chain(
         boost::asio::buffer(cert.data(), cert.size()));
@@ -92,10 +327,36 @@ void load_server_certificate(boost::asio::ssl::context& ctx)
         boost::asio::buffer(key.data(), key.size()),
         boost::asio::ssl::context::file_format::pem);
 
-    logger->log(LogLevel::DEBUG, "Loading DH parameters.");
-    ctx.use_tmp_dh(
-        boost::asio::buffer(dh.data(), dh.size()));
+    if (ecdsa_cert_path && ecdsa_key_path) {
+        // OpenSSL keeps one certificate per key type and picks the one the client supports
+        logger->log(LogLevel::DEBUG, "Loading ECDSA certificate chain.");
+        if (SSL_CTX_use_certificate_chain_file(native, ecdsa_cert_path) != 1 ||
+            SSL_CTX_use_PrivateKey_file(native, ecdsa_key_path, SSL_FILETYPE_PEM) != 1 ||
+            SSL_CTX_check_private_key(native) != 1) {
+            logger->log(LogLevel::ERROR, "Error loading ECDSA certificate or key.");
+            throw std::runtime_error("Could not load ECDSA certificate or key");
+        }
+    }
+
+    if (dh_path) {
+        logger->log(LogLevel::DEBUG, "Loading DH parameters.");
+        std::string dh = load_file_content(dh_path);
+        ctx.use_tmp_dh(
+            boost::asio::buffer(dh.data(), dh.size()));
+    }
 
     logger->log(LogLevel::DEBUG, "Server certificate loaded successfully.");
 }
 
+/**
+ * @brief Creates the session ticket key ring in memory shared with processes forked later.
+ *
+ * Called by the prefork supervisor before it forks, so every worker encrypts tickets
+ * with the same keys and a ticket from one worker resumes on any other.
+ *
+ * @param options Key rotation period and number of keys kept.
+ */
+void share_ticket_keys(const tls_options& options)
+{
+    ticket_keys().configure(std::chrono::seconds(options.ticket_key_rotation_seconds), options.ticket_keys_kept);
+}
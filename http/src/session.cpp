@@ -1,186 +1,618 @@
 #include "../include/session.hpp"
+#include "../include/alloc_stats.hpp"
+#include "../include/connection_stats.hpp"
+#include "../include/http2_session.hpp"
 #include "../include/http_tools.hpp"
+#include "../include/session_pool.hpp"
+#include "../include/tls_stats.hpp"
 #include "../include/utils.hpp"
 #include "../../log/include/log.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+/// Read buffer capacity kept while a connection waits for its next request; see set_idle_buffer_limit().
+std::atomic<std::size_t> idle_buffer_limit{request_arena::block_size};
+
+/// Largest read buffer of a connection; see set_read_buffer_limit().
+std::atomic<std::size_t> read_buffer_limit{64 * 1024};
+
+/// Smallest read buffer limit; a request header must fit in the buffer.
+constexpr std::size_t min_read_buffer_limit = 16 * 1024;
 
 /**
- * @brief Constructs a session object.
- * 
- * Initializes the session with the given socket, SSL context, and document root.
- * 
- * @param socket The socket for the session.
- * @param ctx The SSL context for managing SSL connections.
+ * @brief Constructs the request loop.
+ *
+ * @param buffer Bytes already read from the connection, e.g. while detecting TLS;
+ *               without any, a buffer from the session pool is used.
  * @param doc_root The document root directory for serving files.
+ * @param app The application serving the API.
  */
-session::session(
-        tcp::socket&& socket,
-        ssl::context& ctx,
-        std::shared_ptr<std::string const> const& doc_root, 
+template <class Derived>
+http_session<Derived>::http_session(
+        beast::flat_buffer buffer,
+        std::shared_ptr<std::string const> const& doc_root,
         std::shared_ptr<Application> app)
-    : stream_(std::move(socket), ctx)
+    : buffer_(buffer.capacity() ? std::move(buffer) : shared_session_pool().acquire_buffer())
     , doc_root_(doc_root)
-      , app_(app)
+    , app_(std::move(app))
 {
-    auto logger = LoggerManager::getLogger("session_logger", LogLevel::INFO);
-    logger->log(LogLevel::DEBUG, "Session created.");
+    buffer_.max_size(read_buffer_limit.load(std::memory_order_relaxed));
 }
 
 /**
- * @brief Starts the session by initiating the SSL handshake.
+ * @brief Returns the read buffer and the arenas to the session pool.
+ *
+ * Arenas still held by a request on the blocking pool are left to it.
  */
-void session::run()
+template <class Derived>
+http_session<Derived>::~http_session()
 {
-    auto logger = LoggerManager::getLogger("session_logger");
-    logger->log(LogLevel::DEBUG, "Running session.");
-
-    net::dispatch(
-            stream_.get_executor(),
-            beast::bind_front_handler(
-                &session::on_run,
-                shared_from_this()));
+    parser_.reset();
+    auto& pool = shared_session_pool();
+    pool.release_buffer(std::move(buffer_));
+    for(auto& arena : arenas_)
+        pool.release_arena(std::move(arena));
 }
 
 /**
- * @brief Handles the asynchronous run operation.
- * 
- * This method is called after the session is dispatched and starts the SSL handshake.
+ * @brief An arena no request uses anymore, rewound; a new one if all are in use.
+ *
+ * A request holds its arena through the allocators of its fields and body, so an
+ * arena the session holds the only reference to is free, even if the request was
+ * destroyed on the blocking pool. At most one arena per pipeline slot is kept.
  */
-void session::on_run()
+template <class Derived>
+std::shared_ptr<request_arena> http_session<Derived>::acquire_arena()
 {
-    auto logger = LoggerManager::getLogger("session_logger");
-    logger->log(LogLevel::DEBUG, "Starting SSL handshake.");
-
-    beast::get_lowest_layer(stream_).expires_after(
-            std::chrono::seconds(30));
+    for(auto& arena : arenas_) {
+        if(arena.use_count() == 1) {
+            // Pairs with the release of the last reference on another thread
+            std::atomic_thread_fence(std::memory_order_acquire);
+            arena->reset();
+            return arena;
+        }
+    }
 
-    stream_.async_handshake(
-            ssl::stream_base::server,
-            beast::bind_front_handler(
-                &session::on_handshake,
-                shared_from_this()));
+    auto arena = shared_session_pool().acquire_arena();
+    if(arenas_.size() <= pipeline_limit)
+        arenas_.push_back(arena);
+    return arena;
 }
 
 /**
- * @brief Handles the SSL handshake completion.
- * 
- * This method is called when the SSL handshake is complete.
+ * @brief Reads an HTTP request from the client.
  * 
- * @param ec The error code, if any, from the handshake operation.
+ * Initiates an asynchronous read of the request header, unless a read is already
+ * in progress or the pipeline is full. The body is read once the header passed.
+ *
+ * Between requests, with nothing pending and nothing read ahead, the client may leave
+ * the connection idle for long. The session then gives back its spare memory and
+ * waits for the next bytes in a small buffer before it takes an arena for them.
  */
-void session::on_handshake(boost::beast::error_code ec)
+template <class Derived>
+void http_session<Derived>::do_read()
 {
+    if(reading_ || read_closed_ || closing_ || responses_.size() >= pipeline_limit)
+        return;
+
     auto logger = LoggerManager::getLogger("session_logger");
+    logger->log(LogLevel::DEBUG, "Reading request.");
 
-    if(ec) {
-        logger->log(LogLevel::ERROR, "Handshake failed: " + ec.message());
-        return fail(ec, "handshake");
+    auto read_start_time = std::chrono::steady_clock::now();
+
+    parser_.reset();  // Drops a failed request's hold on its arena
+    reading_ = true;
+
+    // The idle timeout only applies once every response is out; a read-ahead must not
+    // cut off a slow handler, and an ongoing write keeps its own timeout.
+    if(responses_.empty() && !writing_)
+        beast::get_lowest_layer(derived().stream()).expires_after(std::chrono::seconds(30));
+    else if(!writing_)
+        beast::get_lowest_layer(derived().stream()).expires_never();
+
+    if(responses_.empty() && buffer_.size() == 0) {
+        release_idle_memory();
+        std::size_t size = beast::read_size(buffer_, std::max<std::size_t>(512, idle_buffer_limit.load(std::memory_order_relaxed)));
+        derived().stream().async_read_some(buffer_.prepare(size),
+                make_recycling_handler(handler_memory_, [self = derived().shared_from_this(), read_start_time](boost::beast::error_code ec, std::size_t bytes_transferred) {
+                    self->on_idle_read(ec, bytes_transferred, read_start_time);
+                }));
+        return;
     }
 
-    logger->log(LogLevel::DEBUG, "Handshake successful.");
-    do_read();
+    read_header(read_start_time);
 }
 
 /**
- * @brief Reads an HTTP request from the client.
- * 
- * Initiates an asynchronous read operation to receive the client's HTTP request.
+ * @brief Gives back the memory the last requests grew, while the connection is idle.
+ *
+ * The read buffer is freed if it grew past the idle limit. The arenas of pipelined
+ * requests go back to the session pool, and so does the last one unless the limit
+ * leaves room for a block; the next request takes one from there.
  */
-void session::do_read()
+template <class Derived>
+void http_session<Derived>::release_idle_memory()
 {
-    auto logger = LoggerManager::getLogger("session_logger");
-    logger->log(LogLevel::DEBUG, "Reading request.");
+    std::size_t limit = idle_buffer_limit.load(std::memory_order_relaxed);
+    if(buffer_.capacity() > limit)
+        buffer_.shrink_to_fit();  // Empty, so this frees it
+
+    std::size_t keep = limit < request_arena::block_size ? 0 : 1;
+    if(arenas_.size() > keep) {
+        auto& pool = shared_session_pool();
+        for(std::size_t i = keep; i < arenas_.size(); ++i)
+            pool.release_arena(std::move(arenas_[i]));
+        arenas_.resize(keep);
+    }
+}
 
-    auto read_start_time = std::chrono::steady_clock::now();
+/**
+ * @brief Handles the first bytes of a request that arrived on an idle connection.
+ *
+ * @param ec The error code, if any, from the read operation.
+ * @param bytes_transferred The number of bytes read into the buffer.
+ */
+template <class Derived>
+void http_session<Derived>::on_idle_read(boost::beast::error_code ec, std::size_t bytes_transferred, std::chrono::steady_clock::time_point read_start_time)
+{
+    buffer_.commit(bytes_transferred);
 
-    req_ = {};
+    if(closing_) {
+        reading_ = false;
+        return;
+    }
 
-    beast::get_lowest_layer(stream_).expires_after(std::chrono::seconds(30));
+    if(ec == net::error::eof)
+        ec = http::error::end_of_stream;
+    if(ec)
+        return read_failed(ec);
 
-    http::async_read(stream_, buffer_, req_,
-            [self = shared_from_this(), read_start_time](boost::beast::error_code ec, std::size_t bytes_transferred) {
-                self->on_read(ec, bytes_transferred, read_start_time);
-            });
+    read_header(read_start_time);
+}
+
+/**
+ * @brief Reads the request header into a new parser on a free arena.
+ */
+template <class Derived>
+void http_session<Derived>::read_header(std::chrono::steady_clock::time_point read_start_time)
+{
+    auto arena = acquire_arena();
+    parser_.emplace(std::piecewise_construct,
+                    std::make_tuple(arena_allocator<char>(arena)),
+                    std::make_tuple(arena_allocator<char>(arena)));
+
+    http::async_read_header(derived().stream(), buffer_, *parser_,
+            make_recycling_handler(handler_memory_, [self = derived().shared_from_this(), read_start_time](boost::beast::error_code ec, std::size_t bytes_transferred) {
+                self->on_read_header(ec, bytes_transferred, read_start_time);
+            }));
 }
 
 
 /**
- * @brief Handles the completion of the asynchronous read operation.
+ * @brief Handles the completion of reading the request header.
  * 
- * Processes the received HTTP request or closes the session if an error occurs.
+ * Rejects a body larger than the route accepts before any of it is read, answers
+ * `Expect: 100-continue`, then goes on to read the body.
  * 
  * @param ec The error code, if any, from the read operation.
  * @param bytes_transferred The number of bytes transferred during the read.
  */
-void session::on_read(boost::beast::error_code ec, std::size_t bytes_transferred, std::chrono::steady_clock::time_point read_start_time)
+template <class Derived>
+void http_session<Derived>::on_read_header(boost::beast::error_code ec, std::size_t bytes_transferred, std::chrono::steady_clock::time_point read_start_time)
 {
     boost::ignore_unused(bytes_transferred);
+
+    if(closing_) {
+        reading_ = false;
+        return;
+    }
+
+    if(ec)
+        return read_failed(ec);
+
+    auto const& header = parser_->get();
+    std::size_t limit = request_body_limit(header.method(), header.target());
+    parser_->body_limit(limit);
+
+    auto content_length = parser_->content_length();
+    if(content_length && *content_length > limit)
+        return reject_body(limit);
+
+    if(beast::iequals(header[http::field::expect], "100-continue"))
+        return send_continue(read_start_time);
+
+    do_read_body(read_start_time);
+}
+
+/**
+ * @brief Tells a client waiting on `Expect: 100-continue` to send the body.
+ *
+ * Only sent while no response is pending, since it must not land in the middle of one;
+ * otherwise the client sends the body after its own wait, as RFC 9110 allows.
+ */
+template <class Derived>
+void http_session<Derived>::send_continue(std::chrono::steady_clock::time_point read_start_time)
+{
+    if(writing_ || !responses_.empty())
+        return do_read_body(read_start_time);
+
+    static const char continue_response[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    writing_ = true;
+    net::async_write(derived().stream(), net::buffer(continue_response, sizeof(continue_response) - 1),
+            make_recycling_handler(handler_memory_, [self = derived().shared_from_this(), read_start_time](boost::beast::error_code ec, std::size_t) {
+                self->writing_ = false;
+                if(self->closing_) {
+                    self->reading_ = false;
+                    return;
+                }
+                if(ec) {
+                    self->reading_ = false;
+                    self->closing_ = true;
+                    return fail(ec, "write");
+                }
+                self->do_read_body(read_start_time);
+            }));
+}
+
+/**
+ * @brief Reads the next piece of the request body, or hands over the complete request.
+ *
+ * The timeout is renewed for every piece, so a large upload only fails if it stalls,
+ * not because it takes longer than one timeout in total.
+ */
+template <class Derived>
+void http_session<Derived>::do_read_body(std::chrono::steady_clock::time_point read_start_time)
+{
+    if(parser_->is_done())
+        return on_request(read_start_time);
+
+    if(!writing_)
+        beast::get_lowest_layer(derived().stream()).expires_after(std::chrono::seconds(30));
+
+    http::async_read_some(derived().stream(), buffer_, *parser_,
+            make_recycling_handler(handler_memory_, [self = derived().shared_from_this(), read_start_time](boost::beast::error_code ec, std::size_t) {
+                if(self->closing_) {
+                    self->reading_ = false;
+                    return;
+                }
+                if(ec == http::error::body_limit)
+                {
+                    auto const& header = self->parser_->get();
+                    return self->reject_body(request_body_limit(header.method(), header.target()));
+                }
+                if(ec)
+                    return self->read_failed(ec);
+                self->do_read_body(read_start_time);
+            }));
+}
+
+/**
+ * @brief Handles a read that ended without a request.
+ *
+ * @param ec The error code from the read operation.
+ */
+template <class Derived>
+void http_session<Derived>::read_failed(boost::beast::error_code ec)
+{
+    auto logger = LoggerManager::getLogger("session_logger");
+    reading_ = false;
+
+    if(ec == http::error::end_of_stream) {
+        read_closed_ = true;
+        if(responses_.empty() && !writing_) {
+            logger->log(LogLevel::DEBUG, "End of stream detected, closing session.");
+            closing_ = true;
+            return derived().do_close();
+        }
+        logger->log(LogLevel::DEBUG, "End of stream detected, closing after the pending responses.");
+        return;
+    }
+
+    logger->log(LogLevel::ERROR, "Error reading request: " + ec.message());
+    closing_ = true;
+    fail(ec, "read");
+}
+
+/**
+ * @brief Answers 413 to a request whose body exceeds its limit and stops reading.
+ *
+ * The unread body is still on the connection, so it is closed after the response.
+ *
+ * @param limit The limit that was exceeded.
+ */
+template <class Derived>
+void http_session<Derived>::reject_body(std::size_t limit)
+{
+    auto logger = LoggerManager::getLogger("session_logger");
+    logger->log(LogLevel::DEBUG, "Request body exceeds " + std::to_string(limit) + " bytes, rejecting it.");
+    reading_ = false;
+    read_closed_ = true;
+
+    auto req = parser_->release();
+    req.keep_alive(false);
+    responses_.emplace_back(payload_too_large(req, limit));
+    do_write();
+}
+
+/**
+ * @brief Hands a complete request to the request handlers.
+ * 
+ * @param read_start_time When reading the request began.
+ */
+template <class Derived>
+void http_session<Derived>::on_request(std::chrono::steady_clock::time_point read_start_time)
+{
     auto logger = LoggerManager::getLogger("session_logger");
+    reading_ = false;
 
     auto read_end_time = std::chrono::steady_clock::now();
     auto read_duration = std::chrono::duration_cast<std::chrono::microseconds>(read_end_time - read_start_time).count();
     logger->log(LogLevel::DEBUG, "Time to read request: " + std::to_string(read_duration) + " ms");
+    logger->log(LogLevel::DEBUG, "Request received successfully.");
 
-    if(ec == http::error::end_of_stream) {
-        logger->log(LogLevel::DEBUG, "End of stream detected, closing session.");
-        return do_close();
-    }
+    auto req = parser_->release();
+    heap_allocation_stats().count_request();
 
-    if(ec) {
-        logger->log(LogLevel::ERROR, "Error reading request: " + ec.message());
-        return fail(ec, "read");
-    }
+    // Reserve the response's place in the pipeline before the handler can complete
+    uint64_t sequence = first_sequence_ + responses_.size();
+    responses_.emplace_back();
+    if(!req.keep_alive())
+        read_closed_ = true;
 
-    logger->log(LogLevel::DEBUG, "Request received successfully.");
-    send_response(
-            handle_request(*doc_root_, std::move(req_), app_));
+    // Slow endpoints complete later on this session's executor; the io thread moves on meanwhile.
+    async_handle_request(*doc_root_, std::move(req), app_, derived().stream().get_executor(),
+            [self = derived().shared_from_this(), sequence](http::message_generator msg) {
+                self->on_response(sequence, std::move(msg));
+            });
+
+    // Read ahead while the response is produced and written
+    do_read();
 }
 
 /**
- * @brief Sends an HTTP response to the client.
+ * @brief Stores the response to a request and writes whatever is next in order.
  * 
+ * @param sequence Sequence number of the request.
  * @param msg The HTTP response to send.
  */
-void session::send_response(http::message_generator&& msg)
+template <class Derived>
+void http_session<Derived>::on_response(uint64_t sequence, http::message_generator&& msg)
 {
+    if(closing_)
+        return;
+
+    responses_[sequence - first_sequence_].emplace(std::move(msg));
+    do_write();
+}
+
+/**
+ * @brief Writes the next response if it is ready and no write is in progress.
+ */
+template <class Derived>
+void http_session<Derived>::do_write()
+{
+    if(writing_ || responses_.empty() || !responses_.front())
+        return;
+
     auto logger = LoggerManager::getLogger("session_logger");
     logger->log(LogLevel::DEBUG, "Sending response.");
 
+    http::message_generator msg = std::move(*responses_.front());
+    responses_.pop_front();
+    ++first_sequence_;
+    writing_ = true;
+
+    beast::get_lowest_layer(derived().stream()).expires_after(std::chrono::seconds(30));
+
     bool keep_alive = msg.keep_alive();
 
     beast::async_write(
-            stream_,
+            derived().stream(),
             std::move(msg),
-            beast::bind_front_handler(
-                &session::on_write, this->shared_from_this(), keep_alive));
+            make_recycling_handler(handler_memory_, [self = derived().shared_from_this(), keep_alive](boost::beast::error_code ec, std::size_t bytes_transferred) {
+                self->on_write(keep_alive, ec, bytes_transferred);
+            }));
 }
 
 /**
  * @brief Handles the completion of the asynchronous write operation.
  * 
- * Determines whether to keep the connection alive or close it.
+ * Determines whether to keep the connection alive or close it, and resumes
+ * reading if it paused at the pipeline limit.
  * 
  * @param keep_alive Whether to keep the connection alive.
  * @param ec The error code, if any, from the write operation.
  * @param bytes_transferred The number of bytes transferred during the write.
  */
-void session::on_write(bool keep_alive, boost::beast::error_code ec, std::size_t bytes_transferred)
+template <class Derived>
+void http_session<Derived>::on_write(bool keep_alive, boost::beast::error_code ec, std::size_t bytes_transferred)
 {
     boost::ignore_unused(bytes_transferred);
     auto logger = LoggerManager::getLogger("session_logger");
+    writing_ = false;
+
+    if(closing_)
+        return;
 
     if(ec) {
         logger->log(LogLevel::ERROR, "Error writing response: " + ec.message());
+        closing_ = true;
         return fail(ec, "write");
     }
 
     logger->log(LogLevel::DEBUG, "Response sent successfully.");
 
-    if(!keep_alive)
+    if(!keep_alive || (read_closed_ && responses_.empty()))
     {
         logger->log(LogLevel::DEBUG, "Connection will be closed.");
-        return do_close();
+        closing_ = true;
+        return derived().do_close();
+    }
+
+    do_write();
+    if(reading_ && !writing_)
+    {
+        if(responses_.empty())
+            beast::get_lowest_layer(derived().stream()).expires_after(std::chrono::seconds(30));
+        else
+            beast::get_lowest_layer(derived().stream()).expires_never();
+    }
+    do_read();
+}
+
+/**
+ * @brief Constructs a session object.
+ * 
+ * Initializes the session with the given socket, SSL context, and document root.
+ * 
+ * @param socket The socket for the session.
+ * @param ctx The SSL context for managing SSL connections.
+ * @param doc_root The document root directory for serving files.
+ * @param app The application serving the API.
+ * @param handshake_executor Executor to run the TLS handshake on; empty to run it on the session's executor.
+ * @param buffer Bytes of the ClientHello already read while detecting TLS.
+ */
+session::session(
+        tcp::socket&& socket,
+        ssl::context& ctx,
+        std::shared_ptr<std::string const> const& doc_root, 
+        std::shared_ptr<Application> app,
+        net::any_io_executor handshake_executor,
+        beast::flat_buffer buffer)
+    : http_session<session>(std::move(buffer), doc_root, app)
+    , stream_(std::move(socket), ctx)
+    , handshake_executor_(std::move(handshake_executor))
+{
+    session_connection_stats().opened(connection_protocol::tls);
+    auto logger = LoggerManager::getLogger("session_logger", LogLevel::INFO);
+    logger->log(LogLevel::DEBUG, "Session created.");
+}
+
+session::~session()
+{
+    session_connection_stats().closed(connection_protocol::tls);
+}
+
+/**
+ * @brief Starts the session by initiating the SSL handshake.
+ */
+void session::run()
+{
+    auto logger = LoggerManager::getLogger("session_logger");
+    logger->log(LogLevel::DEBUG, "Running session.");
+
+    net::dispatch(
+            stream_.get_executor(),
+            beast::bind_front_handler(
+                &session::on_run,
+                shared_from_this()));
+}
+
+/**
+ * @brief Handles the asynchronous run operation.
+ * 
+ * This method is called after the session is dispatched and starts the SSL handshake.
+ */
+void session::on_run()
+{
+    auto logger = LoggerManager::getLogger("session_logger");
+    logger->log(LogLevel::DEBUG, "Starting SSL handshake.");
+
+    handshake_start_ = std::chrono::steady_clock::now();
+
+    // With a handshake pool, the handshake's completion handler is bound to a strand of the
+    // pool, so every step of the SSL engine (and its RSA/ECDHE work) runs there; the io
+    // threads only report socket readiness. on_handshake hands the session back afterwards.
+    if(handshake_executor_) {
+        // The stream is only touched from the pool strand until the handshake is done, so
+        // its own timer, which would fire on the io executor, stays off; a timer on the
+        // strand closes the socket instead.
+        beast::get_lowest_layer(stream_).expires_never();
+        auto strand = net::make_strand(handshake_executor_);
+        handshake_timer_.emplace(strand);
+        net::post(strand, [self = shared_from_this(), strand] {
+            self->handshake_timer_->expires_after(std::chrono::seconds(30));
+            self->handshake_timer_->async_wait([self](beast::error_code ec) {
+                if(ec || self->handshake_done_)
+                    return;
+                // Fails the pending handshake read with operation_aborted
+                beast::error_code ignored;
+                beast::get_lowest_layer(self->stream_).socket().close(ignored);
+            });
+            self->stream_.async_handshake(
+                    ssl::stream_base::server,
+                    self->buffer_.data(),
+                    net::bind_executor(strand, beast::bind_front_handler(
+                        &session::on_handshake,
+                        self)));
+        });
+        return;
+    }
+
+    beast::get_lowest_layer(stream_).expires_after(
+            std::chrono::seconds(30));
+
+    // The buffer holds whatever protocol detection already read of the ClientHello
+    stream_.async_handshake(
+            ssl::stream_base::server,
+            buffer_.data(),
+            beast::bind_front_handler(
+                &session::on_handshake,
+                shared_from_this()));
+}
+
+/**
+ * @brief Handles the SSL handshake completion.
+ * 
+ * This method is called when the SSL handshake is complete.
+ * 
+ * @param ec The error code, if any, from the handshake operation.
+ * @param bytes_used Bytes of the detection buffer consumed by the handshake.
+ */
+void session::on_handshake(boost::beast::error_code ec, std::size_t bytes_used)
+{
+    auto logger = LoggerManager::getLogger("session_logger");
+    buffer_.consume(bytes_used);
+
+    if(handshake_timer_) {
+        // Still on the pool strand, where the timeout handler runs
+        handshake_done_ = true;
+        handshake_timer_->cancel();
+    }
+
+    auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - handshake_start_);
+    bool resumed = !ec && SSL_session_reused(stream_.native_handle());
+    tls_handshake_stats().record(latency, resumed, static_cast<bool>(ec));
+
+    if(ec) {
+        logger->log(LogLevel::ERROR, "Handshake failed: " + ec.message());
+        return fail(ec, "handshake");
     }
 
+    logger->log(LogLevel::DEBUG, std::string(resumed ? "Resumed" : "Full") + " handshake successful in " +
+                std::to_string(latency.count()) + " us.");
+
+#ifdef WITH_HTTP2
+    const unsigned char* alpn = nullptr;
+    unsigned int alpn_length = 0;
+    SSL_get0_alpn_selected(stream_.native_handle(), &alpn, &alpn_length);
+    if(alpn_length == sizeof(http2_alpn) - 1 && std::memcmp(alpn, http2_alpn, alpn_length) == 0) {
+        // The HTTP/2 session takes over the connection; this one ends here
+        logger->log(LogLevel::DEBUG, "ALPN selected h2.");
+        return make_pooled<http2_session>(std::move(stream_), std::move(buffer_), doc_root_, app_)->run();
+    }
+#endif
+
+    if(handshake_executor_) {
+        // Back to the session's own executor for the request traffic
+        return net::dispatch(
+                stream_.get_executor(),
+                beast::bind_front_handler(
+                    &session::do_read,
+                    shared_from_this()));
+    }
     do_read();
 }
 
@@ -221,3 +653,166 @@ void session::on_shutdown(boost::beast::error_code ec)
     logger->log(LogLevel::DEBUG, "Shutdown completed.");
 }
 
+/**
+ * @brief Constructs a plaintext session.
+ *
+ * @param stream The connection, on the session's executor.
+ * @param buffer Bytes of the first request already read while detecting TLS.
+ * @param doc_root The document root directory for serving files.
+ * @param app The application serving the API.
+ * @param protocol What the connection is counted as in the connection statistics.
+ */
+template <class Stream>
+basic_plain_session<Stream>::basic_plain_session(
+        Stream&& stream,
+        beast::flat_buffer buffer,
+        std::shared_ptr<std::string const> const& doc_root,
+        std::shared_ptr<Application> app,
+        connection_protocol protocol)
+    : http_session<basic_plain_session<Stream>>(std::move(buffer), doc_root, app)
+    , stream_(std::move(stream))
+    , protocol_(protocol)
+{
+    session_connection_stats().opened(protocol_);
+    auto logger = LoggerManager::getLogger("session_logger", LogLevel::INFO);
+    logger->log(LogLevel::DEBUG, "Plaintext session created.");
+}
+
+template <class Stream>
+basic_plain_session<Stream>::~basic_plain_session()
+{
+    session_connection_stats().closed(protocol_);
+}
+
+/**
+ * @brief Starts reading requests.
+ */
+template <class Stream>
+void basic_plain_session<Stream>::run()
+{
+    net::dispatch(
+            stream_.get_executor(),
+            beast::bind_front_handler(
+                &basic_plain_session::do_read,
+                this->shared_from_this()));
+}
+
+/**
+ * @brief Closes the session by shutting down the sending side of the socket.
+ */
+template <class Stream>
+void basic_plain_session<Stream>::do_close()
+{
+    auto logger = LoggerManager::getLogger("session_logger");
+    logger->log(LogLevel::DEBUG, "Closing plaintext session.");
+
+    beast::error_code ec;
+    stream_.socket().shutdown(net::socket_base::shutdown_send, ec);
+}
+
+/**
+ * @brief Constructs the detector for an accepted connection.
+ *
+ * @param socket The socket for the session.
+ * @param ctx The SSL context for TLS connections.
+ * @param doc_root The document root directory for serving files.
+ * @param app The application serving the API.
+ * @param handshake_executor Executor to run TLS handshakes on; empty to run them on the session's executor.
+ */
+detect_session::detect_session(
+        tcp::socket&& socket,
+        ssl::context& ctx,
+        std::shared_ptr<std::string const> const& doc_root,
+        std::shared_ptr<Application> app,
+        net::any_io_executor handshake_executor)
+    : stream_(std::move(socket))
+    , ctx_(ctx)
+    , doc_root_(doc_root)
+    , app_(std::move(app))
+    , handshake_executor_(std::move(handshake_executor))
+    , buffer_(shared_session_pool().acquire_buffer())
+{
+}
+
+detect_session::~detect_session()
+{
+    // Empty if a session took it over
+    shared_session_pool().release_buffer(std::move(buffer_));
+}
+
+/**
+ * @brief Starts detecting the protocol.
+ */
+void detect_session::run()
+{
+    net::dispatch(
+            stream_.get_executor(),
+            beast::bind_front_handler(
+                &detect_session::on_run,
+                shared_from_this()));
+}
+
+void detect_session::on_run()
+{
+    stream_.expires_after(std::chrono::seconds(30));
+
+    // Reads just enough of the first bytes to tell a TLS ClientHello from an HTTP request line
+    beast::async_detect_ssl(
+            stream_,
+            buffer_,
+            beast::bind_front_handler(
+                &detect_session::on_detect,
+                shared_from_this()));
+}
+
+/**
+ * @brief Creates the session for the detected protocol.
+ *
+ * @param ec The error code, if any, from reading the first bytes.
+ * @param is_tls Whether the bytes start a TLS ClientHello.
+ */
+void detect_session::on_detect(beast::error_code ec, bool is_tls)
+{
+    if(ec) {
+        return fail(ec, "detect");
+    }
+
+    if(is_tls) {
+        make_pooled<session>(
+                stream_.release_socket(), ctx_, doc_root_, app_, handshake_executor_, std::move(buffer_))->run();
+        return;
+    }
+
+    make_pooled<plain_session>(std::move(stream_), std::move(buffer_), doc_root_, app_)->run();
+}
+
+/**
+ * @brief Sets the read buffer capacity a connection keeps while it waits for its next request.
+ *
+ * The default of request_arena::block_size keeps one arena and the read buffer
+ * of a typical request, so requests on a busy keep-alive connection never go to the
+ * session pool. Servers holding many idle connections set it lower; the arenas then
+ * go back to the pool while a connection is idle.
+ *
+ * @param bytes Capacity kept; larger buffers are freed while the connection is idle.
+ */
+void set_idle_buffer_limit(std::size_t bytes)
+{
+    idle_buffer_limit.store(bytes, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Sets the largest read buffer of a connection, which bounds how much is read ahead.
+ *
+ * @param bytes Largest read buffer; raised to 16 KiB, which a request header must fit in.
+ */
+void set_read_buffer_limit(std::size_t bytes)
+{
+    read_buffer_limit.store(std::max(bytes, min_read_buffer_limit), std::memory_order_relaxed);
+}
+
+template class http_session<session>;
+template class http_session<plain_session>;
+template class http_session<local_session>;
+template class basic_plain_session<beast::tcp_stream>;
+template class basic_plain_session<local_stream>;
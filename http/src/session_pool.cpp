@@ -0,0 +1,228 @@
+#include "../include/session_pool.hpp"
+#include "../include/stat_entry.hpp"
+#include <algorithm>
+#include <new>
+
+/**
+ * @brief Returns the memory of a closed session of the same size, or new memory.
+ *
+ * Each session type has its own size, so the caches are looked up by exact size.
+ *
+ * @param size Size of the object, including the shared_ptr control block.
+ * @return Memory aligned like operator new.
+ */
+void* session_pool::allocate(std::size_t size)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& cache : objects_) {
+            if (cache.size == size && !cache.free.empty()) {
+                void* pointer = cache.free.back();
+                cache.free.pop_back();
+                cached_bytes_ -= size;
+                object_counters_.hits.fetch_add(1, std::memory_order_relaxed);
+                return pointer;
+            }
+        }
+    }
+
+    object_counters_.misses.fetch_add(1, std::memory_order_relaxed);
+    return ::operator new(size);
+}
+
+/**
+ * @brief Keeps the memory of a session for reuse, or frees it if the pool is full.
+ *
+ * @param pointer Memory returned by allocate().
+ * @param size The size it was allocated with.
+ */
+void session_pool::deallocate(void* pointer, std::size_t size) noexcept
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto cache = std::find_if(objects_.begin(), objects_.end(),
+                                  [size](const object_cache& c) { return c.size == size; });
+        try {
+            if (cache == objects_.end())
+                cache = objects_.insert(objects_.end(), object_cache{size, {}});
+            if (cache->free.size() < capacity()) {
+                cache->free.push_back(pointer);
+                cached_bytes_ += size;
+                return;
+            }
+        } catch (const std::bad_alloc&) {
+            // Not cached then
+        }
+    }
+
+    ::operator delete(pointer);
+}
+
+/**
+ * @brief An empty read buffer, with the capacity a closed session grew it to if one is cached.
+ *
+ * A session starting on a recycled buffer reads its first requests without growing it.
+ */
+boost::beast::flat_buffer session_pool::acquire_buffer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!buffers_.empty()) {
+            auto buffer = std::move(buffers_.back());
+            buffers_.pop_back();
+            cached_bytes_ -= buffer.capacity();
+            buffer_counters_.hits.fetch_add(1, std::memory_order_relaxed);
+            return buffer;
+        }
+    }
+
+    buffer_counters_.misses.fetch_add(1, std::memory_order_relaxed);
+    return boost::beast::flat_buffer();
+}
+
+/**
+ * @brief Takes back the read buffer of a closed session.
+ *
+ * Buffers that never allocated are not worth keeping; buffers grown past
+ * max_buffer_capacity by a large request are freed so the pool stays small.
+ *
+ * @param buffer The buffer; its contents are discarded.
+ */
+void session_pool::release_buffer(boost::beast::flat_buffer&& buffer) noexcept
+{
+    if (buffer.capacity() == 0 || buffer.capacity() > max_buffer_capacity)
+        return;
+
+    buffer.clear();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (buffers_.size() >= capacity())
+        return;
+    try {
+        cached_bytes_ += buffer.capacity();
+        buffers_.push_back(std::move(buffer));
+    } catch (const std::bad_alloc&) {
+        cached_bytes_ -= buffer.capacity();
+    }
+}
+
+/**
+ * @brief A rewound arena of a closed session, or a new one.
+ */
+std::shared_ptr<request_arena> session_pool::acquire_arena()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!arenas_.empty()) {
+            auto arena = std::move(arenas_.back());
+            arenas_.pop_back();
+            cached_bytes_ -= request_arena::block_size;
+            arena_counters_.hits.fetch_add(1, std::memory_order_relaxed);
+            return arena;
+        }
+    }
+
+    arena_counters_.misses.fetch_add(1, std::memory_order_relaxed);
+    return std::make_shared<request_arena>();
+}
+
+/**
+ * @brief Takes back an arena of a closed session; ignored while a request still uses it.
+ *
+ * The arena keeps its first block only, which is all a typical request needs.
+ *
+ * @param arena The arena; the pool holds the only reference afterwards, or none.
+ */
+void session_pool::release_arena(std::shared_ptr<request_arena>&& arena) noexcept
+{
+    if (!arena || arena.use_count() != 1)
+        return;
+    // Pairs with the release of the last other reference on another thread
+    std::atomic_thread_fence(std::memory_order_acquire);
+    arena->reset(request_arena::block_size);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (arenas_.size() >= capacity())
+        return;
+    try {
+        arenas_.push_back(std::move(arena));
+        cached_bytes_ += request_arena::block_size;
+    } catch (const std::bad_alloc&) {
+        // Not cached then
+    }
+}
+
+/**
+ * @brief Sets how many objects, buffers and arenas of each kind are kept; 0 disables the pool.
+ *
+ * @param capacity Entries kept of each kind; cached entries beyond it are freed.
+ */
+void session_pool::set_capacity(std::size_t capacity)
+{
+    capacity_.store(capacity, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mutex_);
+    trim();
+}
+
+/**
+ * @brief Frees cached entries beyond capacity(); called with mutex_ held.
+ */
+void session_pool::trim()
+{
+    std::size_t keep = capacity();
+    for (auto& cache : objects_) {
+        while (cache.free.size() > keep) {
+            ::operator delete(cache.free.back());
+            cache.free.pop_back();
+            cached_bytes_ -= cache.size;
+        }
+    }
+    while (buffers_.size() > keep) {
+        cached_bytes_ -= buffers_.back().capacity();
+        buffers_.pop_back();
+    }
+    while (arenas_.size() > keep) {
+        cached_bytes_ -= request_arena::block_size;
+        arenas_.pop_back();
+    }
+}
+
+/**
+ * @brief Hits, misses and cached bytes as entries shaped like the performance statistics.
+ *
+ * @return Hit and miss counts and the hit rate in percent for session objects, read
+ * buffers and arenas, and the memory the pool holds.
+ */
+nlohmann::json session_pool::to_json() const
+{
+    nlohmann::json stats_json = nlohmann::json::array();
+    auto add = [&](const std::string& kind, const counters& c) {
+        double hits = static_cast<double>(c.hits.load(std::memory_order_relaxed));
+        double misses = static_cast<double>(c.misses.load(std::memory_order_relaxed));
+        stats_json.push_back(stat_entry("session_pool_" + kind + "_hits", hits));
+        stats_json.push_back(stat_entry("session_pool_" + kind + "_misses", misses));
+        stats_json.push_back(stat_entry("session_pool_" + kind + "_hit_rate",
+                                        hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0));
+    };
+    add("object", object_counters_);
+    add("buffer", buffer_counters_);
+    add("arena", arena_counters_);
+
+    std::size_t cached_bytes;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cached_bytes = cached_bytes_;
+    }
+    stats_json.push_back(stat_entry("session_pool_cached_bytes", static_cast<double>(cached_bytes)));
+    return stats_json;
+}
+
+/**
+ * @brief The session pool of this process.
+ *
+ * Never destroyed, so sessions closing during shutdown can still return their memory.
+ */
+session_pool& shared_session_pool()
+{
+    static session_pool* pool = new session_pool;
+    return *pool;
+}
@@ -0,0 +1,21 @@
+#include "../include/stat_entry.hpp"
+
+/**
+ * @brief A single value as an entry shaped like the performance statistics.
+ *
+ * @param name The metric name.
+ * @param value The value.
+ * @param count The number of samples behind the value.
+ * @return A JSON object with the fields of MetricStatistic.
+ */
+nlohmann::json stat_entry(std::string name, double value, uint64_t count)
+{
+    nlohmann::json stat_json;
+    stat_json["metric_name"] = std::move(name);
+    stat_json["average_value"] = value;
+    stat_json["min_value"] = value;
+    stat_json["max_value"] = value;
+    stat_json["total_value"] = value;
+    stat_json["count"] = count;
+    return stat_json;
+}
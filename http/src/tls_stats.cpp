@@ -0,0 +1,97 @@
+#include "../include/tls_stats.hpp"
+#include "../include/stat_entry.hpp"
+#include <algorithm>
+
+namespace {
+
+int64_t now_seconds()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+void handshake_stats::latency_stat::add(double ms)
+{
+    min_ms = count == 0 ? ms : std::min(min_ms, ms);
+    max_ms = std::max(max_ms, ms);
+    total_ms += ms;
+    ++count;
+}
+
+nlohmann::json handshake_stats::latency_stat::to_json(const char* name) const
+{
+    nlohmann::json stat_json;
+    stat_json["metric_name"] = name;
+    stat_json["average_value"] = count ? total_ms / count : 0.0;
+    stat_json["min_value"] = min_ms;
+    stat_json["max_value"] = max_ms;
+    stat_json["total_value"] = total_ms;
+    stat_json["count"] = count;
+    return stat_json;
+}
+
+/**
+ * @brief Records one handshake.
+ *
+ * @param latency Time from starting the handshake to its completion.
+ * @param resumed Whether the session was resumed from the cache or a ticket.
+ * @param failed Whether the handshake failed; its latency is not recorded.
+ */
+void handshake_stats::record(std::chrono::microseconds latency, bool resumed, bool failed)
+{
+    int64_t second = now_seconds();
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto& bucket = per_second_[second % rate_window];
+    if (bucket.second != second) {
+        bucket = second_bucket{second, 0};
+    }
+    ++bucket.handshakes;
+
+    if (failed) {
+        ++failed_;
+        return;
+    }
+    (resumed ? resumed_ : full_).add(latency.count() / 1000.0);
+}
+
+/**
+ * @brief The statistics as entries shaped like the performance statistics.
+ *
+ * @return Entries for full and resumed handshake latency in milliseconds, failed
+ *         handshakes, the resumption ratio and the handshake rate per second.
+ */
+nlohmann::json handshake_stats::to_json() const
+{
+    int64_t second = now_seconds();
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // Only count whole seconds, so the rate does not dip at the start of each second.
+    uint64_t recent = 0;
+    for (const auto& bucket : per_second_) {
+        if (bucket.second < second && bucket.second >= second - static_cast<int64_t>(rate_window)) {
+            recent += bucket.handshakes;
+        }
+    }
+
+    uint64_t succeeded = full_.count + resumed_.count;
+    nlohmann::json stats_json = nlohmann::json::array();
+    stats_json.push_back(full_.to_json("tls_handshake_full_ms"));
+    stats_json.push_back(resumed_.to_json("tls_handshake_resumed_ms"));
+    stats_json.push_back(stat_entry("tls_handshake_failed", static_cast<double>(failed_), failed_));
+    stats_json.push_back(stat_entry("tls_resumption_ratio",
+                                    succeeded ? static_cast<double>(resumed_.count) / succeeded : 0.0, succeeded));
+    stats_json.push_back(stat_entry("tls_handshakes_per_second", static_cast<double>(recent) / rate_window, recent));
+    return stats_json;
+}
+
+/**
+ * @brief The handshake statistics of this process.
+ */
+handshake_stats& tls_handshake_stats()
+{
+    static handshake_stats stats;
+    return stats;
+}
@@ -3,42 +3,386 @@
 #include "http/include/server_certificate.hpp"
 #include "http/include/http_tools.hpp"
 #include "http/include/server.hpp"
+#include "http/include/local_server.hpp"
+#include "http/include/session.hpp"
+#include "http/include/session_pool.hpp"
 #include "http/include/client.hpp"
 #include "app/include/application.hpp"
+#include "app/include/batch_runner.hpp"
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
 #include <boost/asio/ssl.hpp>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
 #include <string>
 #include <memory>
 #include <thread>
 #include <vector>
 
+/**
+ * @brief Pins a thread to one CPU, wrapping around when there are more threads than CPUs.
+ */
+void pin_to_cpu(std::thread& thread, unsigned index, std::shared_ptr<Logger> logger)
+{
+    unsigned cpus = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % cpus, &set);
+    if (pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) != 0)
+        logger->log(LogLevel::ERROR, "Failed to pin thread " + std::to_string(index) + " to a CPU.");
+}
+
+/**
+ * @brief Serves HTTPS with one io_context and one SO_REUSEPORT acceptor per thread.
+ *
+ * Every connection is accepted, handshaken and served by the thread that owns its
+ * shard, so handlers never migrate between cores and the shards share no scheduler
+ * queue. The application (query workers, timers, outbound clients) runs on shard 0.
+ */
+int run_sharded(tcp::endpoint endpoint, std::shared_ptr<std::string const> doc_root, int threads, bool pin_cpus,
+                server_options options, local_listener_options local, ApplicationOptions app_options,
+                std::shared_ptr<Logger> logger)
+{
+    std::vector<std::unique_ptr<net::io_context>> shards;
+    shards.reserve(threads);
+    for (int i = 0; i < threads; ++i)
+        shards.push_back(std::make_unique<net::io_context>(1));
+
+    ssl::context ctx{ssl::context::tls};
+    load_server_certificate(ctx, options.tls);
+    auto app = std::make_shared<Application>(*shards[0], ctx, app_options);
+
+    options.reuse_port = true;
+    options.strand_per_session = false;
+
+    std::vector<std::shared_ptr<server>> servers;
+    for (auto& shard : shards)
+    {
+        servers.push_back(std::make_shared<server>(*shard, ctx, endpoint, doc_root, app, options));
+        servers.back()->run();
+    }
+
+    // Same-host clients are few; shard 0 serves the Unix socket next to its TCP share.
+    if (!local.path.empty())
+    {
+        int listener = open_local_listener(local, logger);
+        if (listener < 0)
+            return EXIT_FAILURE;
+        std::make_shared<local_server>(*shards[0], listener, doc_root, app)->run();
+    }
+
+    logger->log(LogLevel::INFO, "Serving with " + std::to_string(threads) + " sharded io_contexts" +
+                (pin_cpus ? " pinned to CPUs." : "."));
+
+    std::vector<std::thread> v;
+    v.reserve(threads);
+    for (int i = 0; i < threads; ++i)
+    {
+        v.emplace_back([&ioc = *shards[i]] { ioc.run(); });
+        if (pin_cpus)
+            pin_to_cpu(v.back(), i, logger);
+    }
+    for (auto& t : v)
+        t.join();
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Runs a JSONL file of prompts through the application instead of serving HTTP.
+ *
+ * Usage: main --batch <input.jsonl> <output.jsonl> [concurrency] [--ordered]
+ */
+int run_batch(int argc, char* argv[], std::shared_ptr<Logger> logger)
+{
+    if (argc < 4)
+    {
+        logger->log(LogLevel::ERROR, "Usage: main --batch <input.jsonl> <output.jsonl> [concurrency] [--ordered]");
+        return EXIT_FAILURE;
+    }
+
+    BatchOptions options;
+    options.input_path = argv[2];
+    options.output_path = argv[3];
+    for (int i = 4; i < argc; ++i)
+    {
+        if (std::string(argv[i]) == "--ordered")
+            options.ordered = true;
+        else
+            options.concurrency = std::max<int>(1, std::atoi(argv[i]));
+    }
+
+    net::io_context ioc{1};
+    ssl::context ctx{ssl::context::tlsv12_client};
+
+    // One processing thread per in-flight prompt; progress is tracked by the batch checkpoint instead of the journal
+    ApplicationOptions app_options;
+    app_options.workers = options.concurrency;
+    app_options.journal_path.clear();
+    Application app(ioc, ctx, app_options);
+
+    logger->log(LogLevel::INFO, "Running batch " + options.input_path + " -> " + options.output_path +
+                " with concurrency " + std::to_string(options.concurrency) + ".");
+    return BatchRunner(app, options).run();
+}
+
+/// Set by SIGINT/SIGTERM in the prefork supervisor.
+volatile std::sig_atomic_t stop_requested = 0;
+
+void on_stop_signal(int)
+{
+    stop_requested = 1;
+}
+
+/**
+ * @brief Body of one prefork worker process; never returns.
+ *
+ * Runs the usual multi-threaded server on the listening socket inherited from the
+ * supervisor. Each worker keeps its own journal; query state that other workers
+ * must see goes through the shared query store.
+ */
+[[noreturn]] void run_worker(int worker, int listener, tcp::endpoint endpoint, std::shared_ptr<std::string const> doc_root,
+                             int threads, server_options options, int local_listener, ApplicationOptions app_options,
+                             std::shared_ptr<SharedQueryStore> store, std::shared_ptr<Logger> logger)
+{
+    ::signal(SIGINT, SIG_DFL);
+    ::signal(SIGTERM, SIG_DFL);
+
+    net::io_context ioc{threads};
+    ssl::context ctx{ssl::context::tls};
+    load_server_certificate(ctx, options.tls);
+
+    app_options.journal_path = "query_journal." + std::to_string(worker) + ".log";
+    app_options.shared_store = store;
+    auto app = std::make_shared<Application>(ioc, ctx, app_options);
+
+    options.native_listener = listener;
+    std::make_shared<server>(ioc, ctx, endpoint, doc_root, app, options)->run();
+    if (local_listener >= 0)
+        std::make_shared<local_server>(ioc, local_listener, doc_root, app)->run();
+
+    logger->log(LogLevel::INFO, "Worker " + std::to_string(worker) + " (pid " + std::to_string(::getpid()) + ") serving.");
+
+    std::vector<std::thread> v;
+    v.reserve(threads - 1);
+    for (auto i = threads - 1; i > 0; --i)
+        v.emplace_back([&ioc] { ioc.run(); });
+    ioc.run();
+
+    std::_Exit(EXIT_SUCCESS);
+}
+
+/**
+ * @brief Forks worker processes that share one listening socket, and restarts them when they die.
+ *
+ * The supervisor binds and listens before forking, so connections queue up in the
+ * kernel while a crashed worker is being replaced. It also maps the shared query
+ * store and the session ticket keys, which every worker (including restarted ones)
+ * inherits.
+ */
+int run_prefork(tcp::endpoint endpoint, std::shared_ptr<std::string const> doc_root, int threads, int processes,
+                server_options options, local_listener_options local, ApplicationOptions app_options,
+                std::shared_ptr<Logger> logger)
+{
+    int listener = -1;
+    {
+        net::io_context ioc{1};
+        tcp::acceptor acceptor(ioc);
+        boost::beast::error_code ec;
+        acceptor.open(endpoint.protocol(), ec);
+        if (!ec)
+            acceptor.set_option(net::socket_base::reuse_address(true), ec);
+        if (!ec)
+            acceptor.bind(endpoint, ec);
+        if (!ec)
+            acceptor.listen(net::socket_base::max_listen_connections, ec);
+        if (ec)
+        {
+            logger->log(LogLevel::ERROR, "Error setting up listener: " + ec.message());
+            return EXIT_FAILURE;
+        }
+        // Keep a descriptor that outlives the acceptor and its io_context.
+        listener = ::dup(acceptor.native_handle());
+    }
+
+    // Workers share the Unix socket the same way they share the TCP listener.
+    int local_listener = -1;
+    if (!local.path.empty() && (local_listener = open_local_listener(local, logger)) < 0)
+        return EXIT_FAILURE;
+
+    auto store = std::make_shared<SharedQueryStore>();
+    share_ticket_keys(options.tls);  // Tickets issued by one worker resume on any other
+
+    struct sigaction action{};
+    action.sa_handler = on_stop_signal;
+    sigemptyset(&action.sa_mask);
+    ::sigaction(SIGINT, &action, nullptr);  // No SA_RESTART, so waitpid() wakes up
+    ::sigaction(SIGTERM, &action, nullptr);
+
+    std::vector<pid_t> workers(processes, -1);
+    std::vector<std::chrono::steady_clock::time_point> started(processes);
+    auto spawn = [&](int worker) {
+        pid_t pid = ::fork();
+        if (pid == 0)
+            run_worker(worker, listener, endpoint, doc_root, threads, options, local_listener, app_options, store, logger);
+        if (pid < 0)
+            logger->log(LogLevel::ERROR, "Failed to fork worker " + std::to_string(worker) + ".");
+        workers[worker] = pid;
+        started[worker] = std::chrono::steady_clock::now();
+    };
+
+    for (int i = 0; i < processes; ++i)
+        spawn(i);
+    logger->log(LogLevel::INFO, "Supervising " + std::to_string(processes) + " worker processes.");
+
+    while (!stop_requested)
+    {
+        int status = 0;
+        pid_t pid = ::waitpid(-1, &status, 0);
+        if (pid < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;  // No children left
+        }
+
+        auto it = std::find(workers.begin(), workers.end(), pid);
+        if (it == workers.end())
+            continue;
+        int worker = static_cast<int>(it - workers.begin());
+
+        logger->log(LogLevel::ERROR, "Worker " + std::to_string(worker) + " (pid " + std::to_string(pid) + ") " +
+                    (WIFSIGNALED(status) ? "killed by signal " + std::to_string(WTERMSIG(status))
+                                         : "exited with status " + std::to_string(WEXITSTATUS(status))) + ".");
+        if (stop_requested)
+            break;
+
+        // Do not spin if a worker dies right after it starts.
+        if (std::chrono::steady_clock::now() - started[worker] < std::chrono::seconds(1))
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        spawn(worker);
+    }
+
+    logger->log(LogLevel::INFO, "Stopping worker processes.");
+    for (pid_t pid : workers)
+        if (pid > 0)
+            ::kill(pid, SIGTERM);
+    while (::waitpid(-1, nullptr, 0) > 0 || errno == EINTR)
+        ;
+
+    ::close(listener);
+    if (local_listener >= 0)
+        ::close(local_listener);
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char* argv[])
 {
     auto logger = LoggerManager::getLogger("MainLogger", LogLevel::DEBUG, LogOutput::CONSOLE);
+
+    if (argc >= 2 && std::string(argv[1]) == "--batch")
+    {
+        return run_batch(argc, argv, logger);
+    }
     
-    if (argc != 5)
+    if (argc < 5)
     {
-        logger->log(LogLevel::ERROR, "Invalid number of arguments.");
+        logger->log(LogLevel::ERROR, "Usage: main <address> <port> <doc_root> <threads> [--sharded] [--pin-cpus] [--prefork <processes>]"
+                    " [--handshake-threads <n>] [--allow-plaintext] [--max-body-bytes <n>] [--session-pool <n>]"
+                    " [--idle-buffer-bytes <n>] [--read-buffer-bytes <n>] [--keep-tls-buffers]"
+                    " [--unix-socket <path> [--unix-socket-mode <octal>] [--unix-socket-group <group>]]"
+                    " [--webhook-ca-file <pem>]");
         return EXIT_FAILURE;
     }
 
+#if defined(BOOST_ASIO_HAS_IO_URING) && defined(BOOST_ASIO_DISABLE_EPOLL)
+    logger->log(LogLevel::INFO, "Socket I/O backend: io_uring.");
+#else
+    logger->log(LogLevel::INFO, "Socket I/O backend: epoll.");
+#endif
+
     logger->log(LogLevel::DEBUG, "Parsing command line arguments.");
     auto const address = net::ip::make_address(argv[1]);
     auto const port = static_cast<unsigned short>(std::atoi(argv[2]));
     auto const doc_root = std::make_shared<std::string>(argv[3]);
     auto const threads = std::max<int>(1, std::atoi(argv[4]));
 
+    bool sharded = false;
+    bool pin_cpus = false;
+    int processes = 0;
+    server_options options;
+    local_listener_options local;
+    ApplicationOptions app_options;
+    for (int i = 5; i < argc; ++i)
+    {
+        std::string flag = argv[i];
+        if (flag == "--sharded")
+            sharded = true;
+        else if (flag == "--pin-cpus")
+            pin_cpus = true;
+        else if (flag == "--prefork" && i + 1 < argc)
+            processes = std::max<int>(1, std::atoi(argv[++i]));
+        else if (flag == "--handshake-threads" && i + 1 < argc)
+            options.handshake_threads = std::max<int>(0, std::atoi(argv[++i]));
+        else if (flag == "--allow-plaintext")
+            options.allow_plaintext = true;
+        else if (flag == "--max-body-bytes" && i + 1 < argc)
+            set_default_body_limit(static_cast<std::size_t>(std::strtoull(argv[++i], nullptr, 10)));
+        else if (flag == "--session-pool" && i + 1 < argc)
+            shared_session_pool().set_capacity(static_cast<std::size_t>(std::strtoull(argv[++i], nullptr, 10)));
+        else if (flag == "--idle-buffer-bytes" && i + 1 < argc)
+            set_idle_buffer_limit(static_cast<std::size_t>(std::strtoull(argv[++i], nullptr, 10)));
+        else if (flag == "--read-buffer-bytes" && i + 1 < argc)
+            set_read_buffer_limit(static_cast<std::size_t>(std::strtoull(argv[++i], nullptr, 10)));
+        else if (flag == "--keep-tls-buffers")
+            options.tls.release_buffers = false;
+        else if (flag == "--unix-socket" && i + 1 < argc)
+            local.path = argv[++i];
+        else if (flag == "--unix-socket-mode" && i + 1 < argc)
+            local.mode = static_cast<mode_t>(std::strtol(argv[++i], nullptr, 8));
+        else if (flag == "--unix-socket-group" && i + 1 < argc)
+            local.group = argv[++i];
+        else if (flag == "--webhook-ca-file" && i + 1 < argc)
+            app_options.webhook.ca_file = argv[++i];
+        else
+        {
+            logger->log(LogLevel::ERROR, "Unknown option: " + flag);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (processes > 0 && sharded)
+    {
+        logger->log(LogLevel::ERROR, "--prefork and --sharded cannot be combined.");
+        return EXIT_FAILURE;
+    }
+
+    if (processes > 0)
+        return run_prefork(tcp::endpoint{address, port}, doc_root, threads, processes, options, local, app_options, logger);
+
+    if (pin_cpus && !sharded)
+        logger->log(LogLevel::INFO, "--pin-cpus only applies with --sharded, ignoring it.");
+
+    if (sharded)
+        return run_sharded(tcp::endpoint{address, port}, doc_root, threads, pin_cpus, options, local, app_options, logger);
+
     // Initialize the io_context
     logger->log(LogLevel::DEBUG, "Initializing io_context.");
     net::io_context ioc{threads};
 
     // Initialize SSL context
     logger->log(LogLevel::DEBUG, "Initializing SSL context.");
-    ssl::context ctx{ssl::context::tlsv12};
-    load_server_certificate(ctx);
+    ssl::context ctx{ssl::context::tls};
+    load_server_certificate(ctx, options.tls);
     // Initialize the Application
-    auto app = std::make_shared<Application>(ioc, ctx);
+    auto app = std::make_shared<Application>(ioc, ctx, app_options);
     // Start the server to accept incoming connections
     logger->log(LogLevel::DEBUG, "Starting the HTTP server.");
     auto server_instance = std::make_shared<server>(
@@ -46,9 +390,19 @@ int main(int argc, char* argv[])
         ctx,
         tcp::endpoint{address, port},
         doc_root,
-        app);
+        app,
+        options);
     server_instance->run();
 
+    // Plain HTTP for clients on the same host
+    if (!local.path.empty())
+    {
+        int listener = open_local_listener(local, logger);
+        if (listener < 0)
+            return EXIT_FAILURE;
+        std::make_shared<local_server>(ioc, listener, doc_root, app)->run();
+    }
+
     // Run the I/O context in multiple threads
     std::vector<std::thread> v;
     v.reserve(threads - 1);
@@ -435,8 +435,12 @@ class Ollama
     // Generate a streaming reply where a user-defined callback function is invoked when each token is received.
     bool generate(ollama::request& request, std::function<void(const ollama::response&)> on_receive_token)
     {
+        return generate_serialized(request.dump(), on_receive_token);
+    }
 
-        std::string request_string = request.dump();
+    // Generate a streaming reply from a request body that has already been serialized to JSON.
+    bool generate_serialized(const std::string& request_string, std::function<void(const ollama::response&)> on_receive_token)
+    {
         if (ollama::log_requests) std::cout << request_string << std::endl;
 
         std::shared_ptr<std::vector<std::string>> partial_responses = std::make_shared<std::vector<std::string>>();
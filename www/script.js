@@ -1,4 +1,5 @@
 let lastResponse = ""; // Variable to store the last response from the LLM
+let lastContext = []; // Context tokens returned with the last completed query
 const ctx = document.getElementById('performanceChart').getContext('2d');
 let chart; // Reference to the Chart.js instance
 
@@ -29,10 +30,7 @@ function sendQuery(query) {
         },
         body: JSON.stringify({
             message: query,
-            context: {
-                response: lastResponse, // Include the last response as context
-                done: true
-            }
+            context: lastContext // Continue the conversation from the last completed query
         })
     })
     .then(response => response.json())
@@ -95,6 +93,7 @@ function fetchQueryUpdates(queryId) {
 
                 // Store the last response in the global variable for use in the next query
                 lastResponse = currentResponseText.trim();
+                lastContext = status.context || [];
             }
 
         })